@@ -0,0 +1,95 @@
+#include "server.h"
+#include <string.h>
+#include "admit.h"
+
+struct ip_count {
+    in_addr_t addr;
+    int count;   // 0 marks a free entry
+};
+
+// Open addressing with linear probing; entries are removed by backward shift
+static struct ip_count *ip_table;
+static unsigned ip_mask;   // table size - 1, size a power of two > 2 * cfg.max_clients
+static in_addr_t *slot_addr;
+static char *slot_tracked;
+
+void admit_init(void) {
+    unsigned size = 64;
+    while (size <= 2 * (unsigned)cfg.max_clients) size <<= 1;
+    ip_table = pool_alloc(size, sizeof(struct ip_count));
+    ip_mask = size - 1;
+    slot_addr = pool_alloc(cfg.max_clients, sizeof(in_addr_t));
+    slot_tracked = pool_alloc(cfg.max_clients, 1);
+}
+
+static unsigned ip_hash(in_addr_t addr) {
+    return (unsigned)(addr * 2654435761u) & ip_mask;
+}
+
+static struct ip_count *ip_find(in_addr_t addr, int create) {
+    unsigned i = ip_hash(addr);
+    while (ip_table[i].count > 0) {
+        if (ip_table[i].addr == addr) return &ip_table[i];
+        i = (i + 1) & ip_mask;
+    }
+    if (!create) return NULL;
+    ip_table[i].addr = addr;
+    return &ip_table[i];
+}
+
+static void ip_remove(struct ip_count *e) {
+    unsigned hole = (unsigned)(e - ip_table);
+    unsigned i = hole;
+    e->count = 0;
+    while (1) {
+        i = (i + 1) & ip_mask;
+        if (ip_table[i].count == 0) return;
+        unsigned home = ip_hash(ip_table[i].addr);
+        // Move the entry back if the hole lies on its probe path
+        if (((i - home) & ip_mask) >= ((i - hole) & ip_mask)) {
+            ip_table[hole] = ip_table[i];
+            ip_table[i].count = 0;
+            hole = i;
+        }
+    }
+}
+
+static int is_loopback(in_addr_t addr) {
+    return (ntohl(addr) >> 24) == 127;
+}
+
+static int retry_after(void) {
+    return ADMIT_RETRY_SECS + rand() % (ADMIT_RETRY_SECS + 1);
+}
+
+// Returns 0 to admit, otherwise the retry-after hint in seconds
+int admit_check(int slot, const struct sockaddr_in *peer) {
+    if (slot < 0) return retry_after();
+    if (cfg.per_ip_cap > 0 && peer && !is_loopback(peer->sin_addr.s_addr)) {
+        struct ip_count *e = ip_find(peer->sin_addr.s_addr, 0);
+        if (e && e->count >= cfg.per_ip_cap) return retry_after();
+    }
+    return 0;
+}
+
+void admit_track(int slot, const struct sockaddr_in *peer) {
+    if (!peer || slot_tracked[slot]) return;
+    struct ip_count *e = ip_find(peer->sin_addr.s_addr, 1);
+    e->count++;
+    slot_addr[slot] = peer->sin_addr.s_addr;
+    slot_tracked[slot] = 1;
+}
+
+void admit_release(int slot) {
+    if (!slot_tracked[slot]) return;
+    struct ip_count *e = ip_find(slot_addr[slot], 0);
+    if (e && --e->count == 0) ip_remove(e);
+    slot_tracked[slot] = 0;
+}
+
+void admit_reject(int fd, int retry_secs) {
+    char msg[32];
+    int len = snprintf(msg, sizeof(msg), "f%d\n", retry_secs);
+    // A fresh socket has an empty send buffer; never wait on it here
+    send(fd, msg, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+}
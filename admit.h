@@ -0,0 +1,23 @@
+#ifndef ADMIT_H
+#define ADMIT_H
+
+#include <netinet/in.h>
+
+#define ACCEPT_BATCH 64       // connections taken off the backlog per wakeup
+#define ADMIT_RETRY_SECS 5    // base of the retry-after hint, jittered up to 2x
+
+/*
+ * Admission control for new connections. A connection that cannot be
+ * admitted (no free slot, or its address is at the cap) gets
+ * "f<seconds>\n" and is closed; the jittered retry-after spreads the
+ * reconnects of a storm instead of letting them all come back at once.
+ * cfg.per_ip_cap of 0 disables the per-address cap; loopback is never
+ * capped.
+ */
+void admit_init(void);
+int admit_check(int slot, const struct sockaddr_in *peer);
+void admit_track(int slot, const struct sockaddr_in *peer);
+void admit_release(int slot);
+void admit_reject(int fd, int retry_secs);
+
+#endif
@@ -0,0 +1,538 @@
+#include "unp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "game.h"
+#include "gamelog.h"
+#include "histogram.h"
+
+#define ANALYTICS_CHUNK 4096       // records a worker claims at a time
+#define ANALYTICS_MAX_OPENING 5    // plies per opening line; 9^5 lines per variant
+#define ANALYTICS_TOP 10           // openings shown on stdout
+
+/*
+ * Offline analytics over game logs (gamelog.file). The logs are mapped
+ * read-only and every core claims chunks of records from a shared cursor,
+ * so the live server is never involved and nothing is copied. Each worker
+ * keeps its own tallies, merged once at the end.
+ *
+ * Every game is replayed with the server's rules and win kernels (game.c).
+ * A mover who could have won on the spot and didn't has missed a win; a
+ * move that hands the opponent a win on the spot, when some other move
+ * wouldn't have, allowed one. Both count as blunders. One set of winning
+ * columns per position serves both checks; alternatives are only tried
+ * after a move that allowed a win.
+ *
+ * Results go to <outdir>/<table>.c4col, a columnar file: a text header
+ * ("c4col 1", "rows N", one "<name> <type>" line per column, "data") and
+ * then each column's N values back to back, u64 and f64 as 8 bytes in host
+ * order, str32 as 32 bytes padded with NULs.
+ */
+struct segment {
+    const struct gamelog_record *recs;
+    long long n;
+    atomic_llong next;
+};
+
+struct outcome {
+    unsigned long long games, p1, p2, draws;
+};
+
+struct player_stat {
+    char name[GAMELOG_NAME_LEN];   // empty for a free slot
+    unsigned long long games, wins, losses, draws, moves;
+    unsigned long long missed_wins, allowed_wins;
+    unsigned long long timeouts, quits, disconnects;
+};
+
+struct ptable {
+    struct player_stat *slots;
+    size_t cap, count;
+};
+
+struct tally {
+    unsigned long long invalid;
+    unsigned long long games[GAME_NVARIANTS];
+    unsigned long long plies[GAME_NVARIANTS];
+    unsigned long long missed_wins[GAME_NVARIANTS];
+    unsigned long long allowed_wins[GAME_NVARIANTS];
+    unsigned long long reasons[GAME_NVARIANTS][GAME_END_REASONS];
+    unsigned long long length[GAME_NVARIANTS][GAMELOG_MAX_PLIES + 1];
+    struct outcome result[GAME_NVARIANTS];
+    struct outcome first_move[GAME_NVARIANTS][GAME_MAX_COLS];
+    struct outcome *openings;      // opening_lines per variant
+    struct ptable players;
+};
+
+struct worker {
+    pthread_t tid;
+    struct tally t;
+};
+
+struct segment *segments;
+int nsegments;
+int nthreads = 0;
+int opening_plies = 4;
+long long opening_lines;
+const char *outdir = "analytics";
+
+static const char *reason_names[GAME_END_REASONS] = {
+    "win", "full", "timeout", "quit", "disconnect", "abandoned"
+};
+
+// ---- players ----
+
+static unsigned long long hash_name(const char *s) {
+    unsigned long long h = 0xcbf29ce484222325ULL;
+    while (*s) h = (h ^ (unsigned char)*s++) * 0x100000001b3ULL;
+    return h;
+}
+
+static struct player_stat *player_slot(struct ptable *pt, const char *name) {
+    size_t i = hash_name(name) & (pt->cap - 1);
+    while (pt->slots[i].name[0] && strcmp(pt->slots[i].name, name) != 0) i = (i + 1) & (pt->cap - 1);
+    return &pt->slots[i];
+}
+
+static struct player_stat *player_find(struct ptable *pt, const char *name) {
+    if ((pt->count + 1) * 2 > pt->cap) {
+        struct ptable grown = { NULL, pt->cap ? pt->cap * 2 : 1024, pt->count };
+        if (!(grown.slots = calloc(grown.cap, sizeof(struct player_stat)))) err_sys("calloc error");
+        for (size_t i = 0; i < pt->cap; i++) {
+            if (pt->slots[i].name[0]) *player_slot(&grown, pt->slots[i].name) = pt->slots[i];
+        }
+        free(pt->slots);
+        *pt = grown;
+    }
+    struct player_stat *p = player_slot(pt, name);
+    if (!p->name[0]) {
+        snprintf(p->name, sizeof(p->name), "%s", name);
+        pt->count++;
+    }
+    return p;
+}
+
+// ---- replay ----
+
+// Columns where `piece` wins on the spot, one bit each
+static unsigned winning_moves(const struct game *g, int piece) {
+    unsigned wins = 0;
+    for (int c = 0; c < g->v->cols; c++) {
+        struct game h = *g;
+        if (game_play(&h, c, piece) >= 0 && game_won(&h, piece)) wins |= 1u << c;
+    }
+    return wins;
+}
+
+// Whether `piece` had a move that leaves the opponent no win on the spot
+static int had_safe_move(const struct game *g, int piece) {
+    for (int c = 0; c < g->v->cols; c++) {
+        struct game h = *g;
+        if (game_play(&h, c, piece) >= 0 && !winning_moves(&h, 3 - piece)) return 1;
+    }
+    return 0;
+}
+
+static void count_outcome(struct outcome *o, int result) {
+    o->games++;
+    if (result == GAMELOG_P1) o->p1++;
+    else if (result == GAMELOG_P2) o->p2++;
+    else if (result == GAMELOG_DRAWN) o->draws++;
+}
+
+static void analyse(const struct gamelog_record *r, struct tally *t) {
+    if (r->magic != GAMELOG_MAGIC || r->variant >= GAME_NVARIANTS || r->result > GAMELOG_NONE ||
+        r->reason >= GAME_END_REASONS) {
+        t->invalid++;
+        return;
+    }
+    const struct game_variant *v = &game_variants[r->variant];
+    int plies = r->plies;
+    if (plies > v->rows * v->cols) {
+        t->invalid++;
+        return;
+    }
+
+    struct game g, prev;
+    unsigned missed[2] = { 0, 0 }, allowed[2] = { 0, 0 };
+    unsigned wins_prev = 0;
+    game_init(&g, v);
+    prev = g;
+    for (int ply = 0; ply <= plies; ply++) {
+        int piece = 1 + (ply & 1);
+        // The last position only matters if the game stopped without a win or a full board
+        if (ply == plies && (r->reason == GAME_END_WIN || r->reason == GAME_END_DRAW)) break;
+
+        unsigned wins = winning_moves(&g, piece);
+        if (ply > 0 && wins && !wins_prev && had_safe_move(&prev, 3 - piece)) allowed[(ply - 1) & 1]++;
+        if (ply == plies) break;
+
+        int col = r->moves[ply];
+        if (wins && !(wins & (1u << col))) missed[ply & 1]++;
+        prev = g;
+        if (game_play(&g, col, piece) < 0) {
+            t->invalid++;
+            return;
+        }
+        wins_prev = wins;
+    }
+
+    int vi = r->variant;
+    t->games[vi]++;
+    t->plies[vi] += plies;
+    t->length[vi][plies]++;
+    t->reasons[vi][r->reason]++;
+    t->missed_wins[vi] += missed[0] + missed[1];
+    t->allowed_wins[vi] += allowed[0] + allowed[1];
+    count_outcome(&t->result[vi], r->result);
+    if (plies >= 1) count_outcome(&t->first_move[vi][r->moves[0]], r->result);
+    if (plies >= opening_plies) {
+        long long line = 0;
+        for (int i = 0; i < opening_plies; i++) line = line * GAME_MAX_COLS + r->moves[i];
+        count_outcome(&t->openings[vi * opening_lines + line], r->result);
+    }
+
+    for (int seat = 0; seat < 2; seat++) {
+        char name[GAMELOG_NAME_LEN];
+        snprintf(name, sizeof(name), "%.*s", GAMELOG_NAME_LEN - 1, r->names[seat][0] ? r->names[seat] : "?");
+        struct player_stat *p = player_find(&t->players, name);
+        int won = r->result == GAMELOG_P1 + seat;
+        int lost = r->result == GAMELOG_P2 - seat;
+        p->games++;
+        p->wins += won;
+        p->losses += lost;
+        p->draws += r->result == GAMELOG_DRAWN;
+        p->moves += (plies + 1 - seat) / 2;
+        p->missed_wins += missed[seat];
+        p->allowed_wins += allowed[seat];
+        p->timeouts += lost && r->reason == GAME_END_TIMEOUT;
+        p->quits += lost && r->reason == GAME_END_QUIT;
+        p->disconnects += lost && r->reason == GAME_END_DISCONNECT;
+    }
+}
+
+static void *worker_main(void *arg) {
+    struct worker *w = arg;
+
+    for (int s = 0; s < nsegments; s++) {
+        struct segment *seg = &segments[s];
+        for (;;) {
+            long long from = atomic_fetch_add(&seg->next, ANALYTICS_CHUNK);
+            if (from >= seg->n) break;
+            long long to = from + ANALYTICS_CHUNK < seg->n ? from + ANALYTICS_CHUNK : seg->n;
+            for (long long i = from; i < to; i++) analyse(&seg->recs[i], &w->t);
+        }
+    }
+    return NULL;
+}
+
+static void outcome_merge(struct outcome *dst, const struct outcome *src) {
+    dst->games += src->games;
+    dst->p1 += src->p1;
+    dst->p2 += src->p2;
+    dst->draws += src->draws;
+}
+
+static void tally_merge(struct tally *dst, const struct tally *src) {
+    dst->invalid += src->invalid;
+    for (int v = 0; v < GAME_NVARIANTS; v++) {
+        dst->games[v] += src->games[v];
+        dst->plies[v] += src->plies[v];
+        dst->missed_wins[v] += src->missed_wins[v];
+        dst->allowed_wins[v] += src->allowed_wins[v];
+        for (int i = 0; i < GAME_END_REASONS; i++) dst->reasons[v][i] += src->reasons[v][i];
+        for (int i = 0; i <= GAMELOG_MAX_PLIES; i++) dst->length[v][i] += src->length[v][i];
+        outcome_merge(&dst->result[v], &src->result[v]);
+        for (int c = 0; c < GAME_MAX_COLS; c++) outcome_merge(&dst->first_move[v][c], &src->first_move[v][c]);
+    }
+    for (long long i = 0; i < GAME_NVARIANTS * opening_lines; i++) outcome_merge(&dst->openings[i], &src->openings[i]);
+    for (size_t i = 0; i < src->players.cap; i++) {
+        const struct player_stat *s = &src->players.slots[i];
+        if (!s->name[0]) continue;
+        struct player_stat *d = player_find(&dst->players, s->name);
+        d->games += s->games;
+        d->wins += s->wins;
+        d->losses += s->losses;
+        d->draws += s->draws;
+        d->moves += s->moves;
+        d->missed_wins += s->missed_wins;
+        d->allowed_wins += s->allowed_wins;
+        d->timeouts += s->timeouts;
+        d->quits += s->quits;
+        d->disconnects += s->disconnects;
+    }
+}
+
+static void tally_init(struct tally *t) {
+    memset(t, 0, sizeof(*t));
+    if (!(t->openings = calloc(GAME_NVARIANTS * opening_lines, sizeof(struct outcome)))) err_sys("calloc error");
+}
+
+// ---- columnar output ----
+
+#define COL_U64 0
+#define COL_F64 1
+#define COL_STR 2
+
+struct column {
+    const char *name;
+    int type;
+    void *data;                    // rows values, allocated by col_new()
+};
+
+struct table {
+    const char *name;
+    char *spec;                    // column names point into it
+    long long rows, cap;
+    int ncols;
+    struct column cols[16];
+};
+
+static const char *type_names[] = { "u64", "f64", "str32" };
+static const size_t type_sizes[] = { 8, 8, 32 };
+
+static void table_init(struct table *tb, const char *name, long long cap, const char *spec) {
+    // spec: "name:type,..." with type u, f or s
+    memset(tb, 0, sizeof(*tb));
+    tb->name = name;
+    tb->cap = cap > 0 ? cap : 1;
+    if (!(tb->spec = strdup(spec))) err_sys("strdup error");
+    for (char *tok = strtok(tb->spec, ","); tok && tb->ncols < 16; tok = strtok(NULL, ",")) {
+        char *colon = strchr(tok, ':');
+        struct column *c = &tb->cols[tb->ncols++];
+        *colon = '\0';
+        c->name = tok;
+        c->type = colon[1] == 'f' ? COL_F64 : colon[1] == 's' ? COL_STR : COL_U64;
+        if (!(c->data = calloc(tb->cap, type_sizes[c->type]))) err_sys("calloc error");
+    }
+}
+
+// Appends a row; values follow the column order, strings as const char *
+static void table_row(struct table *tb, ...) {
+    va_list ap;
+    long long r = tb->rows++;
+    va_start(ap, tb);
+    for (int i = 0; i < tb->ncols; i++) {
+        struct column *c = &tb->cols[i];
+        if (c->type == COL_U64) ((unsigned long long *)c->data)[r] = va_arg(ap, unsigned long long);
+        else if (c->type == COL_F64) ((double *)c->data)[r] = va_arg(ap, double);
+        else strncpy((char *)c->data + r * 32, va_arg(ap, const char *), 32);
+    }
+    va_end(ap);
+}
+
+static void table_write(struct table *tb) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s.c4col", outdir, tb->name);
+    FILE *f = fopen(path, "wb");
+    if (!f) err_sys("analytics: cannot write %s", path);
+    fprintf(f, "c4col 1\nrows %lld\n", tb->rows);
+    for (int i = 0; i < tb->ncols; i++) fprintf(f, "%s %s\n", tb->cols[i].name, type_names[tb->cols[i].type]);
+    fprintf(f, "data\n");
+    for (int i = 0; i < tb->ncols; i++) fwrite(tb->cols[i].data, type_sizes[tb->cols[i].type], tb->rows, f);
+    if (fclose(f) != 0) err_sys("analytics: cannot write %s", path);
+    for (int i = 0; i < tb->ncols; i++) free(tb->cols[i].data);
+    free(tb->spec);
+}
+
+static double p1_score(const struct outcome *o) {
+    unsigned long long decided = o->p1 + o->p2 + o->draws;
+    return decided ? (o->p1 + o->draws / 2.0) / decided : 0;
+}
+
+static void opening_name(long long line, char *out, size_t size) {
+    int cols[ANALYTICS_MAX_OPENING], n = 0;
+    for (int i = 0; i < opening_plies; i++, line /= GAME_MAX_COLS) cols[opening_plies - 1 - i] = (int)(line % GAME_MAX_COLS);
+    for (int i = 0; i < opening_plies; i++) n += snprintf(out + n, size - n, i ? "-%d" : "%d", cols[i] + 1);
+}
+
+static const struct tally *sort_tally;
+
+static int by_games_desc(const void *a, const void *b) {
+    unsigned long long ga = sort_tally->openings[*(const long long *)a].games;
+    unsigned long long gb = sort_tally->openings[*(const long long *)b].games;
+    return ga < gb ? 1 : ga > gb ? -1 : 0;
+}
+
+static int by_player_games(const void *a, const void *b) {
+    const struct player_stat *pa = a, *pb = b;
+    if (pa->games != pb->games) return pa->games < pb->games ? 1 : -1;
+    return strcmp(pa->name, pb->name);
+}
+
+static void write_tables(const struct tally *t) {
+    struct table tb;
+    char line[64];
+
+    if (mkdir(outdir, 0755) < 0 && errno != EEXIST) err_sys("analytics: cannot create %s", outdir);
+
+    table_init(&tb, "summary", GAME_NVARIANTS,
+               "variant:s,games:u,p1_wins:u,p2_wins:u,draws:u,plies:u,avg_plies:f,p1_score:f,"
+               "full:u,timeouts:u,quits:u,disconnects:u,abandoned:u,missed_wins:u,allowed_wins:u");
+    for (int v = 0; v < GAME_NVARIANTS; v++) {
+        const unsigned long long *rs = t->reasons[v];
+        if (!t->games[v]) continue;
+        table_row(&tb, game_variants[v].name, t->games[v], t->result[v].p1, t->result[v].p2, t->result[v].draws,
+                  t->plies[v], (double)t->plies[v] / t->games[v], p1_score(&t->result[v]),
+                  rs[GAME_END_DRAW], rs[GAME_END_TIMEOUT], rs[GAME_END_QUIT], rs[GAME_END_DISCONNECT],
+                  rs[GAME_END_ABANDONED], t->missed_wins[v], t->allowed_wins[v]);
+    }
+    table_write(&tb);
+
+    table_init(&tb, "lengths", GAME_NVARIANTS * (GAMELOG_MAX_PLIES + 1), "variant:s,plies:u,games:u");
+    for (int v = 0; v < GAME_NVARIANTS; v++) {
+        for (int p = 0; p <= GAMELOG_MAX_PLIES; p++) {
+            if (t->length[v][p]) table_row(&tb, game_variants[v].name, (unsigned long long)p, t->length[v][p]);
+        }
+    }
+    table_write(&tb);
+
+    table_init(&tb, "first_move", GAME_NVARIANTS * GAME_MAX_COLS,
+               "variant:s,column:u,games:u,p1_wins:u,p2_wins:u,draws:u,p1_score:f");
+    for (int v = 0; v < GAME_NVARIANTS; v++) {
+        for (int c = 0; c < game_variants[v].cols; c++) {
+            const struct outcome *o = &t->first_move[v][c];
+            if (o->games) table_row(&tb, game_variants[v].name, (unsigned long long)c + 1, o->games, o->p1, o->p2, o->draws, p1_score(o));
+        }
+    }
+    table_write(&tb);
+
+    long long *order = malloc(sizeof(long long) * GAME_NVARIANTS * opening_lines);
+    long long n = 0;
+    if (!order) err_sys("malloc error");
+    for (long long i = 0; i < GAME_NVARIANTS * opening_lines; i++) if (t->openings[i].games) order[n++] = i;
+    sort_tally = t;
+    qsort(order, n, sizeof(long long), by_games_desc);
+    table_init(&tb, "openings", n, "variant:s,line:s,games:u,p1_wins:u,p2_wins:u,draws:u,p1_score:f");
+    for (long long i = 0; i < n; i++) {
+        const struct outcome *o = &t->openings[order[i]];
+        opening_name(order[i] % opening_lines, line, sizeof(line));
+        table_row(&tb, game_variants[order[i] / opening_lines].name, line, o->games, o->p1, o->p2, o->draws, p1_score(o));
+    }
+    table_write(&tb);
+
+    // Top openings of the most played variant, for the terminal
+    int top = 0;
+    for (int v = 1; v < GAME_NVARIANTS; v++) if (t->games[v] > t->games[top]) top = v;
+    for (long long i = 0, shown = 0; i < n && shown < ANALYTICS_TOP; i++) {
+        if (order[i] / opening_lines != top) continue;
+        const struct outcome *o = &t->openings[order[i]];
+        if (shown == 0) printf("top %s openings (%d plies):\n", game_variants[top].name, opening_plies);
+        opening_name(order[i] % opening_lines, line, sizeof(line));
+        printf("  %-12s %10llu games  P1 score %5.1f%%\n", line, o->games, 100.0 * p1_score(o));
+        shown++;
+    }
+    free(order);
+
+    struct player_stat *ps = malloc(sizeof(struct player_stat) * (t->players.count ? t->players.count : 1));
+    n = 0;
+    if (!ps) err_sys("malloc error");
+    for (size_t i = 0; i < t->players.cap; i++) if (t->players.slots[i].name[0]) ps[n++] = t->players.slots[i];
+    qsort(ps, n, sizeof(struct player_stat), by_player_games);
+    table_init(&tb, "players", n,
+               "name:s,games:u,wins:u,losses:u,draws:u,moves:u,blunders:u,missed_wins:u,allowed_wins:u,"
+               "timeouts:u,quits:u,disconnects:u");
+    for (long long i = 0; i < n; i++) {
+        const struct player_stat *p = &ps[i];
+        table_row(&tb, p->name, p->games, p->wins, p->losses, p->draws, p->moves, p->missed_wins + p->allowed_wins,
+                  p->missed_wins, p->allowed_wins, p->timeouts, p->quits, p->disconnects);
+    }
+    table_write(&tb);
+    free(ps);
+}
+
+static void report(const struct tally *t, long long records, double secs) {
+    unsigned long long games = 0, plies = 0;
+    for (int v = 0; v < GAME_NVARIANTS; v++) {
+        games += t->games[v];
+        plies += t->plies[v];
+    }
+    printf("=== analytics: %llu games, %llu moves in %.2fs (%.1fM moves/s), %d threads, %llu invalid of %lld ===\n",
+           games, plies, secs, secs > 0 ? plies / secs / 1e6 : 0, nthreads, t->invalid, records);
+    for (int v = 0; v < GAME_NVARIANTS; v++) {
+        unsigned long long g = t->games[v];
+        if (!g) continue;
+        printf("%-5s %10llu games  avg %5.1f plies  P1 %5.1f%%  P2 %5.1f%%  draw %5.1f%%  P1 score %5.1f%%\n",
+               game_variants[v].name, g, (double)t->plies[v] / g, 100.0 * t->result[v].p1 / g,
+               100.0 * t->result[v].p2 / g, 100.0 * t->result[v].draws / g, 100.0 * p1_score(&t->result[v]));
+        printf("      ended by");
+        for (int i = 0; i < GAME_END_REASONS; i++) printf(" %s %.1f%%", reason_names[i], 100.0 * t->reasons[v][i] / g);
+        printf("\n      blunders per 100 moves: %.2f missed wins, %.2f allowed wins\n",
+               t->plies[v] ? 100.0 * t->missed_wins[v] / t->plies[v] : 0,
+               t->plies[v] ? 100.0 * t->allowed_wins[v] / t->plies[v] : 0);
+    }
+}
+
+void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-t threads] [-k opening plies (1-%d)] [-o outdir] gamelog...\n",
+            prog, ANALYTICS_MAX_OPENING);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    long long records = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "t:k:o:")) != -1) {
+        switch (c) {
+            case 't': nthreads = atoi(optarg); break;
+            case 'k': opening_plies = atoi(optarg); break;
+            case 'o': outdir = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind == argc || opening_plies < 1 || opening_plies > ANALYTICS_MAX_OPENING) usage(argv[0]);
+    if (nthreads <= 0) nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads <= 0) nthreads = 1;
+    opening_lines = 1;
+    for (int i = 0; i < opening_plies; i++) opening_lines *= GAME_MAX_COLS;
+
+    // Whole records only: the server may be appending to the last file
+    nsegments = argc - optind;
+    if (!(segments = calloc(nsegments, sizeof(struct segment)))) err_sys("calloc error");
+    for (int i = 0; i < nsegments; i++) {
+        struct stat st;
+        int fd = open(argv[optind + i], O_RDONLY);
+        if (fd < 0 || fstat(fd, &st) < 0) err_sys("analytics: cannot open %s", argv[optind + i]);
+        segments[i].n = st.st_size / (off_t)sizeof(struct gamelog_record);
+        atomic_init(&segments[i].next, 0);
+        if (segments[i].n > 0) {
+            size_t len = segments[i].n * sizeof(struct gamelog_record);
+            void *p = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) err_sys("analytics: cannot map %s", argv[optind + i]);
+            madvise(p, len, MADV_SEQUENTIAL);
+            segments[i].recs = p;
+        }
+        close(fd);
+        records += segments[i].n;
+    }
+
+    struct worker *workers = calloc(nthreads, sizeof(struct worker));
+    if (!workers) err_sys("calloc error");
+    long long start = monotonic_ns();
+    for (int i = 0; i < nthreads; i++) {
+        tally_init(&workers[i].t);
+        if (pthread_create(&workers[i].tid, NULL, worker_main, &workers[i]) != 0) err_sys("pthread_create error");
+    }
+
+    struct tally total;
+    tally_init(&total);
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(workers[i].tid, NULL);
+        tally_merge(&total, &workers[i].t);
+        free(workers[i].t.openings);
+        free(workers[i].t.players.slots);
+    }
+    report(&total, records, (monotonic_ns() - start) / 1e9);
+    write_tables(&total);
+    printf("tables written to %s/\n", outdir);
+    return 0;
+}
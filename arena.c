@@ -0,0 +1,34 @@
+#include "server.h"
+#include "arena.h"
+
+static char *slab;           // cfg.max_rooms regions of cfg.room_arena_size bytes
+static size_t region_size;
+static size_t *arena_used;
+
+void arena_init(void) {
+    // Regions start on cache-line boundaries
+    region_size = ((size_t)cfg.room_arena_size + 63) & ~(size_t)63;
+    slab = pool_alloc(cfg.max_rooms, region_size);
+    arena_used = pool_alloc(cfg.max_rooms, sizeof(size_t));
+}
+
+static int room_slot(struct Room* room) {
+    return room->id - room_id_base;
+}
+
+// Returns NULL when the room's region is exhausted
+void *room_alloc(struct Room* room, size_t size) {
+    int slot = room_slot(room);
+    size_t start = (arena_used[slot] + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (start + size > region_size) return NULL;
+    arena_used[slot] = start + size;
+    return slab + slot * region_size + start;
+}
+
+void room_arena_reset(struct Room* room) {
+    arena_used[room_slot(room)] = 0;
+}
+
+size_t room_arena_used(struct Room* room) {
+    return arena_used[room_slot(room)];
+}
@@ -0,0 +1,21 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_ALIGN 16
+
+struct Room;
+
+/*
+ * Per-room region allocator. Every room slot owns a fixed region
+ * (cfg.room_arena_size bytes) of one slab allocated at startup; anything whose lifetime is the room's (audience list, chat
+ * history, ...) is bump-allocated from it and released all at once by
+ * room_arena_reset() when the room closes. There is no per-object free.
+ */
+void arena_init(void);
+void *room_alloc(struct Room* room, size_t size);
+void room_arena_reset(struct Room* room);
+size_t room_arena_used(struct Room* room);
+
+#endif
@@ -0,0 +1,300 @@
+#include "server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "histogram.h"
+#include "lobby.h"
+#include "arena.h"
+
+/*
+ * Microbenchmarks for the server's hot paths. Each case runs `warmup`
+ * untimed samples, then `reps` timed samples of `batch` operations; the
+ * per-op times of the samples are reported as min/percentiles/max.
+ * Output is CSV (default) or JSON lines (-j) on stdout.
+ */
+struct bench_result {
+    const char *name;
+    int size;
+    int batch;
+    double *samples;
+    int nsamples;
+};
+
+typedef void (*bench_setup_fn)(int size);
+typedef void (*bench_run_fn)(int size, int batch);
+
+int reps = 200;
+int warmup = 20;
+int json_output = 0;
+const char *filter = NULL;
+
+volatile long long bench_sink;
+int sink_fds[DEFAULT_MAX_CLIENTS];
+int nsink_fds = 0;
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double pct(const double *sorted, int n, double p) {
+    int idx = (int)(p / 100.0 * (n - 1) + 0.5);
+    return sorted[idx];
+}
+
+void report(struct bench_result *r) {
+    qsort(r->samples, r->nsamples, sizeof(double), cmp_double);
+    double sum = 0;
+    for (int i = 0; i < r->nsamples; i++) sum += r->samples[i];
+    double mean = sum / r->nsamples;
+
+    if (json_output) {
+        printf("{\"benchmark\":\"%s\",\"size\":%d,\"samples\":%d,\"batch\":%d,"
+               "\"min_ns\":%.2f,\"p50_ns\":%.2f,\"p90_ns\":%.2f,\"p99_ns\":%.2f,"
+               "\"max_ns\":%.2f,\"mean_ns\":%.2f}\n",
+               r->name, r->size, r->nsamples, r->batch,
+               r->samples[0], pct(r->samples, r->nsamples, 50), pct(r->samples, r->nsamples, 90),
+               pct(r->samples, r->nsamples, 99), r->samples[r->nsamples - 1], mean);
+    } else {
+        printf("%s,%d,%d,%d,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f\n",
+               r->name, r->size, r->nsamples, r->batch,
+               r->samples[0], pct(r->samples, r->nsamples, 50), pct(r->samples, r->nsamples, 90),
+               pct(r->samples, r->nsamples, 99), r->samples[r->nsamples - 1], mean);
+    }
+    fflush(stdout);
+}
+
+void run_bench(const char *name, const int *sizes, int nsizes, int batch,
+               bench_setup_fn setup, bench_run_fn run) {
+    if (filter && !strstr(name, filter)) return;
+
+    struct bench_result r;
+    r.name = name;
+    r.batch = batch;
+    r.samples = malloc(sizeof(double) * reps);
+    if (!r.samples) err_sys("malloc error");
+
+    for (int s = 0; s < nsizes; s++) {
+        r.size = sizes[s];
+        r.nsamples = reps;
+        if (setup) setup(sizes[s]);
+        for (int i = 0; i < warmup; i++) run(sizes[s], batch);
+        for (int i = 0; i < reps; i++) {
+            long long t0 = monotonic_ns();
+            run(sizes[s], batch);
+            long long t1 = monotonic_ns();
+            r.samples[i] = (double)(t1 - t0) / batch;
+        }
+        report(&r);
+    }
+    free(r.samples);
+}
+
+// ---- fixtures ----
+
+void reset_server_state() {
+    clear_players();
+    memset(room_status, 0, cfg.max_rooms);
+    memset(room_active, 0, cfg.max_rooms);
+    memset(rooms, -1, sizeof(struct Room) * cfg.max_rooms);
+    for (int i = 0; i < cfg.max_rooms; i++) {
+        rooms[i].id = room_id_base + i;
+        rooms[i].audience = NULL;
+        room_arena_reset(&rooms[i]);
+    }
+    lobby_rebuild();
+    init_waiting_list();
+    next_id = 1;
+}
+
+// Every player gets its own /dev/null descriptor: writes cost a real
+// syscall but never block or fill a buffer.
+void open_sinks(int n) {
+    while (nsink_fds < n) {
+        int fd = open("/dev/null", O_WRONLY);
+        if (fd < 0) err_sys("open /dev/null");
+        sink_fds[nsink_fds++] = fd;
+    }
+}
+
+void add_players(int n) {
+    open_sinks(n);
+    for (int i = 0; i < n; i++) {
+        player_set(&players[i], next_id++, sink_fds[i]);
+        snprintf(players[i].name, MAX_NAME_LEN, "bench%d", i);
+        players[i].room_id = -1;
+        players[i].player_number = 0;
+    }
+}
+
+// Plays `moves` random legal moves on a classic board; returns the piece
+// that moved last (0 for an empty board).
+int random_game(struct game *g, int moves) {
+    int last = 0;
+    game_init(g, GAME_CLASSIC);
+    for (int m = 0; m < moves; m++) {
+        int col, tries = 0;
+        do {
+            col = rand() % g->v->cols;
+        } while (g->height[col] >= g->v->rows && ++tries < 100);
+        if (game_play(g, col, m % 2 + 1) < 0) break;
+        last = m % 2 + 1;
+    }
+    return last;
+}
+
+#define BOARD_VARIANTS 64
+int bench_last[BOARD_VARIANTS];
+struct game bench_games[BOARD_VARIANTS];
+
+void setup_boards(int moves) {
+    srand(moves + 1);
+    for (int i = 0; i < BOARD_VARIANTS; i++) bench_last[i] = random_game(&bench_games[i], moves);
+}
+
+// ---- benchmarks ----
+
+void run_game_won(int size, int batch) {
+    long long acc = 0;
+    (void)size;
+    for (int i = 0; i < batch; i++) {
+        int v = i % BOARD_VARIANTS;
+        acc += bench_last[v] && game_won(&bench_games[v], bench_last[v]);
+    }
+    bench_sink = acc;
+}
+
+void setup_serialize(int moves) {
+    setup_boards(moves);
+    reset_server_state();
+    rooms[0].id = room_id_base;
+    rooms[0].game = bench_games[0];
+}
+
+void run_serialize(int size, int batch) {
+    char buf[BOARD_MSG_LEN];
+    long long acc = 0;
+    (void)size;
+    for (int i = 0; i < batch; i++) acc += serialize_board(&rooms[0], buf);
+    bench_sink = acc;
+}
+
+char parse_input[MAXLINE];
+int parse_len;
+
+// `lines` frames that go through parsing and player lookup but touch no
+// sockets: moves and chat from ids that are not connected.
+void setup_parse(int lines) {
+    reset_server_state();
+    add_players(cfg.max_clients);
+    parse_len = 0;
+    for (int i = 0; i < lines; i++) {
+        int left = (int)sizeof(parse_input) - parse_len;
+        int n = (i % 2 == 0)
+            ? snprintf(parse_input + parse_len, left, "s%d %d\n", 100000 + i, i % 7 + 1)
+            : snprintf(parse_input + parse_len, left, "c%d;hello there %d\n", 100000 + i, i);
+        if (n >= left) break;
+        parse_len += n;
+    }
+}
+
+void run_parse(int size, int batch) {
+    char buf[MAXLINE];
+    (void)size;
+    for (int i = 0; i < batch; i++) {
+        memcpy(buf, parse_input, parse_len);
+        handle_client_message(-1, buf, parse_len);
+    }
+}
+
+void setup_find_player(int nplayers) {
+    reset_server_state();
+    add_players(nplayers);
+}
+
+void run_find_player(int size, int batch) {
+    long long acc = 0;
+    for (int i = 0; i < batch; i++) {
+        // Alternate between the last slot (worst hit) and a miss
+        struct Player *p = find_player_by_id((i & 1) ? size : -2);
+        acc += p ? p->fd : 0;
+    }
+    bench_sink = acc;
+}
+
+void setup_notify(int audience) {
+    reset_server_state();
+    add_players(audience + 2);
+    struct Room *room = &rooms[0];
+    game_init(&room->game, GAME_CLASSIC);
+    room->id = room_id_base;
+    room->player_1 = players[0].id;
+    room->player_2 = players[1].id;
+    ROOM_ACTIVE(room) = 1;
+    room->audience = room_alloc(room, sizeof(long long) * cfg.max_audience);
+    room->audience_count = audience;
+    for (int i = 0; i < audience; i++) room->audience[i] = players[i + 2].id;
+    room_status[0] = 1;
+}
+
+void run_notify(int size, int batch) {
+    char board_msg[BOARD_MSG_LEN];
+    (void)size;
+    serialize_board(&rooms[0], board_msg);
+    for (int i = 0; i < batch; i++) notify_room(room_id_base, board_msg);
+}
+
+void setup_waitlist(int count) {
+    reset_server_state();
+    for (int i = 0; i < count; i++) add_to_waitlist(i + 1);
+}
+
+// remove_from_waitlist() + add_to_waitlist() keeps the queue at `size`
+void run_waitlist(int size, int batch) {
+    (void)size;
+    for (int i = 0; i < batch; i++) add_to_waitlist(remove_from_waitlist());
+}
+
+void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-r reps] [-w warmup] [-f filter] [-j]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    int c;
+    while ((c = getopt(argc, argv, "r:w:f:j")) != -1) {
+        switch (c) {
+            case 'r': reps = atoi(optarg); break;
+            case 'w': warmup = atoi(optarg); break;
+            case 'f': filter = optarg; break;
+            case 'j': json_output = 1; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (reps <= 0 || warmup < 0) usage(argv[0]);
+
+    // Built-in defaults, so results compare across machines and configs
+    config_defaults();
+    server_init();
+    reset_server_state();
+
+    if (!json_output) printf("benchmark,size,samples,batch,min_ns,p50_ns,p90_ns,p99_ns,max_ns,mean_ns\n");
+
+    const int fill[] = { 0, 7, 21, 35, 42 };
+    const int lines[] = { 1, 8, 64, 128 };
+    const int nplayers[] = { 1, 10, 25, DEFAULT_MAX_CLIENTS };
+    const int audience[] = { 0, 8, 24, DEFAULT_MAX_AUDIENCE };
+    const int waiting[] = { 1, 10, 25, DEFAULT_MAX_CLIENTS };
+
+    run_bench("game_won", fill, 5, 4096, setup_boards, run_game_won);
+    run_bench("serialize_board", fill, 5, 4096, setup_serialize, run_serialize);
+    run_bench("handle_client_message", lines, 4, 64, setup_parse, run_parse);
+    run_bench("find_player_by_id", nplayers, 4, 4096, setup_find_player, run_find_player);
+    run_bench("notify_room", audience, 4, 16, setup_notify, run_notify);
+    run_bench("remove_from_waitlist", waiting, 4, 4096, setup_waitlist, run_waitlist);
+
+    reset_server_state();
+    return 0;
+}
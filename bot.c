@@ -0,0 +1,459 @@
+#include "bot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+
+struct bot_options bot_opts;
+struct bot_counters bot_stats;
+struct histogram move_latency;
+struct histogram match_latency;
+struct histogram connect_latency;
+struct histogram think_time;
+
+static struct bot *bots;
+static struct pollfd *pfds;
+static struct bot_counters last_stats;
+static volatile sig_atomic_t stop_requested = 0;
+
+static int known_rooms[KNOWN_ROOMS];
+static int known_count = 0;
+
+void bot_defaults(void) {
+    bot_opts.nbots = 100;
+    bot_opts.spectator_pct = 10;
+    bot_opts.chat_per_min = 0;
+    bot_opts.think_ms = 0;
+    bot_opts.ramp_per_sec = 1000;
+    bot_opts.duration = 30;
+    bot_opts.requeue_ms = RETRY_DELAY_NS / 1000000;
+    bot_opts.engine = engine_find("random");
+    bot_opts.depth = ENGINE_DEFAULT_DEPTH;
+    bot_opts.name = "bot";
+}
+
+static void remember_room(int room_id) {
+    for (int i = 0; i < known_count && i < KNOWN_ROOMS; i++) {
+        if (known_rooms[i] == room_id) return;
+    }
+    known_rooms[known_count++ % KNOWN_ROOMS] = room_id;
+}
+
+static int pick_known_room() {
+    int n = known_count < KNOWN_ROOMS ? known_count : KNOWN_ROOMS;
+    if (n == 0) return -1;
+    return known_rooms[rand() % n];
+}
+
+static long long chat_interval_ns() {
+    if (bot_opts.chat_per_min <= 0) return 0;
+    double mean = 60e9 / bot_opts.chat_per_min;
+    // Uniform jitter in [0.5, 1.5) of the mean keeps bots from syncing up
+    return (long long)(mean * (0.5 + (double)rand() / RAND_MAX));
+}
+
+static void bot_send(struct bot *b, const char *fmt, ...) {
+    va_list ap;
+    char line[MAXLINE];
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (n <= 0 || n >= (int)sizeof(line)) return;
+    if (b->outlen + n > (int)sizeof(b->out)) return;
+    memcpy(b->out + b->outlen, line, n);
+    b->outlen += n;
+    bot_stats.msgs_out++;
+}
+
+static int ai_move(struct bot *b) {
+    long long start = monotonic_ns();
+    long long nodes = b->ctx.nodes;
+    int column = bot_opts.engine->choose(&b->game, b->piece, &b->ctx);
+    hist_record(&think_time, monotonic_ns() - start);
+    bot_stats.engine_nodes += b->ctx.nodes - nodes;
+    bot_stats.engine_depth += b->ctx.reached;
+    return column;
+}
+
+static void bot_queue(struct bot *b, long long now) {
+    game_init(&b->game, GAME_CLASSIC);
+    b->my_turn = 0;
+    b->move_sent_ns = 0;
+    b->room_id = -1;
+    if (b->spectator) {
+        int room_id = pick_known_room();
+        if (room_id == -1) {
+            b->state = BOT_IDLE;
+            b->next_retry_ns = now + RETRY_DELAY_NS;
+            return;
+        }
+        bot_send(b, "m4%lld;%d\n", b->id, room_id);
+        b->state = BOT_QUEUED;
+    } else {
+        bot_send(b, "m1%lld\n", b->id);
+        b->queue_sent_ns = now;
+        b->state = BOT_QUEUED;
+    }
+}
+
+// <name><index>, then <name><index>-<k> while a player holds it with a token
+static void bot_name(struct bot *b) {
+    if (b->name_tries) bot_send(b, "n%s%d-%d\n", bot_opts.name, (int)(b - bots), b->name_tries);
+    else bot_send(b, "n%s%d\n", bot_opts.name, (int)(b - bots));
+}
+
+static void bot_game_over(struct bot *b, long long now) {
+    if (b->spectator) {
+        bot_send(b, "l%lld\n", b->id);
+        b->next_retry_ns = now + RETRY_DELAY_NS;
+    } else {
+        bot_stats.games++;
+        b->next_retry_ns = now + bot_opts.requeue_ms * 1000000LL;
+    }
+    b->state = BOT_IDLE;
+}
+
+static void bot_handle_line(struct bot *b, char *msg, long long now) {
+    bot_stats.msgs_in++;
+    switch (msg[0]) {
+        case 'f':
+            // Server full: honour the retry-after hint
+            bot_stats.rejected++;
+            b->reconnect_ns = now + atoi(msg + 1) * 1000000000LL;
+            break;
+
+        case 'i':
+            sscanf(msg + 1, "%lld", &b->id);
+            bot_queue(b, now);
+            break;
+
+        case 'r': {
+            int room_id;
+            if (sscanf(msg + 1, "%d", &room_id) == 1) {
+                b->room_id = room_id;
+                if (!b->spectator) remember_room(room_id);
+            }
+            game_init(&b->game, GAME_CLASSIC);
+            break;
+        }
+
+        case 'v': {
+            // The room is not the classic board; the next "s" uses its geometry
+            char name[16];
+            const struct game_variant *v;
+            if (sscanf(msg + 1, "%15[^;]", name) == 1 && (v = game_variant_find(name))) {
+                game_init(&b->game, v);
+            }
+            break;
+        }
+
+        case 'p':
+            if (msg[1] == '2') {
+                b->state = BOT_PLAYING;
+                b->next_chat_ns = now + chat_interval_ns();
+                if (b->queue_sent_ns) {
+                    hist_record(&match_latency, now - b->queue_sent_ns);
+                    b->queue_sent_ns = 0;
+                }
+            } else if (msg[1] == '3') {
+                long long turn;
+                sscanf(msg + 2, "%lld", &turn);
+                b->my_turn = (turn == b->id);
+                if (b->my_turn) b->next_move_ns = now + bot_opts.think_ms * 1000000LL;
+            } else if (msg[1] == '4') {
+                b->piece = atoi(msg + 2);
+            } else if (msg[1] == '9') {
+                b->state = BOT_WATCHING;
+                b->next_chat_ns = now + chat_interval_ns();
+            }
+            break;
+
+        case 's': {
+            // Bottom row first, so replaying the cells in order stacks every column
+            const struct game_variant *v = b->game.v;
+            int idx = 1;
+            game_init(&b->game, v);
+            for (int i = 0; i < v->rows; i++) {
+                for (int j = 0; j < v->cols && msg[idx]; j++) {
+                    int piece = msg[idx++] - '0';
+                    if (piece == 1 || piece == 2) game_play(&b->game, j, piece);
+                }
+            }
+            if (b->move_sent_ns) {
+                hist_record(&move_latency, now - b->move_sent_ns);
+                b->move_sent_ns = 0;
+                bot_stats.moves++;
+            }
+            break;
+        }
+
+        case 'e':
+            bot_game_over(b, now);
+            break;
+
+        case 'c':
+            bot_stats.chats_in++;
+            break;
+
+        case 'w':
+            if (b->state == BOT_NAMING) {
+                // "Name is registered to another player"
+                if (++b->name_tries < BOT_NAME_TRIES) {
+                    bot_name(b);
+                } else {
+                    bot_stats.failures++;
+                    b->state = BOT_CLOSED;
+                }
+                break;
+            }
+            // "Room closed" / "Cannot join" / "Room full": go back and retry
+            if (strncmp(msg + 1, "Matching", 8) != 0 && b->state != BOT_PLAYING) {
+                b->state = BOT_IDLE;
+                b->next_retry_ns = now + RETRY_DELAY_NS;
+            }
+            break;
+    }
+}
+
+static void bot_close(struct bot *b, struct pollfd *p) {
+    if (b->fd >= 0) close(b->fd);
+    b->fd = -1;
+    b->state = BOT_CLOSED;
+    p->fd = -1;
+}
+
+static void bot_read(struct bot *b, struct pollfd *p, long long now) {
+    ssize_t n = read(b->fd, b->in + b->inlen, sizeof(b->in) - 1 - b->inlen);
+    if (n <= 0) {
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+        bot_stats.failures++;
+        bot_close(b, p);
+        return;
+    }
+    bot_stats.bytes_in += n;
+    b->inlen += n;
+    b->in[b->inlen] = '\0';
+
+    char *start = b->in;
+    char *nl;
+    while ((nl = memchr(start, '\n', b->in + b->inlen - start)) != NULL) {
+        *nl = '\0';
+        if (nl > start) bot_handle_line(b, start, now);
+        start = nl + 1;
+    }
+    // Asked to come back later, or out of names to try
+    if (b->reconnect_ns || b->state == BOT_CLOSED) {
+        b->inlen = 0;
+        bot_close(b, p);
+        return;
+    }
+    // Keep any partial line for the next read
+    b->inlen -= start - b->in;
+    memmove(b->in, start, b->inlen);
+    if (b->inlen == (int)sizeof(b->in) - 1) b->inlen = 0;
+}
+
+static void bot_flush(struct bot *b, struct pollfd *p) {
+    if (b->outlen == 0) return;
+    ssize_t n = write(b->fd, b->out, b->outlen);
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EINTR) return;
+        bot_stats.failures++;
+        bot_close(b, p);
+        return;
+    }
+    bot_stats.bytes_out += n;
+    b->outlen -= n;
+    memmove(b->out, b->out + n, b->outlen);
+}
+
+static void bot_connect(struct bot *b, struct pollfd *p, const struct sockaddr_in *addr) {
+    b->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (b->fd < 0) {
+        bot_stats.failures++;
+        b->state = BOT_CLOSED;
+        return;
+    }
+    fcntl(b->fd, F_SETFL, fcntl(b->fd, F_GETFL, 0) | O_NONBLOCK);
+    b->state = BOT_CONNECTING;
+    b->queue_sent_ns = monotonic_ns();
+    if (connect(b->fd, (const SA *)addr, sizeof(*addr)) < 0 && errno != EINPROGRESS) {
+        bot_stats.failures++;
+        bot_close(b, p);
+        return;
+    }
+    p->fd = b->fd;
+}
+
+static void bot_timers(struct bot *b, long long now) {
+    if (b->state == BOT_IDLE && now >= b->next_retry_ns) {
+        bot_queue(b, now);
+    }
+    if (b->state == BOT_PLAYING && b->my_turn && !b->move_sent_ns && now >= b->next_move_ns) {
+        int column = ai_move(b);
+        if (column != -1) {
+            bot_send(b, "s%lld %d\n", b->id, column);
+            b->move_sent_ns = now;
+            b->my_turn = 0;
+        }
+    }
+    if ((b->state == BOT_PLAYING || b->state == BOT_WATCHING) &&
+        bot_opts.chat_per_min > 0 && now >= b->next_chat_ns) {
+        bot_send(b, "c%lld;load test chat %d\n", b->id, rand() % 1000);
+        bot_stats.chats_out++;
+        b->next_chat_ns = now + chat_interval_ns();
+    }
+}
+
+static void print_interval(double secs) {
+    printf("[%6.1fs] out=%llu/s in=%llu/s moves=%llu/s games=%llu chats=%llu/s kB_out=%.1f/s kB_in=%.1f/s fail=%llu\n",
+           secs,
+           bot_stats.msgs_out - last_stats.msgs_out,
+           bot_stats.msgs_in - last_stats.msgs_in,
+           bot_stats.moves - last_stats.moves,
+           bot_stats.games,
+           bot_stats.chats_out - last_stats.chats_out,
+           (bot_stats.bytes_out - last_stats.bytes_out) / 1024.0,
+           (bot_stats.bytes_in - last_stats.bytes_in) / 1024.0,
+           bot_stats.failures);
+    fflush(stdout);
+    last_stats = bot_stats;
+}
+
+static void handle_stop_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+/*
+ * Connects bot_opts.nbots bots at ramp_per_sec and drives them until the
+ * duration runs out or SIGINT, printing one progress line per second and
+ * the summary at the end.
+ */
+void bot_run(const struct sockaddr_in *addr, const char *title) {
+    int nbots = bot_opts.nbots;
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, handle_stop_signal);
+    srand((unsigned)getpid());
+
+    bots = calloc(nbots, sizeof(struct bot));
+    pfds = calloc(nbots, sizeof(struct pollfd));
+    if (!bots || !pfds) err_sys("calloc error");
+    for (int i = 0; i < nbots; i++) {
+        bots[i].fd = -1;
+        bots[i].state = BOT_CLOSED;
+        bots[i].spectator = (i * 100 / nbots) < bot_opts.spectator_pct;
+        engine_ctx_init(&bots[i].ctx, bot_opts.depth, (unsigned)rand());
+        pfds[i].fd = -1;
+    }
+    hist_init(&move_latency);
+    hist_init(&match_latency);
+    hist_init(&connect_latency);
+    hist_init(&think_time);
+
+    long long start = monotonic_ns();
+    long long end = bot_opts.duration > 0 ? start + bot_opts.duration * 1000000000LL : 0;
+    long long next_report = start + 1000000000LL;
+    int opened = 0;
+
+    while (!stop_requested) {
+        long long now = monotonic_ns();
+        if (end && now >= end) break;
+
+        // Ramp up connections at the configured rate
+        int target = (int)((now - start) / 1000000000.0 * bot_opts.ramp_per_sec) + 1;
+        if (target > nbots) target = nbots;
+        while (opened < target) {
+            bot_connect(&bots[opened], &pfds[opened], addr);
+            opened++;
+        }
+
+        for (int i = 0; i < opened; i++) {
+            if (bots[i].state == BOT_CLOSED && bots[i].reconnect_ns && now >= bots[i].reconnect_ns) {
+                bots[i].reconnect_ns = 0;
+                bots[i].outlen = 0;
+                bot_connect(&bots[i], &pfds[i], addr);
+            }
+            if (bots[i].state == BOT_CLOSED) continue;
+            if (bots[i].state != BOT_CONNECTING) bot_timers(&bots[i], now);
+            pfds[i].events = POLLIN;
+            if (bots[i].state == BOT_CONNECTING || bots[i].outlen > 0) pfds[i].events |= POLLOUT;
+        }
+
+        int nready = poll(pfds, opened, 10);
+        if (nready < 0) {
+            if (errno == EINTR) continue;
+            err_sys("poll error");
+        }
+        now = monotonic_ns();
+
+        for (int i = 0; i < opened && nready > 0; i++) {
+            struct bot *b = &bots[i];
+            if (pfds[i].fd < 0 || pfds[i].revents == 0) continue;
+            nready--;
+
+            if (b->state == BOT_CONNECTING) {
+                int err = 0;
+                socklen_t len = sizeof(err);
+                getsockopt(b->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                if (err != 0) {
+                    bot_stats.failures++;
+                    bot_close(b, &pfds[i]);
+                    continue;
+                }
+                bot_stats.connects++;
+                hist_record(&connect_latency, now - b->queue_sent_ns);
+                b->queue_sent_ns = 0;
+                b->state = BOT_NAMING;
+                b->name_tries = 0;
+                bot_name(b);
+            }
+            if (pfds[i].revents & (POLLIN | POLLERR | POLLHUP)) {
+                bot_read(b, &pfds[i], now);
+                // Answer in this round: the move or the next m1 rides the same write
+                if (b->state != BOT_CLOSED) bot_timers(b, now);
+            }
+            if (b->state != BOT_CLOSED && (pfds[i].revents & POLLOUT)) bot_flush(b, &pfds[i]);
+        }
+        // Flush anything queued this round without waiting for another POLLOUT
+        for (int i = 0; i < opened; i++) {
+            if (bots[i].state != BOT_CLOSED && bots[i].state != BOT_CONNECTING) bot_flush(&bots[i], &pfds[i]);
+        }
+
+        if (now >= next_report) {
+            print_interval((now - start) / 1e9);
+            next_report += 1000000000LL;
+        }
+    }
+
+    bot_print_summary(title, (monotonic_ns() - start) / 1e9);
+    for (int i = 0; i < nbots; i++) {
+        if (bots[i].fd >= 0) close(bots[i].fd);
+    }
+    free(bots);
+    free(pfds);
+}
+
+void bot_print_summary(const char *title, double secs) {
+    printf("\n=== %s summary (%.1fs) ===\n", title, secs);
+    printf("connections: %llu ok, %llu failures, %llu rejected (server full)\n",
+           bot_stats.connects, bot_stats.failures, bot_stats.rejected);
+    printf("messages:    %llu out (%.0f/s), %llu in (%.0f/s)\n",
+           bot_stats.msgs_out, bot_stats.msgs_out / secs, bot_stats.msgs_in, bot_stats.msgs_in / secs);
+    printf("bytes:       %llu out, %llu in\n", bot_stats.bytes_out, bot_stats.bytes_in);
+    printf("moves:       %llu (%.0f/s), games: %llu, chats: %llu out / %llu in\n",
+           bot_stats.moves, bot_stats.moves / secs, bot_stats.games, bot_stats.chats_out, bot_stats.chats_in);
+    if (think_time.total) {
+        printf("engine:      %s, %llu nodes, avg depth %.1f\n", bot_opts.engine->name,
+               bot_stats.engine_nodes, (double)bot_stats.engine_depth / think_time.total);
+    }
+    hist_print(&connect_latency, stdout, "connect", 1000.0, "us");
+    hist_print(&match_latency, stdout, "match", 1000.0, "us");
+    hist_print(&move_latency, stdout, "move", 1000.0, "us");
+    hist_print(&think_time, stdout, "think", 1000.0, "us");
+}
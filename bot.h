@@ -0,0 +1,95 @@
+#ifndef BOT_H
+#define BOT_H
+
+#include "unp.h"
+#include "game.h"
+#include "engine.h"
+#include "histogram.h"
+
+#define MAXLINE 4096
+
+#define BOT_CONNECTING 0
+#define BOT_NAMING 1
+#define BOT_QUEUED 2
+#define BOT_PLAYING 3
+#define BOT_IDLE 4
+#define BOT_WATCHING 5
+#define BOT_CLOSED 6
+
+#define KNOWN_ROOMS 256
+#define RETRY_DELAY_NS 500000000LL
+#define BOT_NAME_TRIES 8       // suffixed names tried when <name><index> is registered
+
+/*
+ * Headless bot sessions, shared by loadgen and the client's bot mode:
+ * each bot speaks the same line protocol as the interactive client over
+ * its own non-blocking socket, and one poll() loop drives them all.
+ * Players queue with m1 and play the moves of the configured engine;
+ * spectators watch rooms the players have been matched into; everyone in
+ * a room chats at the configured rate. Replies to a read (the next move,
+ * the next m1) are queued in the same round and leave in one write.
+ */
+struct bot {
+    int fd;
+    int state;
+    int spectator;
+    int name_tries;        // names refused so far on this connection
+    long long id;
+    int room_id;
+    int piece;
+    int my_turn;
+    struct game game;      // the room's variant, as of the last "s"
+    struct engine_ctx ctx;
+    char in[MAXLINE];
+    int inlen;
+    char out[MAXLINE];
+    int outlen;
+    long long move_sent_ns;
+    long long queue_sent_ns;
+    long long next_move_ns;
+    long long next_chat_ns;
+    long long next_retry_ns;
+    long long reconnect_ns;   // set when the server asked us to come back later
+};
+
+struct bot_counters {
+    unsigned long long msgs_out;
+    unsigned long long msgs_in;
+    unsigned long long bytes_out;
+    unsigned long long bytes_in;
+    unsigned long long moves;
+    unsigned long long games;
+    unsigned long long chats_out;
+    unsigned long long chats_in;
+    unsigned long long connects;
+    unsigned long long failures;
+    unsigned long long rejected;
+    unsigned long long engine_nodes;
+    unsigned long long engine_depth;   // sum over moves of the depth reached
+};
+
+struct bot_options {
+    int nbots;
+    int spectator_pct;
+    double chat_per_min;
+    int think_ms;
+    int ramp_per_sec;
+    int duration;          // seconds; 0 runs until SIGINT
+    int requeue_ms;        // pause between the end of a game and the next m1
+    const struct engine *engine;
+    int depth;
+    const char *name;      // bots are named <name><index>
+};
+
+extern struct bot_options bot_opts;
+extern struct bot_counters bot_stats;
+extern struct histogram move_latency;
+extern struct histogram match_latency;
+extern struct histogram connect_latency;
+extern struct histogram think_time;
+
+void bot_defaults(void);
+void bot_run(const struct sockaddr_in *addr, const char *title);
+void bot_print_summary(const char *title, double secs);
+
+#endif
@@ -0,0 +1,249 @@
+#include "server.h"
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "capture.h"
+#include "stats.h"
+#include "cluster.h"
+#include "relay.h"
+#include "logger.h"
+
+/*
+ * Same shape as the logger: the event loop appends events to a byte ring
+ * and a writer thread drains it to the file, so capturing costs the loop a
+ * clock read and a memcpy per read(). A full ring drops the event and
+ * bumps a counter; a write error stops the capture at the next event.
+ */
+#define CAPTURE_FLUSH_INTERVAL_NS 2000000L
+
+// line_state values, for masking claim tokens across reads
+#define AT_LINE_START 0
+#define IN_LINE 1
+#define IN_NAME 2                // an "n" line before its ';'
+#define IN_TOKEN 3
+
+static char ring[CAPTURE_RING_SIZE];
+static atomic_ulong ring_head;   // bytes appended by the event loop
+static atomic_ulong ring_tail;   // bytes written out by the writer
+static atomic_int write_errno;
+
+// Event loop side
+static int capturing;
+static unsigned *conn_ids;       // per client slot, 0 when not traced
+static unsigned char *line_state;   // per client slot, where its last read stopped
+static unsigned next_conn;
+static long long last_us;
+static unsigned long long nevents;
+static unsigned long long ndropped;
+static const char *capture_path = "";
+
+static int capture_fd = -1;
+static pthread_t writer;
+static atomic_int running;
+
+static void ring_copy(unsigned long pos, const void *p, size_t n) {
+    size_t off = pos & (CAPTURE_RING_SIZE - 1);
+    size_t first = n < CAPTURE_RING_SIZE - off ? n : CAPTURE_RING_SIZE - off;
+    memcpy(ring + off, p, first);
+    memcpy(ring, (const char *)p + first, n - first);
+}
+
+static void push(unsigned conn, int kind, const char *buf, int len) {
+    int err = atomic_load_explicit(&write_errno, memory_order_relaxed);
+    if (err) {
+        log_event(EV_CAPTURE_ERROR, -1, err, (long long)nevents, capture_path);
+        capture_stop();
+        return;
+    }
+
+    long long now_us = monotonic_ns() / 1000;
+    size_t need = sizeof(struct capture_event) + len;
+    unsigned long head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+    unsigned long tail = atomic_load_explicit(&ring_tail, memory_order_acquire);
+    if (CAPTURE_RING_SIZE - (head - tail) < need) {
+        ndropped++;
+        return;
+    }
+
+    // A gap of over an hour saturates rather than wraps
+    long long dt = now_us - last_us;
+    struct capture_event ev;
+    ev.dt_us = dt > 0xffffffffLL ? 0xffffffffu : (unsigned)dt;
+    ev.conn = conn;
+    ev.len = (unsigned short)len;
+    ev.kind = (unsigned char)kind;
+    ev.pad = 0;
+    ring_copy(head, &ev, sizeof(ev));
+    if (len) ring_copy(head + sizeof(ev), buf, len);
+    atomic_store_explicit(&ring_head, head + need, memory_order_release);
+    last_us = now_us;
+    nevents++;
+}
+
+static int drain(void) {
+    unsigned long tail = atomic_load_explicit(&ring_tail, memory_order_relaxed);
+    unsigned long head = atomic_load_explicit(&ring_head, memory_order_acquire);
+    int n = 0;
+
+    while (tail != head) {
+        size_t off = tail & (CAPTURE_RING_SIZE - 1);
+        size_t chunk = head - tail < CAPTURE_RING_SIZE - off ? head - tail : CAPTURE_RING_SIZE - off;
+        ssize_t w = write(capture_fd, ring + off, chunk);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) {
+            atomic_store(&write_errno, w < 0 ? errno : EIO);
+            w = (ssize_t)chunk;   // discarded; the loop stops capturing
+        }
+        tail += (unsigned long)w;
+        atomic_store_explicit(&ring_tail, tail, memory_order_release);
+        n++;
+    }
+    return n;
+}
+
+static void *writer_main(void *arg) {
+    struct timespec pause = { 0, CAPTURE_FLUSH_INTERVAL_NS };
+    (void)arg;
+
+    while (atomic_load(&running)) {
+        if (drain() == 0) nanosleep(&pause, NULL);
+    }
+    drain();
+    return NULL;
+}
+
+static int is_client_slot(int slot) {
+    return slot > ADMIN_SLOT && clients[slot].fd >= 0 && !stats_is_admin_conn(slot) &&
+           !cluster_owns_slot(slot) && !relay_owns_slot(slot);
+}
+
+/*
+ * Starts a new segment in `path`, stopping any capture already running;
+ * an empty path only stops. Clients connected at this point are numbered
+ * with CAPTURE_LIVE events; of their earlier input only the name is in
+ * the trace.
+ */
+int capture_open(const char *path) {
+    struct capture_event ev;
+    struct capture_header h;
+    char seg[sizeof(ev) + sizeof(h)];
+    struct timespec ts;
+
+    capture_stop();
+    if (!path[0]) return 0;
+    capture_path = path;
+    if (!conn_ids) {
+        conn_ids = pool_alloc(cfg.max_clients, sizeof(unsigned));
+        line_state = pool_alloc(cfg.max_clients, 1);
+    }
+
+    int fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    clock_gettime(CLOCK_REALTIME, &ts);
+    memset(&ev, 0, sizeof(ev));
+    ev.len = sizeof(h);
+    ev.kind = CAPTURE_SEGMENT;
+    h.magic = CAPTURE_MAGIC;
+    h.node = (unsigned)cfg.node_id;
+    h.started_ns = (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    memcpy(seg, &ev, sizeof(ev));
+    memcpy(seg + sizeof(ev), &h, sizeof(h));
+    if (fd < 0 || write(fd, seg, sizeof(seg)) != sizeof(seg)) {
+        log_event(EV_CAPTURE_ERROR, -1, errno, 0, path);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+
+    capture_fd = fd;
+    atomic_store(&ring_head, 0);
+    atomic_store(&ring_tail, 0);
+    atomic_store(&write_errno, 0);
+    atomic_store(&running, 1);
+    if (pthread_create(&writer, NULL, writer_main, NULL) != 0) {
+        log_event(EV_CAPTURE_ERROR, -1, errno, 0, path);
+        atomic_store(&running, 0);
+        close(fd);
+        capture_fd = -1;
+        return -1;
+    }
+    capturing = 1;
+    next_conn = 0;
+    last_us = monotonic_ns() / 1000;
+    for (int i = 0; i < cfg.max_clients; i++) {
+        conn_ids[i] = 0;
+        line_state[i] = AT_LINE_START;
+        if (i <= maxi && is_client_slot(i)) {
+            conn_ids[i] = ++next_conn;
+            push(conn_ids[i], CAPTURE_LIVE, NULL, 0);
+            // Named players get their name again, so a replay can carry on
+            struct Player *p = find_player_by_fd(clients[i].fd);
+            if (p) {
+                char line[MAX_NAME_LEN + 2];
+                push(conn_ids[i], CAPTURE_DATA, line, snprintf(line, sizeof(line), "n%s\n", p->name));
+            }
+        }
+    }
+    return 0;
+}
+
+// Writes out everything appended so far; before exec, and on reload
+void capture_stop(void) {
+    if (!capturing) return;
+    capturing = 0;
+    atomic_store(&running, 0);
+    pthread_join(writer, NULL);
+    close(capture_fd);
+    capture_fd = -1;
+}
+
+void capture_accept(int slot) {
+    if (!capturing) return;
+    conn_ids[slot] = ++next_conn;
+    line_state[slot] = AT_LINE_START;
+    push(conn_ids[slot], CAPTURE_OPEN, NULL, 0);
+}
+
+/*
+ * Claim tokens ("n<name>;<token>") never reach the file: each token byte
+ * becomes 'x', so a replay still claims the name, with the same token at
+ * every login, and the read keeps its length. Reads are at most MAXLINE.
+ */
+void capture_data(int slot, const char *buf, int len) {
+    static char masked[MAXLINE];
+    const char *out = buf;
+    if (!capturing || !conn_ids[slot]) return;
+
+    unsigned char st = line_state[slot];
+    for (int i = 0; i < len; i++) {
+        if (buf[i] == '\n') {
+            st = AT_LINE_START;
+        } else if (st == AT_LINE_START) {
+            st = buf[i] == 'n' ? IN_NAME : IN_LINE;
+        } else if (st == IN_NAME && buf[i] == ';') {
+            st = IN_TOKEN;
+        } else if (st == IN_TOKEN && len <= MAXLINE) {
+            if (out == buf) {
+                memcpy(masked, buf, len);
+                out = masked;
+            }
+            masked[i] = 'x';
+        }
+    }
+    line_state[slot] = st;
+    push(conn_ids[slot], CAPTURE_DATA, out, len);
+}
+
+void capture_close(int slot) {
+    if (!capturing || !conn_ids[slot]) return;
+    push(conn_ids[slot], CAPTURE_CLOSE, NULL, 0);
+    conn_ids[slot] = 0;
+}
+
+unsigned long long capture_events(void) {
+    return nevents;
+}
+
+unsigned long long capture_dropped(void) {
+    return ndropped;
+}
@@ -0,0 +1,45 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#define CAPTURE_MAGIC 0x31543443u   // "C4T1" on disk, in every segment header
+#define CAPTURE_RING_SIZE (4 << 20) // bytes, power of two
+
+// Event kinds
+#define CAPTURE_OPEN 1              // connection accepted
+#define CAPTURE_DATA 2              // one read() worth of client input
+#define CAPTURE_CLOSE 3
+#define CAPTURE_LIVE 4              // already connected when the capture started, then its name
+#define CAPTURE_SEGMENT 5           // payload is a struct capture_header
+
+/*
+ * Inbound traffic trace for the replay tool. A file is a sequence of
+ * events, each followed by `len` payload bytes. Every capture started
+ * (server start, a reload that sets capture.file, the process after a hot
+ * upgrade) opens a segment with a CAPTURE_SEGMENT event. Connections are
+ * numbered from 1 within their segment, and an event's time is
+ * microseconds since the previous event of the segment. Claim tokens in
+ * "n" lines are masked before they are recorded.
+ */
+struct capture_header {
+    unsigned magic;
+    unsigned node;
+    long long started_ns;           // unix time the segment's event times count from
+};
+
+struct capture_event {
+    unsigned dt_us;
+    unsigned conn;
+    unsigned short len;
+    unsigned char kind;
+    unsigned char pad;
+};
+
+int capture_open(const char *path);
+void capture_stop(void);
+void capture_accept(int slot);
+void capture_data(int slot, const char *buf, int len);
+void capture_close(int slot);
+unsigned long long capture_events(void);
+unsigned long long capture_dropped(void);
+
+#endif
@@ -0,0 +1,138 @@
+#include "server.h"
+#include <string.h>
+#include "chat.h"
+#include "arena.h"
+
+/*
+ * Chat lines are not written as they arrive. chat_post() records the line
+ * in the room's history ring and appends it to the room's pending batch;
+ * the event loop calls chat_flush_pending() once per poll round, so every
+ * recipient gets all lines of that round in a single write.
+ *
+ * The history ring and the pending batch live in the room's arena and are
+ * allocated on the first line posted; they go away with the room.
+ */
+struct chat_line {
+    int len;
+    char text[CHAT_LINE_LEN];
+};
+
+struct chat_room {
+    struct chat_line *lines;   // CHAT_HISTORY entries, NULL until first post
+    char *pending;             // CHAT_BATCH_LEN bytes
+    int head;    // index of the oldest line
+    int count;
+    int pending_len;
+    int dirty;
+};
+
+static struct chat_room *chat_rooms;   // cfg.max_rooms entries
+static int *dirty_rooms;
+static int dirty_count = 0;
+
+void chat_init(void) {
+    chat_rooms = pool_alloc(cfg.max_rooms, sizeof(struct chat_room));
+    dirty_rooms = pool_alloc(cfg.max_rooms, sizeof(int));
+    dirty_count = 0;
+}
+
+static int room_slot(struct Room* room) {
+    return room->id - room_id_base;
+}
+
+static void history_append(int slot, const char *line, int len) {
+    struct chat_room *cr = &chat_rooms[slot];
+    int pos = (cr->head + cr->count) % CHAT_HISTORY;
+    if (cr->count == CHAT_HISTORY) {
+        cr->head = (cr->head + 1) % CHAT_HISTORY;
+    } else {
+        cr->count++;
+    }
+
+    struct chat_line *l = &cr->lines[pos];
+    if (len > CHAT_LINE_LEN) {
+        // Keep the prefix and restore the frame terminator
+        len = CHAT_LINE_LEN;
+        memcpy(l->text, line, len - 1);
+        l->text[len - 1] = '\n';
+    } else {
+        memcpy(l->text, line, len);
+    }
+    l->len = len;
+}
+
+void chat_flush_room(struct Room* room) {
+    struct chat_room *cr = &chat_rooms[room_slot(room)];
+    if (cr->pending_len == 0) return;
+    cr->pending[cr->pending_len] = '\0';
+    notify_room(room->id, cr->pending);
+    cr->pending_len = 0;
+}
+
+void chat_post(struct Room* room, const char *line, int len) {
+    int slot = room_slot(room);
+    struct chat_room *cr = &chat_rooms[slot];
+
+    if (!cr->lines) {
+        cr->lines = room_alloc(room, sizeof(struct chat_line) * CHAT_HISTORY);
+        cr->pending = room_alloc(room, CHAT_BATCH_LEN);
+        if (!cr->lines || !cr->pending) {
+            // Arena full: deliver unbuffered and keep no history
+            cr->lines = NULL;
+            notify_room(room->id, line);
+            return;
+        }
+    }
+
+    history_append(slot, line, len);
+
+    if (cr->pending_len + len >= CHAT_BATCH_LEN) chat_flush_room(room);
+    if (len >= CHAT_BATCH_LEN) {
+        notify_room(room->id, line);
+        return;
+    }
+    memcpy(cr->pending + cr->pending_len, line, len);
+    cr->pending_len += len;
+    if (!cr->dirty) {
+        cr->dirty = 1;
+        dirty_rooms[dirty_count++] = slot;
+    }
+}
+
+void chat_flush_pending(void) {
+    for (int i = 0; i < dirty_count; i++) {
+        int slot = dirty_rooms[i];
+        chat_rooms[slot].dirty = 0;
+        if (room_status[slot]) chat_flush_room(&rooms[slot]);
+        chat_rooms[slot].pending_len = 0;
+    }
+    dirty_count = 0;
+}
+
+// Replays the history to one newly joined member in a single write
+void chat_send_history(struct Room* room, int fd) {
+    struct chat_room *cr = &chat_rooms[room_slot(room)];
+    char buf[CHAT_HISTORY * CHAT_LINE_LEN];
+    int len = 0;
+
+    for (int i = 0; i < cr->count; i++) {
+        struct chat_line *l = &cr->lines[(cr->head + i) % CHAT_HISTORY];
+        memcpy(buf + len, l->text, l->len);
+        len += l->len;
+    }
+    if (len > 0) client_write(fd, buf, len);
+}
+
+void chat_reset(struct Room* room) {
+    struct chat_room *cr = &chat_rooms[room_slot(room)];
+    cr->lines = NULL;
+    cr->pending = NULL;
+    cr->head = 0;
+    cr->count = 0;
+    cr->pending_len = 0;
+}
+
+// Arena bytes a room needs once chat starts, for sizing checks
+size_t chat_arena_size(void) {
+    return sizeof(struct chat_line) * CHAT_HISTORY + CHAT_BATCH_LEN + ARENA_ALIGN;
+}
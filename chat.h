@@ -0,0 +1,20 @@
+#ifndef CHAT_H
+#define CHAT_H
+
+#define CHAT_HISTORY 32      // lines kept per room for catch-up
+#define CHAT_LINE_LEN 256    // longer lines are truncated in the history
+#define CHAT_BATCH_LEN 4096  // pending bytes per room before a forced flush
+
+#include <stddef.h>
+
+struct Room;
+
+void chat_init(void);
+void chat_post(struct Room* room, const char *line, int len);
+void chat_flush_room(struct Room* room);
+void chat_flush_pending(void);
+void chat_send_history(struct Room* room, int fd);
+void chat_reset(struct Room* room);
+size_t chat_arena_size(void);
+
+#endif
@@ -5,10 +5,11 @@
 #include <unistd.h>
 #include <termios.h>
 #include <poll.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include "bot.h"
+#include "ratings.h"
 
-#define MAXLINE 4096
-#define BOARD_WIDTH 6
-#define BOARD_HEIGHT 7
 #define MAX_NAME_LEN 32
 #define MAX_MSG_LEN 1024
 #define MAX_CHAT_LEN 10
@@ -19,6 +20,7 @@
 #define STATE_IN_GAME 3
 #define STATE_CHAT 4
 #define first_line 23
+#define RECV_BUF_LEN (4 * MAXLINE)
 
 #define MOVE_CURSOR(x, y)  printf("\033[%d;%dH", (x), (y))
 
@@ -47,7 +49,11 @@ struct game_state {
     int player_number;
     int my_turn;
     
-    int board[BOARD_WIDTH][BOARD_HEIGHT];
+    int board[GAME_MAX_ROWS][GAME_MAX_COLS];
+    int rows;               // geometry of the room's variant, from "v"
+    int cols;
+    int connect;
+    char variant[16];
     int game_ended;
     struct chat_queue chat;
     int is_audience;
@@ -61,6 +67,8 @@ int sockfd;
 struct pollfd fds[2];
 int guidestatus=0; 
 int inavaildstatus=0;
+int redraw_pending=0;
+int bell_pending=0;
 
 void clear_screen();
 void init_board();
@@ -70,7 +78,8 @@ void display_menu();
 void send_chat(const char* message);
 void send_move(int column);
 
-void handle_server_message(char *buf);
+void handle_server_message(char *message);
+int handle_server_data(char *buf, int len);
 void handle_user_input();
 
 void add_chat_message(const char* sender, const char* content);
@@ -103,15 +112,184 @@ void cleanup() {
     }
 }
 
+/*
+ * In-game screen model. A frame is composed into back[] with scr_move()
+ * and scr_print(), which understand the escapes the drawing code uses
+ * (colours, bold, clear to end of line). scr_present() compares it with
+ * front[], what the terminal shows, and sends only the changed cells in
+ * one write. Output that bypasses the model (menus, banners, notices)
+ * must call scr_invalidate() so the next frame repaints everything.
+ */
+#define SCR_ROWS 40
+#define SCR_COLS 100
+#define INPUT_ROW (13 + first_line)
+
+struct cell {
+    char glyph[5];        // one UTF-8 character
+    unsigned char fg;     // SGR colour, 0 for the default
+    unsigned char bold;
+};
+
+struct cell front[SCR_ROWS][SCR_COLS];
+struct cell back[SCR_ROWS][SCR_COLS];
+int front_valid = 0;
+int scr_row = 1, scr_col = 1;
+unsigned char scr_fg = 0, scr_bold = 0;
+
+static const struct cell blank_cell = { " ", 0, 0 };
+
+void scr_invalidate() {
+    front_valid = 0;
+}
+
+void scr_clear() {
+    for (int r = 0; r < SCR_ROWS; r++) {
+        for (int c = 0; c < SCR_COLS; c++) back[r][c] = blank_cell;
+    }
+    scr_row = scr_col = 1;
+    scr_fg = scr_bold = 0;
+}
+
+void scr_move(int row, int col) {
+    scr_row = row;
+    scr_col = col < 1 ? 1 : col;
+}
+
+static int utf8_len(unsigned char c) {
+    if (c >= 0xf0) return 4;
+    if (c >= 0xe0) return 3;
+    if (c >= 0xc0) return 2;
+    return 1;
+}
+
+// Handles "\033[...m" and "\033[K"; returns the bytes consumed
+static int scr_escape(const char *p) {
+    const char *q = p + 2;
+    int params[8], n = 0, v = 0, have = 0;
+    while (*q && (isdigit((unsigned char)*q) || *q == ';')) {
+        if (*q == ';') {
+            if (n < 8) params[n++] = v;
+            v = have = 0;
+        } else {
+            v = v * 10 + (*q - '0');
+            have = 1;
+        }
+        q++;
+    }
+    if (n < 8 && (have || n == 0)) params[n++] = v;
+    if (*q == 'm') {
+        for (int i = 0; i < n; i++) {
+            if (params[i] == 0) scr_fg = scr_bold = 0;
+            else if (params[i] == 1) scr_bold = 1;
+            else if (params[i] >= 30 && params[i] <= 37) scr_fg = params[i];
+        }
+    } else if (*q == 'K' && scr_row >= 1 && scr_row <= SCR_ROWS) {
+        for (int c = scr_col; c <= SCR_COLS; c++) back[scr_row - 1][c - 1] = blank_cell;
+    }
+    return *q ? (int)(q - p) + 1 : (int)(q - p);
+}
+
+void scr_print(const char *fmt, ...) {
+    char buf[MAX_MSG_LEN];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+
+    for (const char *p = buf; *p; ) {
+        if (p[0] == '\033' && p[1] == '[') {
+            p += scr_escape(p);
+            continue;
+        }
+        if (*p == '\n') {
+            scr_row++;
+            scr_col = 1;
+            p++;
+            continue;
+        }
+        int len = utf8_len((unsigned char)*p);
+        if (scr_row >= 1 && scr_row <= SCR_ROWS && scr_col <= SCR_COLS) {
+            struct cell *cl = &back[scr_row - 1][scr_col - 1];
+            int i;
+            for (i = 0; i < len && p[i]; i++) cl->glyph[i] = p[i];
+            cl->glyph[i] = '\0';
+            cl->fg = scr_fg;
+            cl->bold = scr_bold;
+        }
+        scr_col++;
+        while (len-- > 0 && *p) p++;
+    }
+}
+
+static int same_cell(const struct cell *a, const struct cell *b) {
+    return a->fg == b->fg && a->bold == b->bold && strcmp(a->glyph, b->glyph) == 0;
+}
+
+static void out_append(char *out, int *len, const char *s) {
+    int n = strlen(s);
+    if (*len + n > SCR_ROWS * SCR_COLS * 16) return;
+    memcpy(out + *len, s, n);
+    *len += n;
+}
+
+// Sends the cells that changed since the last frame, then parks the cursor on the input line
+void scr_present() {
+    static char out[SCR_ROWS * SCR_COLS * 16];
+    char esc[32];
+    int len = 0;
+    int row = -1, col = -1;
+    int fg = -1, bold = -1;
+
+    if (!front_valid) {
+        out_append(out, &len, "\033[0m\033[2J");
+        for (int r = 0; r < SCR_ROWS; r++) {
+            for (int c = 0; c < SCR_COLS; c++) front[r][c] = blank_cell;
+        }
+        fg = bold = 0;
+        front_valid = 1;
+    }
+    for (int r = 0; r < SCR_ROWS; r++) {
+        for (int c = 0; c < SCR_COLS; c++) {
+            struct cell *cl = &back[r][c];
+            if (same_cell(cl, &front[r][c])) continue;
+            if (row != r || col != c) {
+                snprintf(esc, sizeof(esc), "\033[%d;%dH", r + 1, c + 1);
+                out_append(out, &len, esc);
+            }
+            if (cl->fg != fg || cl->bold != bold) {
+                out_append(out, &len, "\033[0m");
+                if (cl->bold) out_append(out, &len, "\033[1m");
+                if (cl->fg) {
+                    snprintf(esc, sizeof(esc), "\033[%dm", cl->fg);
+                    out_append(out, &len, esc);
+                }
+                fg = cl->fg;
+                bold = cl->bold;
+            }
+            out_append(out, &len, cl->glyph);
+            front[r][c] = *cl;
+            row = r;
+            col = c + 1;
+        }
+    }
+    if (fg > 0 || bold > 0) out_append(out, &len, "\033[0m");
+    // Whatever the user typed and the terminal echoed goes with the frame
+    snprintf(esc, sizeof(esc), "\033[%d;1H\033[2K", INPUT_ROW);
+    out_append(out, &len, esc);
+
+    fflush(stdout);
+    Writen(STDOUT_FILENO, out, len);
+}
+
 void draw_chat_box() {
-    MOVE_CURSOR(first_line, 1);
-    printf("+------------------------------------------------------------+");
-    MOVE_CURSOR(1 + first_line, 1);
-    printf("| Chat Room:                                                 |");
-    MOVE_CURSOR(12 + first_line, 1);
-    printf("|------------------------------------------------------------|");
-    MOVE_CURSOR(14 + first_line, 1);
-    printf("+------------------------------------------------------------+");
+    scr_move(first_line, 1);
+    scr_print("+------------------------------------------------------------+");
+    scr_move(1 + first_line, 1);
+    scr_print("| Chat Room:                                                 |");
+    scr_move(12 + first_line, 1);
+    scr_print("|------------------------------------------------------------|");
+    scr_move(14 + first_line, 1);
+    scr_print("+------------------------------------------------------------+");
 }
 
 void draw_victory() {
@@ -161,11 +339,6 @@ void draw_gameover() {
 
 
 void display_chat_history() {
-    for (int i = first_line + 1; i < first_line + 12; i++) {
-        MOVE_CURSOR(i, 1);
-        printf("\033[K"); 
-    }
-    
     draw_chat_box();
     
     if (is_chat_queue_empty(&gs.chat)) {
@@ -175,36 +348,34 @@ void display_chat_history() {
     int i = gs.chat.front;
     int line = first_line + 2;  
     while (i != gs.chat.rear) {
-        MOVE_CURSOR(line++, 3);
-        printf("\033[K%s", gs.chat.messages[i]);  
+        scr_move(line++, 3);
+        scr_print("%s", gs.chat.messages[i]);
         i = (i + 1) % 10;
     }
-    
-    if (gs.state == STATE_IN_GAME && !gs.is_audience) {
-        MOVE_CURSOR(19, 0);
-        if (gs.my_turn && !gs.game_ended) {
-            printf("\033[KYour turn! Enter 1-7 or ':' for chat: ");
-            if(inavaildstatus){
-                //
-                MOVE_CURSOR(19, 0);
-                printf("\033[KInvalid move! Enter 1-7 or ':' for chat: ");
-            }
-        } else if (!gs.game_ended) {
-            printf("\033[KOpponent's turn...");
-        }
-    }
-    else if(gs.is_audience && !gs.game_ended){
-        MOVE_CURSOR(19, 0);
-        printf("Press q to quit or type your message after ':'.\n");
-        MOVE_CURSOR(13 + first_line,0);
+}
+
+// The line under the board: whose turn it is, or how to leave
+void draw_prompt() {
+    int row = 7 + 2 * gs.rows;
+    if (gs.game_ended) {
+        scr_move(row + 1, 1);
+        scr_print("Press Enter to return to menu...");
+    } else if (gs.is_audience) {
+        scr_move(row, 1);
+        scr_print("Press q to quit or type your message after ':'.");
+    } else if (gs.my_turn) {
+        scr_move(row, 1);
+        scr_print("%s Enter 1-%d or ':' for chat: ", inavaildstatus ? "Invalid move!" : "Your turn!", gs.cols);
+    } else {
+        scr_move(row, 1);
+        scr_print("Opponent's turn...");
     }
-    MOVE_CURSOR(13 + first_line,0);
-    
 }
 
 
 void clear_screen() {
     printf("\033[2J\033[1;1H");
+    scr_invalidate();
 }
 
 void init_board() {
@@ -214,103 +385,98 @@ void init_board() {
 void add_chat_message(const char* sender, const char* content) {
     enqueue_chat(&gs.chat, sender, content);
     if (gs.state == STATE_IN_GAME) {
-        printf("\a");
-        draw_board();
-        display_chat_history();
+        bell_pending = 1;
+        redraw_pending = 1;
     }
 }
 
+// Server lines only mark the frame stale; it is drawn once per batch, or
+// before anything is printed outside the frame
+void flush_redraw() {
+    if (bell_pending) printf("\a");
+    if (redraw_pending && gs.state == STATE_IN_GAME) draw_board();
+    bell_pending = 0;
+    redraw_pending = 0;
+}
+
+// Every room starts out classic until the server says otherwise
+void reset_variant() {
+    memset(gs.board, 0, sizeof(gs.board));
+    gs.rows = GAME_CLASSIC->rows;
+    gs.cols = GAME_CLASSIC->cols;
+    gs.connect = GAME_CLASSIC->connect;
+    strcpy(gs.variant, GAME_CLASSIC->name);
+}
+
 void init_game_state() {
     memset(&gs, 0, sizeof(gs));
     gs.state = STATE_INIT;
     init_chat_queue(&gs.chat);
+    reset_variant();
 }
 
 void draw_board(){
-    clear_screen();
+    scr_clear();
     if (gs.is_audience) {
-        MOVE_CURSOR(4,1);
-        printf("\033[1m=== AUDIENCE MODE ===\033[0m\n");
+        scr_move(4,1);
+        scr_print("\033[1m=== AUDIENCE MODE ===\033[0m\n");
     }
     
-    MOVE_CURSOR(1, 1);
-    printf("Room ID: %d", gs.room_id);
+    scr_move(1, 1);
+    scr_print("Room ID: %d", gs.room_id);
     
-    if (gs.audience_count > 0) {
-        MOVE_CURSOR(1, 20);
-        printf("Audiences: %d", gs.audience_count);
-        MOVE_CURSOR(13 + first_line,0);
+    if (gs.audience_count > 0 || gs.is_audience) {
+        scr_move(1, 20);
+        scr_print("Audiences: %d", gs.audience_count);
+    }
+    if (strcmp(gs.variant, GAME_CLASSIC->name) != 0) {
+        scr_move(1, 40);
+        scr_print("Board %s, connect %d", gs.variant, gs.connect);
     }
-    char token = (gs.player_number == 1) ? 'O' : 'X';
     char arrow[] = "->";
     if (gs.is_audience) {
-        MOVE_CURSOR(2, 4);
-        printf("Player 1: %s", gs.player_1_name);
-        printf(" \033[31m⬤\033[0m");
+        scr_move(2, 4);
+        scr_print("Player 1: %s", gs.player_1_name);
+        scr_print(" \033[31m⬤\033[0m");
         
-        MOVE_CURSOR(3, 4);
-        printf("Player 2: %s", gs.player_2_name);
-        printf(" \033[33m⬤\033[0m");
+        scr_move(3, 4);
+        scr_print("Player 2: %s", gs.player_2_name);
+        scr_print(" \033[33m⬤\033[0m");
     } else {
-        MOVE_CURSOR(2, 10);
-        printf("me: %s", gs.player_name);
-        printf(" %s", gs.player_number == 1 ? "\033[31m⬤\033[0m" : "\033[33m⬤\033[0m");
+        scr_move(2, 10);
+        scr_print("me: %s", gs.player_name);
+        scr_print(" %s", gs.player_number == 1 ? "\033[31m⬤\033[0m" : "\033[33m⬤\033[0m");
         
-        MOVE_CURSOR(3, 4);
-        printf("opponent: %s", gs.opponent_name);
-        printf(" %s", gs.player_number == 1 ? "\033[33m⬤\033[0m" : "\033[31m⬤\033[0m");
+        scr_move(3, 4);
+        scr_print("opponent: %s", gs.opponent_name);
+        scr_print(" %s", gs.player_number == 1 ? "\033[33m⬤\033[0m" : "\033[31m⬤\033[0m");
     }
-    MOVE_CURSOR(gs.my_turn ? 2 : 3, 1);
-    printf("%s", arrow);
-    MOVE_CURSOR(5, 1);
-    printf("  1   2   3   4   5   6   7  \n");
-    printf("-----------------------------\n");
+    scr_move(gs.my_turn ? 2 : 3, 1);
+    scr_print("%s", arrow);
+    char rule[4 * GAME_MAX_COLS + 2];
+    memset(rule, '-', 4 * gs.cols + 1);
+    rule[4 * gs.cols + 1] = '\0';
+    scr_move(5, 1);
+    for (int j = 0; j < gs.cols; j++) scr_print("  %d ", j + 1);
+    scr_print("\n%s\n", rule);
     
-    for (int i = BOARD_WIDTH - 1; i >= 0; i--) {
-        printf("|");
-        for (int j = 0; j < BOARD_HEIGHT; j++) {
+    for (int i = gs.rows - 1; i >= 0; i--) {
+        scr_print("|");
+        for (int j = 0; j < gs.cols; j++) {
             if (gs.board[i][j] == 1) {
-                printf(" \033[31m⬤\033[0m |");
+                scr_print(" \033[31m⬤\033[0m |");
             } else if (gs.board[i][j] == 2) {
-                printf(" \033[33m⬤\033[0m |");
+                scr_print(" \033[33m⬤\033[0m |");
             } else {
-                printf("   |");
+                scr_print("   |");
             }
         }
-        printf("\n-----------------------------\n");
+        scr_print("\n%s\n", rule);
     }
 
-    if (gs.game_ended) {
-        MOVE_CURSOR(19, 0);
-        printf("\nPress Enter to return to menu...\n");
-    }
-    
     display_chat_history();
-    
-    if (gs.state == STATE_IN_GAME) {
-        draw_chat_box();
-        display_chat_history();
-    }
-
-    if (!gs.is_audience) {
-        if (gs.my_turn && !gs.game_ended) {
-            MOVE_CURSOR(19, 0);
-            printf("Your turn! Enter 1-7 or ':' for chat: \n");
-            if(inavaildstatus){
-                //inavaildstatus=0;
-                MOVE_CURSOR(19, 0);
-                printf("\033[KInvalid move! Enter 1-7 or ':' for chat: \n");
-            }
-        } else if (!gs.game_ended) {
-            MOVE_CURSOR(19, 0);
-            printf("Opponent's turn...\n");
-        }
-    }
-    else if(gs.is_audience && !gs.game_ended){
-        MOVE_CURSOR(19, 0);
-        printf("Press q to quit or type your message after ':'.\n");
-    }
-    MOVE_CURSOR(13 + first_line,0);
+    draw_prompt();
+    scr_present();
 }
 
 void send_chat(const char* message) {
@@ -328,7 +494,6 @@ void send_chat(const char* message) {
 void send_move(int column) {
     char buf[32];
     snprintf(buf, sizeof(buf), "s%lld %d\n", gs.player_id, column);
-    printf("Sending: %s\n", buf);
     Writen(sockfd, buf, strlen(buf));
 }
 
@@ -343,7 +508,7 @@ void display_help() {
     clear_screen();
     printf("=== Connect Four Help ===\n\n");
     printf("Game Controls:\n");
-    printf("  1-7     : Place piece in column\n");
+    printf("  1-%d     : Place piece in column\n", gs.cols);
     printf("  :       : Enter chat mode\n");
     printf("  /help   : Display this help\n");
     printf("  /quit   : Exit game\n\n");
@@ -359,7 +524,10 @@ void display_menu() {
     printf("2. Create Private Room\n");
     printf("3. Join Private Room\n");
     printf("4. Watch a Game\n");
-    printf("5. Exit\n\n");
+    printf("5. Browse Lobby\n");
+    printf("6. Tournaments\n");
+    printf("7. Leaderboard\n");
+    printf("8. Exit\n\n");
     printf("Enter your choice: ");
     fflush(stdout);
 }
@@ -367,11 +535,11 @@ void display_menu() {
 
 int get_ai_move() {
 
-    int valid_columns[BOARD_HEIGHT];
+    int valid_columns[GAME_MAX_COLS];
     int valid_count = 0;
     
-    for (int col = 0; col < BOARD_HEIGHT; col++) {
-        if (gs.board[BOARD_WIDTH-1][col] == 0) {
+    for (int col = 0; col < gs.cols; col++) {
+        if (gs.board[gs.rows-1][col] == 0) {
             valid_columns[valid_count++] = col;
         }
     }
@@ -388,299 +556,364 @@ void handle_ai_turn() {
     }
 }
 
-void handle_server_message(char *buf) {
-    char *message = strtok(buf, "\n");
-    while (message != NULL) {
+// Applies one server line to gs
+void handle_server_message(char *message) {
+    switch (message[0]) {
+        case 'a': { 
+            sscanf(message + 1, "%d", &gs.audience_count);
+            redraw_pending = 1;
+            break;
+        }
+        
+        case 'r': {  
+            sscanf(message + 1, "%d", &gs.room_id);
+            reset_variant();
+            break;
+        }
 
-        switch (message[0]) {
-            case 'a': { 
-                sscanf(message + 1, "%d", &gs.audience_count);
-                if (gs.state == STATE_IN_GAME) {
-                    draw_board();
-                }
-                break;
-            }
-            
-            case 'r': {  
-                sscanf(message + 1, "%d", &gs.room_id);
-                break;
+        case 'v': {
+            // v<name>;<cols>;<rows>;<connect>: this room is not the classic board
+            char name[sizeof(gs.variant)];
+            int cols, rows, connect;
+            if (sscanf(message + 1, "%15[^;];%d;%d;%d", name, &cols, &rows, &connect) == 4 &&
+                cols >= 1 && cols <= GAME_MAX_COLS && rows >= 1 && rows <= GAME_MAX_ROWS) {
+                memset(gs.board, 0, sizeof(gs.board));
+                strcpy(gs.variant, name);
+                gs.cols = cols;
+                gs.rows = rows;
+                gs.connect = connect;
+                redraw_pending = 1;
             }
+            break;
+        }
 
-            case 'i': {  
-                sscanf(message + 1, "%lld", &gs.player_id);
-                gs.state = STATE_MENU;
-                display_menu();
-                break;
+        case 'f': {
+            // Turned away at the door: the server is full or we have
+            // too many connections open
+            int retry = atoi(message + 1);
+            printf("Server is busy, please try again in %d seconds.\n", retry);
+            exit(0);
+        }
+
+        case 'i': {  
+            sscanf(message + 1, "%lld", &gs.player_id);
+            gs.state = STATE_MENU;
+            display_menu();
+            break;
+        }
+        case 'w': { 
+            int room_id;
+            if (sscanf(message + 1, "%d", &room_id) == 1) {
+                gs.room_id = room_id;  
+                MOVE_CURSOR(19, 0);
+                printf("Room created successfully! Room ID: %d\n", room_id);
+                printf("Waiting for opponent...\n");
+                gs.state = STATE_WAITING;
             }
-            case 'w': { 
-                int room_id;
-                if (sscanf(message + 1, "%d", &room_id) == 1) {
-                    gs.room_id = room_id;  
-                    MOVE_CURSOR(19, 0);
-                    printf("Room created successfully! Room ID: %d\n", room_id);
-                    printf("Waiting for opponent...\n");
-                    gs.state = STATE_WAITING;
-                }
-                else if(message[1] == ' ' && strlen(message) == 2){
-                    ;
-                }
-                else {
-                    printf("%s\n", message + 1);
-                }
-                break;
+            else if(message[1] == ' ' && strlen(message) == 2){
+                ;
             }
+            else {
+                flush_redraw();
+                printf("%s\n", message + 1);
+                scr_invalidate();
+            }
+            break;
+        }
 
-            case 'j': { 
-                char name[MAX_NAME_LEN];
-                sscanf(message + 1, "%s", name);
-                printf("\nPlayer %s has joined the game!\n", name);
-                strncpy(gs.opponent_name, name, MAX_NAME_LEN - 1);
-                gs.opponent_name[MAX_NAME_LEN - 1] = '\0';
+        case 'j': { 
+            char name[MAX_NAME_LEN];
+            sscanf(message + 1, "%s", name);
+            printf("\nPlayer %s has joined the game!\n", name);
+            strncpy(gs.opponent_name, name, MAX_NAME_LEN - 1);
+            gs.opponent_name[MAX_NAME_LEN - 1] = '\0';
+            fflush(stdout);
+            break;
+        }
+        
+        case 'c': {  
+            char sender[MAX_NAME_LEN];
+            char chat_msg[MAX_MSG_LEN];
+            sscanf(message + 1, "%[^;];%[^\n]", sender, chat_msg);
+            add_chat_message(sender, chat_msg);
+            break;
+        }
+
+
+        case 'T': {
+            // Tournament lines (see tourney.h); during a game only the
+            // ones about our own event's progress go to the chat panel
+            int event, a, b, c, d;
+            char name[MAX_NAME_LEN], text[MAX_MSG_LEN], fmt[16], variant[16], state[16];
+            text[0] = '\0';
+            if (message[1] == 'o' &&
+                sscanf(message + 2, "%d;%15[^;];%d;%d;%15[^;];%d;%15s", &event, fmt, &a, &b, variant, &c, state) == 7) {
+                snprintf(text, sizeof(text), "event %d: %s, %d rounds, %d/%d players, %s board, %s",
+                         event, fmt, a, c, b, variant, state);
+            } else if (message[1] == 'r' && sscanf(message + 2, "%d;%d;%d", &event, &a, &b) == 3) {
+                snprintf(text, sizeof(text), "event %d: round %d of %d", event, a, b);
+            } else if (message[1] == 'm' && sscanf(message + 2, "%d;%d;%d;%31s", &event, &a, &b, name) == 4) {
+                snprintf(text, sizeof(text), "event %d round %d: you play %s in room %d", event, a, name, b);
+            } else if (message[1] == 'b' && sscanf(message + 2, "%d;%d", &event, &a) == 2) {
+                snprintf(text, sizeof(text), "event %d round %d: bye", event, a);
+            } else if (message[1] == 's' && gs.state != STATE_IN_GAME &&
+                       sscanf(message + 2, "%d;%31[^;];%d;%d", &event, name, &a, &b) == 4) {
+                snprintf(text, sizeof(text), "event %d: %s %.1f%s", event, name, a / 2.0, b ? " (out)" : "");
+            } else if (message[1] == 'f' && sscanf(message + 2, "%d;%d;%31[^;];%d", &event, &a, name, &d) == 4) {
+                snprintf(text, sizeof(text), "event %d: %d. %s %.1f", event, a, name, d / 2.0);
+            } else if (message[1] == 'e' && sscanf(message + 2, "%d;%31s", &event, name) == 2) {
+                snprintf(text, sizeof(text), "event %d won by %s", event, name);
+            } else if (message[1] == 'z') {
+                printf("Enter your choice: ");
                 fflush(stdout);
-                break;
             }
-            
-            case 'c': {  
-                char sender[MAX_NAME_LEN];
-                char chat_msg[MAX_MSG_LEN];
-                sscanf(message + 1, "%[^;];%[^\n]", sender, chat_msg);
-                add_chat_message(sender, chat_msg);
-                
-                if (gs.state == STATE_IN_GAME) {
-                    draw_board();
-                    display_chat_history();
-                    
-                    MOVE_CURSOR(19, 0);
-                    if (gs.my_turn && !gs.game_ended && !gs.is_audience) {
-                        printf("Your turn! Enter 1-7 or ':' for chat: \n");
-                        if(inavaildstatus){
-                            //inavaildstatus=0;
-                            MOVE_CURSOR(19, 0);
-                            printf("\033[KInvalid move! Enter 1-7 or ':' for chat: ");
-                        }
-                        MOVE_CURSOR(13 + first_line,0);
-                    } else if (!gs.game_ended && !gs.is_audience) {
-                        printf("Opponent's turn...\n");
-                        MOVE_CURSOR(13 + first_line,0);
-                    }
-                    else if(gs.is_audience && !gs.game_ended){
-                        MOVE_CURSOR(19, 0);
-                        printf("Press q to quit or type your message after ':'.\n");
-                        MOVE_CURSOR(13 + first_line,0);
-                    }
-                    
-                    fflush(stdout);
-                }
-                break;
+            if (!text[0]) break;
+            if (gs.state == STATE_IN_GAME) {
+                if (message[1] != 'o' && message[1] != 'f') add_chat_message("tourney", text);
+            } else {
+                flush_redraw();
+                printf("  [tourney] %s\n", text);
+                fflush(stdout);
+                scr_invalidate();
             }
+            break;
+        }
 
-
-            case 's': { 
-                int idx = 1;
-                for (int i = 0; i < BOARD_WIDTH; i++) {
-                    for (int j = 0; j < BOARD_HEIGHT; j++) {
-                        if (message[idx]) {
-                            gs.board[i][j] = message[idx] - '0';
-                            idx++;
-                        }
-                    }
-                }
-                if (gs.state == STATE_IN_GAME) {
-                    clear_screen();
-                    draw_board();
-                    MOVE_CURSOR(13 + first_line,0);
-                    fflush(stdout);
-                }
-                break;
+        case 'K': {
+            // Leaderboard page: Kr<rank>;<name>;<rating>;<games>, then
+            // Ke<page>;<more>;<our rank>;<our rating>
+            int rank, rating, games, page, more;
+            char name[MAX_NAME_LEN];
+            if (message[1] == 'r' && sscanf(message + 2, "%d;%31[^;];%d;%d", &rank, name, &rating, &games) == 4) {
+                printf("  %3d. %-20s %5d  (%d games)\n", rank, name, rating, games);
+            } else if (message[1] == 'e' && sscanf(message + 2, "%d;%d;%d;%d", &page, &more, &rank, &rating) == 4) {
+                printf("-- page %d%s -- you: #%d, %d --\n", page + 1, more ? ", more available" : "", rank, rating);
+                printf("Enter your choice: ");
             }
+            fflush(stdout);
+            break;
+        }
 
-            case 'e': {
-                inavaildstatus=0;
-                if (message[1] == 'T') {
-                    long long timeout_player_id;
-                    sscanf(message + 2, "%lld", &timeout_player_id);
-                    clear_screen();
-                    draw_board();
-                    MOVE_CURSOR(19, 0);
-                    
-                    if (gs.is_audience) {
-                        draw_gameover();
-                        if (timeout_player_id == gs.player_1_id) {
-                            printf("\nPlayer 1 (%s) lost due to timeout!\n", gs.player_1_name);
-                            printf("Press Enter to return to menu...\n");
-                        } else {
-                            printf("\nPlayer 2 (%s) lost due to timeout!\n", gs.player_2_name);
-                            printf("Press Enter to return to menu...\n");
-                        }
-                    } else {
-                        if (timeout_player_id == gs.player_id) {
-                            draw_failure();
-                            printf("\nGame Over - You lost due to timeout!\n");
-                            printf("Press Enter to return to menu...\n");
-                        } else {
-                            draw_victory();
-                            printf("\nGame Over - You won! Opponent timed out!\n");
-                            printf("Press Enter to return to menu...\n");
-                        }
-                    }
-                    gs.game_ended = 1;
-                    break;
-                }
-
-                if (message[1] == 'X') {
-                    MOVE_CURSOR(19, 0);
-                    if (gs.is_audience) {
-                        printf("Game ended - A player disconnected.\n");
-                    } else {
-                        printf("Your opponent left.\n");
-                    }
-                    printf("Press Enter to return to menu...");
-                    gs.game_ended = 1;
-                    break;
-                }
+        case 'L': {
+            // Lobby listing: Lo<room>;<host> open rooms, Lg<room>;<p1>;<p2>;<audience>
+            // live games, Le<page>;<more> ends the page
+            int room_id, count, page, more;
+            char name1[MAX_NAME_LEN], name2[MAX_NAME_LEN];
+            if (message[1] == 'o' && sscanf(message + 2, "%d;%31s", &room_id, name1) == 2) {
+                printf("  [open] room %d  host %s\n", room_id, name1);
+            } else if (message[1] == 'g' &&
+                       sscanf(message + 2, "%d;%31[^;];%31[^;];%d", &room_id, name1, name2, &count) == 4) {
+                printf("  [live] room %d  %s vs %s  (%d watching)\n", room_id, name1, name2, count);
+            } else if (message[1] == 'e' && sscanf(message + 2, "%d;%d", &page, &more) == 2) {
+                printf("-- page %d%s --\n", page + 1, more ? ", more available" : "");
+                printf("Enter your choice: ");
+            }
+            fflush(stdout);
+            break;
+        }
 
-                if (message[1] == 'Q') {
-                    long long quit_id;
-                    sscanf(message + 2, "%lld", &quit_id);
-                    MOVE_CURSOR(19, 0);
-                    if (gs.is_audience) {
-                        printf("Game ended - A player quit.\n");
-                        printf("Press Enter to return to menu...\n");
-                    }
-                    else if(quit_id == gs.player_id){
-                        printf("You quit the game.\n");
-                        printf("Press Enter to return to menu...\n");
+        case 's': { 
+            int idx = 1;
+            for (int i = 0; i < gs.rows; i++) {
+                for (int j = 0; j < gs.cols; j++) {
+                    if (message[idx]) {
+                        gs.board[i][j] = message[idx] - '0';
+                        idx++;
                     }
-                    else{
-                        printf("Your opponent quit.\n");
-                        printf("Press Enter to return to menu...");
-                    }
-                    
-                    gs.game_ended = 1;
-                    break;
                 }
+            }
+            redraw_pending = 1;
+            break;
+        }
 
-                int result = message[1] - '0';
+        case 'e': {
+            inavaildstatus=0;
+            // The result is printed over the last frame
+            flush_redraw();
+            scr_invalidate();
+            if (message[1] == 'T') {
+                long long timeout_player_id;
+                sscanf(message + 2, "%lld", &timeout_player_id);
+                clear_screen();
+                draw_board();
                 MOVE_CURSOR(19, 0);
-                if (result == 9) {
-                    draw_draw();
-                } else if (gs.is_audience) {
+                
+                if (gs.is_audience) {
                     draw_gameover();
-                    if (result == 1) {
-                        printf("Player 1 (%s) wins!\n", gs.player_1_name);
+                    if (timeout_player_id == gs.player_1_id) {
+                        printf("\nPlayer 1 (%s) lost due to timeout!\n", gs.player_1_name);
                         printf("Press Enter to return to menu...\n");
                     } else {
-                        printf("Player 2 (%s) wins!\n", gs.player_2_name);
+                        printf("\nPlayer 2 (%s) lost due to timeout!\n", gs.player_2_name);
                         printf("Press Enter to return to menu...\n");
                     }
                 } else {
-                    if (result == gs.player_number) {
-                        draw_victory();
-                    } else {
+                    if (timeout_player_id == gs.player_id) {
                         draw_failure();
+                        printf("\nGame Over - You lost due to timeout!\n");
+                        printf("Press Enter to return to menu...\n");
+                    } else {
+                        draw_victory();
+                        printf("\nGame Over - You won! Opponent timed out!\n");
+                        printf("Press Enter to return to menu...\n");
                     }
                 }
-                fflush(stdout);
                 gs.game_ended = 1;
                 break;
-}            
-            case 'p': {
-                if(message[1] == '1'){
-                    sscanf(message + 2, "%s", gs.opponent_name);
+            }
+
+            if (message[1] == 'X') {
+                MOVE_CURSOR(19, 0);
+                if (gs.is_audience) {
+                    printf("Game ended - A player disconnected.\n");
+                } else {
+                    printf("Your opponent left.\n");
                 }
-                else if(message[1] == '3'){
-                    long long current_turn;
-                    sscanf(message + 2, "%lld", &current_turn);
-                    gs.my_turn = (current_turn == gs.player_id);
+                printf("Press Enter to return to menu...");
+                gs.game_ended = 1;
+                break;
+            }
+
+            if (message[1] == 'Q') {
+                long long quit_id;
+                sscanf(message + 2, "%lld", &quit_id);
+                MOVE_CURSOR(19, 0);
+                if (gs.is_audience) {
+                    printf("Game ended - A player quit.\n");
+                    printf("Press Enter to return to menu...\n");
                 }
-                else if(message[1] == '4'){ 
-                    sscanf(message + 2, "%d", &gs.player_number);
+                else if(quit_id == gs.player_id){
+                    printf("You quit the game.\n");
+                    printf("Press Enter to return to menu...\n");
                 }
-                else if(message[1] == '2'){ 
-                    sscanf(message + 2, "%lld", &gs.opponent_id);
-                    gs.state = STATE_IN_GAME;
-                    gs.is_audience = 0;
-                    gs.game_ended = 0;  // Reset game_ended flag when starting new game
-                    init_chat_queue(&gs.chat);  
-                    clear_screen();
-                    draw_board();
-                    display_chat_history();
-                    inavaildstatus=0;
-                    MOVE_CURSOR(19, 0);
-                    if (gs.my_turn && !gs.game_ended) {
-                        printf("\033[KYour turn! Enter 1-7 or ':' for chat: ");
-                        if(inavaildstatus){
-                            inavaildstatus = 0;
-                            MOVE_CURSOR(19, 0);
-                            printf("\033[KInvalid move! Enter 1-7 or ':' for chat: ");
-                        }
-                        MOVE_CURSOR(13 + first_line,0);
-                    } else if (!gs.game_ended) {
-                        printf("\033[KOpponent's turn...");
-                        MOVE_CURSOR(13 + first_line,0);
-                    }
-                    fflush(stdout);
-                    break;
+                else{
+                    printf("Your opponent quit.\n");
+                    printf("Press Enter to return to menu...");
                 }
+                
+                gs.game_ended = 1;
+                break;
+            }
 
-
-                else if(message[1] == '6'){
-                    if(message[2] == '1'){
-                        sscanf(message + 3, "%s", gs.player_1_name);
-                    }
-                    else{
-                        sscanf(message + 3, "%s", gs.player_2_name);
-                    }
+            int result = message[1] - '0';
+            MOVE_CURSOR(19, 0);
+            if (result == 9) {
+                draw_draw();
+            } else if (gs.is_audience) {
+                draw_gameover();
+                if (result == 1) {
+                    printf("Player 1 (%s) wins!\n", gs.player_1_name);
+                    printf("Press Enter to return to menu...\n");
+                } else {
+                    printf("Player 2 (%s) wins!\n", gs.player_2_name);
+                    printf("Press Enter to return to menu...\n");
                 }
-
-                else if(message[1] == '7'){
-                    if(message[2] == '1'){
-                        sscanf(message + 3, "%lld", &gs.player_1_id);
-                    }
-                    else{
-                        sscanf(message + 3, "%lld", &gs.player_2_id);
-                    }
+            } else {
+                if (result == gs.player_number) {
+                    draw_victory();
+                } else {
+                    draw_failure();
                 }
+            }
+            fflush(stdout);
+            gs.game_ended = 1;
+            break;
+}            
+        case 'p': {
+            if(message[1] == '1'){
+                sscanf(message + 2, "%s", gs.opponent_name);
+            }
+            else if(message[1] == '3'){
+                long long current_turn;
+                sscanf(message + 2, "%lld", &current_turn);
+                gs.my_turn = (current_turn == gs.player_id);
+            }
+            else if(message[1] == '4'){ 
+                sscanf(message + 2, "%d", &gs.player_number);
+            }
+            else if(message[1] == '2'){ 
+                sscanf(message + 2, "%lld", &gs.opponent_id);
+                gs.state = STATE_IN_GAME;
+                gs.is_audience = 0;
+                gs.game_ended = 0;  // Reset game_ended flag when starting new game
+                init_chat_queue(&gs.chat);  
+                inavaildstatus=0;
+                clear_screen();
+                redraw_pending = 1;
+                break;
+            }
 
-                else if(message[1] == '8'){ 
-                    long long current_turn;
-                    sscanf(message + 2 , "%lld", &current_turn);
-                    gs.my_turn = (current_turn == gs.player_1_id);
-                }
-                else if(message[1] == '9'){ 
-                    gs.state = STATE_IN_GAME;
-                    gs.is_audience = 1;
-                    gs.game_ended = 0;  
-                    init_chat_queue(&gs.chat);
-                    clear_screen();
-                    draw_board();
-                    draw_chat_box();
-                    display_chat_history();
 
-                    if (gs.audience_count > 0 || gs.audience_count == 0) {
-                        MOVE_CURSOR(1, 20);
-                        printf("Audiences: %d", gs.audience_count);
-                    }
-                    fflush(stdout);
-                    MOVE_CURSOR(13 + first_line,0);
-                    break;
+            else if(message[1] == '6'){
+                if(message[2] == '1'){
+                    sscanf(message + 3, "%s", gs.player_1_name);
                 }
+                else{
+                    sscanf(message + 3, "%s", gs.player_2_name);
+                }
+            }
 
+            else if(message[1] == '7'){
+                if(message[2] == '1'){
+                    sscanf(message + 3, "%lld", &gs.player_1_id);
+                }
+                else{
+                    sscanf(message + 3, "%lld", &gs.player_2_id);
+                }
             }
 
-            default:
-                printf("Unknown message from server: %s\n", message);
+            else if(message[1] == '8'){ 
+                long long current_turn;
+                sscanf(message + 2 , "%lld", &current_turn);
+                gs.my_turn = (current_turn == gs.player_1_id);
+            }
+            else if(message[1] == '9'){ 
+                gs.state = STATE_IN_GAME;
+                gs.is_audience = 1;
+                gs.game_ended = 0;  
+                init_chat_queue(&gs.chat);
+                clear_screen();
+                redraw_pending = 1;
                 break;
+            }
+            break;
         }
-        message = strtok(NULL, "\n");
+
+        default:
+            flush_redraw();
+            printf("Unknown message from server: %s\n", message);
+            scr_invalidate();
+            break;
     }
 }
 
+/*
+ * Takes the bytes in buf, applies every complete line and redraws once.
+ * A partial line at the end is moved to the front of buf; the return
+ * value is its length, where the next read continues.
+ */
+int handle_server_data(char *buf, int len) {
+    int start = 0;
+    for (int i = 0; i < len; i++) {
+        if (buf[i] != '\n') continue;
+        buf[i] = '\0';
+        if (i > start) handle_server_message(buf + start);
+        start = i + 1;
+    }
+    flush_redraw();
+
+    len -= start;
+    memmove(buf, buf + start, len);
+    // A line that does not fit is dropped rather than read as two
+    if (len == RECV_BUF_LEN - 1) len = 0;
+    return len;
+}
+
 int is_valid_move(int column) {
     column--; 
-    if (column < 0 || column >= BOARD_HEIGHT) return 0;
+    if (column < 0 || column >= gs.cols) return 0;
     
-    return gs.board[BOARD_WIDTH-1][column] == 0;
+    return gs.board[gs.rows-1][column] == 0;
 }
 
 void handle_user_input() {
@@ -690,11 +923,13 @@ void handle_user_input() {
 
     switch (gs.state) {
         case STATE_INIT: {
+            // "name;token" claims the name for ratings; only the name is shown
+            char msg[128];
+            snprintf(msg, sizeof(msg), "n%.100s\n", buf);
+            Writen(sockfd, msg, strlen(msg));
+            buf[strcspn(buf, ";")] = '\0';
             strncpy(gs.player_name, buf, sizeof(gs.player_name) - 1);
             gs.player_name[sizeof(gs.player_name) - 1] = '\0';
-            char msg[64];
-            snprintf(msg, sizeof(msg), "n%s\n", gs.player_name);
-            Writen(sockfd, msg, strlen(msg));
             break;
         }
 
@@ -709,11 +944,19 @@ void handle_user_input() {
                     gs.state = STATE_WAITING;
                     break;
                     
-                case 2:  // Create Private Room
+                case 2: {  // Create Private Room
                     gs.game_ended = 0;  // Reset game_ended flag when creating room
-                    snprintf(buf, sizeof(buf), "m2%lld\n", gs.player_id);
+                    printf("Board (Enter for %s", GAME_CLASSIC->name);
+                    for (int i = 1; i < GAME_NVARIANTS; i++) printf(", %s", game_variants[i].name);
+                    printf("): ");
+                    fflush(stdout);
+                    char variant[32] = "";
+                    if (fgets(variant, sizeof(variant), stdin)) variant[strcspn(variant, "\r\n")] = '\0';
+                    if (variant[0]) snprintf(buf, sizeof(buf), "m2%lld;%s\n", gs.player_id, variant);
+                    else snprintf(buf, sizeof(buf), "m2%lld\n", gs.player_id);
                     Writen(sockfd, buf, strlen(buf));
                     break;
+                }
                     
                 case 3: {  // Join Private Room
                     gs.game_ended = 0;  // Reset game_ended flag when joining room
@@ -739,12 +982,54 @@ void handle_user_input() {
                             break;
                         }
                         
-                        case 5:  // Exit
+                        case 5: {  // Browse Lobby
+                            printf("Page (1 = most watched): ");
+                            fflush(stdout);
+                            if (fgets(buf, sizeof(buf), stdin)) {
+                                int page = atoi(buf);
+                                if (page < 1) page = 1;
+                                char msg[64];
+                                snprintf(msg, sizeof(msg), "m5%lld;%d\n", gs.player_id, page - 1);
+                                Writen(sockfd, msg, strlen(msg));
+                            }
+                            break;
+                        }
+
+                        case 6: {  // Tournaments
+                            printf("Enter for the list, or j/w/l<event> to join/watch/leave: ");
+                            fflush(stdout);
+                            if (fgets(buf, sizeof(buf), stdin)) {
+                                char msg[64];
+                                int event = atoi(buf + 1);
+                                if (strchr("jwl", buf[0]) && buf[0] && event > 0) {
+                                    snprintf(msg, sizeof(msg), "t%c%lld;%d\n", buf[0], gs.player_id, event);
+                                } else {
+                                    snprintf(msg, sizeof(msg), "ti%lld\n", gs.player_id);
+                                }
+                                Writen(sockfd, msg, strlen(msg));
+                            }
+                            break;
+                        }
+
+                        case 7: {  // Leaderboard
+                            printf("Page (1 = top %d): ", RATINGS_PAGE_SIZE);
+                            fflush(stdout);
+                            if (fgets(buf, sizeof(buf), stdin)) {
+                                int page = atoi(buf);
+                                if (page < 1) page = 1;
+                                char msg[64];
+                                snprintf(msg, sizeof(msg), "m6%lld;%d\n", gs.player_id, page - 1);
+                                Writen(sockfd, msg, strlen(msg));
+                            }
+                            break;
+                        }
+
+                        case 8:  // Exit
                             exit(0);
                             break;
                             
                         default:
-                            printf("Invalid choice. Please enter 1-5: ");
+                            printf("Invalid choice. Please enter 1-8: ");
                             fflush(stdout);
                     }
                     break;
@@ -821,58 +1106,60 @@ void handle_user_input() {
             // Handle move command (only when it's player's turn and not an audience)
             if (gs.my_turn && !gs.is_audience) {
                 int column = atoi(buf);
-                if (column >= 1 && column <= 7 && is_valid_move(column)) {
+                if (is_valid_move(column)) {
                     send_move(column);
                     inavaildstatus=0;
                 } else if (column != 0) {  // Only show error if input was a number but invalid
-                    MOVE_CURSOR(19, 0);
-                    printf("Invalid move! Enter 1-7 or ':' for chat: ");
                     inavaildstatus=1;
-                    MOVE_CURSOR(13 + first_line,0);
-                    fflush(stdout);
                 }
             }
 
             draw_board();
-            MOVE_CURSOR(19, 0);
-            if (gs.my_turn && !gs.game_ended && !gs.is_audience) {
-                printf("Your turn! Enter 1-7 or ':' for chat: ");
-                if(inavaildstatus){
-                    //
-                    MOVE_CURSOR(19, 0);
-                    printf("\033[KInvalid move! Enter 1-7 or ':' for chat: ");
-                }
-                MOVE_CURSOR(13 + first_line,0);
-            } else if (!gs.game_ended && !gs.is_audience) {
-                printf("Opponent's turn...");
-                MOVE_CURSOR(13 + first_line,0);
-            }
-            else if(gs.is_audience && !gs.game_ended){
-                MOVE_CURSOR(19, 0);
-                printf("Press q to quit or type your message after ':'.\n");
-                MOVE_CURSOR(13 + first_line,0);
-            }
-            fflush(stdout);
             break;
         }
     }
 }
 
+void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-b bots [-e random|search] [-D depth] [-d seconds]] <ServerIP> [port]\n", prog);
+    exit(1);
+}
+
 int main(int argc, char **argv) {
     struct sockaddr_in servaddr;
-    char recvbuf[MAXLINE];
-
-    if (argc != 2) {
-        fprintf(stderr, "usage: %s <ServerIP>\n", argv[0]);
-        exit(1);
+    char recvbuf[RECV_BUF_LEN];
+    int recvlen = 0;
+    int c;
+
+    // Headless mode: no terminal, -b bots playing back to back
+    bot_defaults();
+    bot_opts.nbots = 0;
+    bot_opts.spectator_pct = 0;
+    bot_opts.duration = 0;
+    while ((c = getopt(argc, argv, "b:e:D:d:")) != -1) {
+        switch (c) {
+            case 'b': bot_opts.nbots = atoi(optarg); break;
+            case 'e': bot_opts.engine = engine_find(optarg); break;
+            case 'D': bot_opts.depth = atoi(optarg); break;
+            case 'd': bot_opts.duration = atoi(optarg); break;
+            default: usage(argv[0]);
+        }
     }
-
-    sockfd = Socket(AF_INET, SOCK_STREAM, 0);
+    if (argc - optind != 1 && argc - optind != 2) usage(argv[0]);
+    if (!bot_opts.engine) usage(argv[0]);
 
     bzero(&servaddr, sizeof(servaddr));
     servaddr.sin_family = AF_INET;
-    servaddr.sin_port = htons(12345);
-    Inet_pton(AF_INET, argv[1], &servaddr.sin_addr);
+    servaddr.sin_port = htons(argc - optind == 2 ? atoi(argv[optind + 1]) : 12345);
+    Inet_pton(AF_INET, argv[optind], &servaddr.sin_addr);
+
+    if (bot_opts.nbots > 0) {
+        printf("client: %d %s bots against %s\n", bot_opts.nbots, bot_opts.engine->name, argv[optind]);
+        bot_run(&servaddr, "client");
+        return 0;
+    }
+
+    sockfd = Socket(AF_INET, SOCK_STREAM, 0);
 
     Connect(sockfd, (SA *)&servaddr, sizeof(servaddr));
 
@@ -894,13 +1181,12 @@ int main(int argc, char **argv) {
             handle_user_input();
         }
         if (fds[1].revents & POLLIN) {
-            int n = Read(sockfd, recvbuf, MAXLINE);
+            int n = Read(sockfd, recvbuf + recvlen, RECV_BUF_LEN - 1 - recvlen);
             if (n <= 0) {
                 printf("\nServer disconnected\n");
                 exit(1);
             }
-            recvbuf[n] = '\0';
-            handle_server_message(recvbuf);
+            recvlen = handle_server_data(recvbuf, recvlen + n);
         }
         if(gs.state==STATE_IN_GAME){
             MOVE_CURSOR(13 + first_line,0);
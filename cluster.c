@@ -0,0 +1,611 @@
+#include "server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <endian.h>
+#include <netinet/tcp.h>
+#include "cluster.h"
+#include "logger.h"
+#include "ratings.h"
+#include "stats.h"
+#include "uring.h"
+
+int cluster_size = 1;
+
+// Frame types. INPUT and CLOSE go from the edge to the owner, OUTPUT, END
+// and HOME come back; END either acknowledges a CLOSE or ends the session,
+// HOME returns it to the edge along with the line the edge must route.
+#define LINK_HELLO 1    // session = sender's node id, first frame of a link
+#define LINK_ADVERT 2   // session = sender's waitlist length
+#define LINK_OPEN 3     // payload = player id (8 bytes, big endian) + name
+#define LINK_INPUT 4
+#define LINK_OUTPUT 5
+#define LINK_CLOSE 6
+#define LINK_END 7
+#define LINK_HOME 8     // payload = player id + name + '\n' + line
+
+struct link_hdr {
+    uint32_t len;       // payload bytes
+    uint32_t session;   // the edge's fd for the client
+    uint8_t type;
+    uint8_t pad[3];
+};
+
+struct peer {
+    struct sockaddr_in addr;
+    int slot;           // clients[] slot of the link, -1 while down
+    char *in;           // bytes read but not yet a whole frame
+    size_t in_len;
+    size_t in_cap;
+    char *out;          // frames queued and not yet taken by the socket
+    size_t out_len;
+    size_t out_cap;
+    int waiting;        // its last advertised waitlist length
+    time_t next_try;
+};
+
+#define SLOT_NONE -1
+#define SLOT_LISTENER -2
+#define SLOT_PENDING -3   // accepted, HELLO not seen yet
+
+static struct peer peers[CLUSTER_MAX_NODES];
+static int self;
+static int *slot_peer;            // by clients[] slot: peer index or SLOT_*
+static int listen_slot = -1;
+static unsigned char *fwd_peer;   // by edge fd: owner + 1 of a handed-off session
+static unsigned char *closing;    // by edge fd * cluster_size + owner: CLOSEs not yet answered
+static int advertised = -1;
+
+static int make_vfd(int p, unsigned session) {
+    return CLUSTER_VFD_BASE | (p << 20) | (int)session;
+}
+
+static int vfd_peer(int vfd) {
+    return (vfd >> 20) & 0x3ff;
+}
+
+static unsigned vfd_session(int vfd) {
+    return (unsigned)vfd & 0xfffff;
+}
+
+static void append(char **buf, size_t *len, size_t *cap, const void *p, size_t n) {
+    if (*len + n > *cap) {
+        size_t cap2 = *cap ? *cap : 4096;
+        while (cap2 < *len + n) cap2 *= 2;
+        char *b = realloc(*buf, cap2);
+        if (!b) err_sys("realloc error");
+        *buf = b;
+        *cap = cap2;
+    }
+    memcpy(*buf + *len, p, n);
+    *len += n;
+}
+
+static int queue_frame(int p, int type, unsigned session, const void *payload, size_t n) {
+    struct peer *pr = &peers[p];
+    if (pr->slot < 0) return -1;
+    struct link_hdr h;
+    memset(&h, 0, sizeof(h));
+    h.len = htonl((uint32_t)n);
+    h.session = htonl(session);
+    h.type = (uint8_t)type;
+    append(&pr->out, &pr->out_len, &pr->out_cap, &h, sizeof(h));
+    if (n) append(&pr->out, &pr->out_len, &pr->out_cap, payload, n);
+    return 0;
+}
+
+static int add_slot(int fd, int kind) {
+    for (int i = ADMIN_SLOT + 1; i < cfg.max_clients; i++) {
+        if (clients[i].fd < 0) {
+            clients[i].fd = fd;
+            clients[i].events = POLLRDNORM;
+            slot_peer[i] = kind;
+            if (i > maxi) maxi = i;
+            return i;
+        }
+    }
+    close(fd);
+    return -1;
+}
+
+static void close_slot(int slot) {
+    if (uring_active) uring_forget(slot);
+    close(clients[slot].fd);
+    clients[slot].fd = -1;
+    slot_peer[slot] = SLOT_NONE;
+}
+
+static void link_up(int p, int slot) {
+    peers[p].slot = slot;
+    peers[p].in_len = peers[p].out_len = 0;
+    peers[p].waiting = 0;
+    slot_peer[slot] = p;
+    advertised = -1;   // resend ours on the next flush
+    log_event(EV_CLUSTER_LINK, -1, p, 1, NULL);
+}
+
+static void link_down(int p) {
+    struct peer *pr = &peers[p];
+    if (pr->slot < 0) return;
+    close_slot(pr->slot);
+    pr->slot = -1;
+    pr->in_len = pr->out_len = 0;
+    pr->waiting = 0;
+    pr->next_try = time(NULL) + CLUSTER_RETRY_SECS;
+    log_event(EV_CLUSTER_LINK, -1, p, 0, NULL);
+
+    // Clients we handed to p lose their session
+    for (int i = ADMIN_SLOT + 1; i <= maxi; i++) {
+        int fd = clients[i].fd;
+        if (fd < 0 || fd >= cfg.max_fd || slot_peer[i] != SLOT_NONE) continue;
+        if (fwd_peer[fd] == p + 1) {
+            fwd_peer[fd] = 0;
+            drop_client(i);
+        }
+    }
+    for (int fd = 0; fd < cfg.max_fd; fd++) closing[fd * cluster_size + p] = 0;
+
+    // Sessions p handed to us leave like any disconnected client
+    for (int i = 0; i < cfg.max_clients; i++) {
+        int fd = player_fds[i];
+        if (cluster_is_vfd(fd) && vfd_peer(fd) == p) cleanup_disconnected_client(fd);
+    }
+}
+
+static void open_listener(void) {
+    struct sockaddr_in addr = peers[self].addr;
+    int on = 1;
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    // Fails while an old process still holds the port during a hot
+    // upgrade; housekeeping retries
+    if (bind(fd, (SA *)&addr, sizeof(addr)) < 0 || listen(fd, CLUSTER_MAX_NODES) < 0) {
+        close(fd);
+        return;
+    }
+    listen_slot = add_slot(fd, SLOT_LISTENER);
+}
+
+// Blocks the loop for at most CLUSTER_CONNECT_MS when the peer is unreachable
+static void link_connect(int p) {
+    peers[p].next_try = time(NULL) + CLUSTER_RETRY_SECS;
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0) return;
+    if (connect(fd, (SA *)&peers[p].addr, sizeof(peers[p].addr)) < 0) {
+        struct pollfd pfd = { fd, POLLOUT, 0 };
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (errno != EINPROGRESS || poll(&pfd, 1, CLUSTER_CONNECT_MS) != 1 ||
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+            close(fd);
+            return;
+        }
+    }
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    int slot = add_slot(fd, SLOT_PENDING);
+    if (slot < 0) return;
+    link_up(p, slot);
+    queue_frame(p, LINK_HELLO, self, NULL, 0);
+}
+
+void cluster_init(void) {
+    char list[CONFIG_STR_LEN];
+    int n = 0;
+
+    self = cfg.node_id;
+    slot_peer = pool_alloc(cfg.max_clients, sizeof(int));
+    for (int i = 0; i < cfg.max_clients; i++) slot_peer[i] = SLOT_NONE;
+
+    snprintf(list, sizeof(list), "%s", cfg.cluster_peers);
+    for (char *tok = strtok(list, ","); tok; tok = strtok(NULL, ",")) {
+        char *colon = strrchr(tok, ':');
+        if (n == CLUSTER_MAX_NODES || !colon) err_quit("cluster.peers: bad entry %s", tok);
+        *colon = '\0';
+        while (*tok == ' ') tok++;
+        bzero(&peers[n].addr, sizeof(peers[n].addr));
+        peers[n].addr.sin_family = AF_INET;
+        peers[n].addr.sin_port = htons(atoi(colon + 1));
+        if (inet_pton(AF_INET, tok, &peers[n].addr.sin_addr) != 1) {
+            err_quit("cluster.peers: %s is not an IPv4 address", tok);
+        }
+        peers[n].slot = -1;
+        n++;
+    }
+    if (n <= 1) return;
+    if (self >= n) err_quit("node_id %d not in cluster.peers", self);
+
+    cluster_size = n;
+    room_id_base = MIN_ROOM_ID + self * CLUSTER_ROOM_STRIDE;
+    while ((next_id - 1) % n != self) next_id++;
+    fwd_peer = pool_alloc(cfg.max_fd, 1);
+    closing = pool_alloc((size_t)cfg.max_fd * n, 1);
+    printf("Cluster node %d of %d, rooms from %d\n", self, n, room_id_base);
+}
+
+int cluster_owner(int room_id) {
+    if (cluster_size == 1 || room_id < MIN_ROOM_ID) return self;
+    int owner = (room_id - MIN_ROOM_ID) / CLUSTER_ROOM_STRIDE;
+    return owner < cluster_size ? owner : self;
+}
+
+int cluster_owns_slot(int slot) {
+    return slot_peer[slot] != SLOT_NONE;
+}
+
+int cluster_forwarding(int fd) {
+    return cluster_size > 1 && fd >= 0 && fd < cfg.max_fd && fwd_peer[fd];
+}
+
+// ---- edge side ----
+
+void cluster_forward(int fd, const char *line) {
+    char buf[MAXLINE + 1];
+    int n = snprintf(buf, sizeof(buf), "%s\n", line);
+    queue_frame(fwd_peer[fd] - 1, LINK_INPUT, fd, buf, n);
+}
+
+static int handoff(int fd, struct Player* player, int p, const char *line) {
+    if (fd < 0 || fd >= cfg.max_fd || peers[p].slot < 0) return 0;
+
+    char open[8 + MAX_NAME_LEN];
+    uint64_t id = htobe64((uint64_t)player->id);
+    int name_len = strlen(player->name);
+    memcpy(open, &id, 8);
+    memcpy(open + 8, player->name, name_len);
+    queue_frame(p, LINK_OPEN, fd, open, 8 + name_len);
+    log_event(EV_CLUSTER_HANDOFF, fd, player->id, p, NULL);
+
+    // The session now lives on the owner; this node only relays bytes
+    waitlist_remove(player->id);
+    ratings_logout(player->rating);
+    player->rating = -1;
+    player_set(player, -1, -1);
+    player->room_id = -1;
+    player->player_number = 0;
+    fwd_peer[fd] = p + 1;
+    cluster_forward(fd, line);
+    return 1;
+}
+
+// Lowest connected node below `below` (any, if -1) with players waiting
+static int waiting_peer(int below) {
+    for (int p = 0; p < cluster_size; p++) {
+        if (p == self || (below >= 0 && p >= below)) continue;
+        if (peers[p].slot >= 0 && peers[p].waiting > 0) return p;
+    }
+    return -1;
+}
+
+// Owner side: only the edge can move a session on, so it goes back there
+static int send_home(int vfd, struct Player* player, const char *line) {
+    char home[8 + MAX_NAME_LEN + MAXLINE + 1];
+    uint64_t id = htobe64((uint64_t)player->id);
+    memcpy(home, &id, 8);
+    int n = 8 + snprintf(home + 8, sizeof(home) - 8, "%s\n%s", player->name, line);
+    if (queue_frame(vfd_peer(vfd), LINK_HOME, vfd_session(vfd), home, n) < 0) return 0;
+    log_event(EV_CLUSTER_HANDOFF, vfd, player->id, vfd_peer(vfd), NULL);
+    cleanup_disconnected_client(vfd);
+    return 1;
+}
+
+/*
+ * Called for m1/m3/m4 before they are handled locally. Returns 1 when the
+ * session was handed to the owning node, which then answers the message,
+ * or, for a session handed to us, sent back to its edge to be routed.
+ */
+int cluster_route(int fd, struct Player* player, char action, const char *message) {
+    long long player_id;
+    int room_id, p;
+
+    if (cluster_size == 1 || player->room_id != -1) return 0;
+    switch (action) {
+        case '1':
+            // Handed-in sessions wait here; housekeeping merges waitlists
+            if (cluster_is_vfd(fd) || waitlist.count > 0 || (p = waiting_peer(-1)) < 0) return 0;
+            return handoff(fd, player, p, message);
+        case '3':
+        case '4':
+            if (sscanf(message + 2, "%lld;%d", &player_id, &room_id) != 2) return 0;
+            p = cluster_owner(room_id);
+            if (p == self) return 0;
+            if (cluster_is_vfd(fd)) return send_home(fd, player, message);
+            return handoff(fd, player, p, message);
+    }
+    return 0;
+}
+
+void cluster_client_closed(int fd) {
+    if (!cluster_forwarding(fd)) return;
+    int p = fwd_peer[fd] - 1;
+    fwd_peer[fd] = 0;
+    if (queue_frame(p, LINK_CLOSE, fd, NULL, 0) == 0) closing[fd * cluster_size + p]++;
+}
+
+static void edge_output(int p, unsigned fd, const char *data, size_t len) {
+    if (fd >= (unsigned)cfg.max_fd || fwd_peer[fd] != p + 1 || closing[fd * cluster_size + p]) return;
+    client_write(fd, data, len);
+}
+
+static void drop_edge_client(int fd) {
+    for (int i = ADMIN_SLOT + 1; i <= maxi; i++) {
+        if (clients[i].fd == fd && slot_peer[i] == SLOT_NONE) {
+            drop_client(i);
+            return;
+        }
+    }
+}
+
+// 1 when a frame from p still belongs to the session on edge fd; an END or
+// HOME crossing our CLOSE only answers it
+static int edge_current(int p, unsigned fd) {
+    if (fd >= (unsigned)cfg.max_fd) return 0;
+    unsigned char *pending = &closing[fd * cluster_size + p];
+    if (*pending) {
+        (*pending)--;
+        return 0;
+    }
+    return fwd_peer[fd] == p + 1;
+}
+
+static void edge_end(int p, unsigned fd) {
+    if (!edge_current(p, fd)) return;
+    // The owner ended the session (e.g. it was flooding)
+    fwd_peer[fd] = 0;
+    drop_edge_client(fd);
+}
+
+/*
+ * The owner gave the session back: it left its rooms there and asked for
+ * a room elsewhere. It becomes a local player again and its line is
+ * handled as if just read, so it is routed on to that room's owner or
+ * served here. The line passes the rate limiter a second time.
+ */
+static void edge_home(int p, unsigned fd, const char *payload, size_t len) {
+    char buf[MAXLINE];
+    uint64_t id;
+
+    if (len < 8 || len - 8 >= MAXLINE || !memchr(payload + 8, '\n', len - 8)) return;
+    if (!edge_current(p, fd)) return;
+    fwd_peer[fd] = 0;
+    memcpy(&id, payload, 8);
+    memcpy(buf, payload + 8, len - 8);
+    buf[len - 8] = '\0';
+    char *line = strchr(buf, '\n');
+    *line++ = '\0';
+    size_t name_len = strlen(buf) < MAX_NAME_LEN - 1 ? strlen(buf) : MAX_NAME_LEN - 1;
+
+    for (int i = 0; i < cfg.max_clients; i++) {
+        if (player_fds[i] != -1) continue;
+        player_set(&players[i], (long long)be64toh(id), fd);
+        memcpy(players[i].name, buf, name_len);
+        players[i].name[name_len] = '\0';
+        players[i].rating = ratings_login(players[i].name, NULL);
+        players[i].room_id = -1;
+        players[i].player_number = 0;
+        log_event(EV_CLUSTER_HANDOFF, fd, players[i].id, self, NULL);
+        if (handle_client_message(fd, line, strlen(line)) < 0) drop_edge_client(fd);
+        return;
+    }
+    drop_edge_client(fd);
+}
+
+// ---- owner side ----
+
+void cluster_write(int vfd, const void *buf, size_t len) {
+    if (queue_frame(vfd_peer(vfd), LINK_OUTPUT, vfd_session(vfd), buf, len) == 0) {
+        stats.bytes_out += len;
+    }
+}
+
+static void session_open(int p, unsigned session, const char *payload, size_t len) {
+    int vfd = make_vfd(p, session);
+    uint64_t id;
+
+    if (len < 8 || session >= (1u << 20)) return;
+    if (find_player_by_fd(vfd)) cleanup_disconnected_client(vfd);
+    memcpy(&id, payload, 8);
+    for (int i = 0; i < cfg.max_clients; i++) {
+        if (player_fds[i] != -1) continue;
+        size_t name_len = len - 8 < MAX_NAME_LEN - 1 ? len - 8 : MAX_NAME_LEN - 1;
+        player_set(&players[i], (long long)be64toh(id), vfd);
+        memcpy(players[i].name, payload + 8, name_len);
+        players[i].name[name_len] = '\0';
+        players[i].rating = ratings_login(players[i].name, NULL);
+        players[i].room_id = -1;
+        players[i].player_number = 0;
+        return;
+    }
+    queue_frame(p, LINK_END, session, NULL, 0);
+}
+
+static void session_input(int p, unsigned session, const char *data, size_t len) {
+    char buf[MAXLINE];
+    int vfd = make_vfd(p, session);
+
+    if (len >= MAXLINE || session >= (1u << 20) || !find_player_by_fd(vfd)) return;
+    memcpy(buf, data, len);
+    stats.bytes_in += len;
+    if (handle_client_message(vfd, buf, len) < 0) {
+        cleanup_disconnected_client(vfd);
+        queue_frame(p, LINK_END, session, NULL, 0);
+    }
+}
+
+static void session_close(int p, unsigned session) {
+    int vfd = make_vfd(p, session);
+    if (session >= (1u << 20) || !find_player_by_fd(vfd)) return;   // we ended it first
+    cleanup_disconnected_client(vfd);
+    queue_frame(p, LINK_END, session, NULL, 0);
+}
+
+// ---- link I/O ----
+
+/*
+ * Links never block the loop: two nodes writing big batches at each other
+ * with full socket buffers would otherwise wait on each other forever.
+ * What the socket does not take stays queued and goes out on POLLOUT.
+ */
+static void want_write(int slot, int on) {
+    short events = on ? POLLRDNORM | POLLWRNORM : POLLRDNORM;
+    if (clients[slot].events == events) return;
+    clients[slot].events = events;
+    if (uring_active) uring_rearm(slot);
+}
+
+// -1 on a write error; a full socket is not one
+static int link_send(int p) {
+    struct peer *pr = &peers[p];
+    size_t off = 0;
+    while (off < pr->out_len) {
+        ssize_t n = send(clients[pr->slot].fd, pr->out + off, pr->out_len - off, MSG_NOSIGNAL);
+        if (n > 0) {
+            off += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            return -1;
+        }
+    }
+    memmove(pr->out, pr->out + off, pr->out_len - off);
+    pr->out_len -= off;
+    want_write(pr->slot, pr->out_len > 0);
+    return 0;
+}
+
+static void dispatch(int p, int type, unsigned session, const char *payload, size_t len) {
+    switch (type) {
+        case LINK_ADVERT: peers[p].waiting = (int)session; break;
+        case LINK_OPEN: session_open(p, session, payload, len); break;
+        case LINK_INPUT: session_input(p, session, payload, len); break;
+        case LINK_CLOSE: session_close(p, session); break;
+        case LINK_OUTPUT: edge_output(p, session, payload, len); break;
+        case LINK_END: edge_end(p, session); break;
+        case LINK_HOME: edge_home(p, session, payload, len); break;
+    }
+}
+
+static void accept_link(void) {
+    int fd = accept4(clients[listen_slot].fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (fd < 0) return;
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    add_slot(fd, SLOT_PENDING);
+}
+
+static void read_hello(int slot) {
+    struct link_hdr h;
+    ssize_t n = recv(clients[slot].fd, &h, sizeof(h), MSG_PEEK | MSG_DONTWAIT);
+    if (n > 0 && n < (ssize_t)sizeof(h)) return;   // rest still in flight
+    if (n <= 0 || read(clients[slot].fd, &h, sizeof(h)) != sizeof(h) || h.type != LINK_HELLO) {
+        close_slot(slot);
+        return;
+    }
+    int p = (int)ntohl(h.session);
+    if (p < 0 || p >= cluster_size || p == self) {
+        close_slot(slot);
+        return;
+    }
+    // A reconnecting peer replaces its old link
+    link_down(p);
+    link_up(p, slot);
+}
+
+void cluster_serve(int slot) {
+    int kind = slot_peer[slot];
+    if (kind == SLOT_LISTENER) {
+        accept_link();
+        return;
+    }
+    if (kind == SLOT_PENDING) {
+        read_hello(slot);
+        return;
+    }
+
+    struct peer *pr = &peers[kind];
+    if (pr->out_len > 0 && link_send(kind) < 0) {
+        link_down(kind);
+        return;
+    }
+    if (pr->in_cap - pr->in_len < 65536) {
+        char *b = realloc(pr->in, pr->in_len + 65536);
+        if (!b) err_sys("realloc error");
+        pr->in = b;
+        pr->in_cap = pr->in_len + 65536;
+    }
+    ssize_t n = read(clients[slot].fd, pr->in + pr->in_len, pr->in_cap - pr->in_len);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return;   // woken to write
+    if (n <= 0) {
+        link_down(kind);
+        return;
+    }
+    pr->in_len += n;
+
+    size_t off = 0;
+    while (pr->in_len - off >= sizeof(struct link_hdr)) {
+        struct link_hdr h;
+        memcpy(&h, pr->in + off, sizeof(h));
+        size_t len = ntohl(h.len);
+        if (len > CLUSTER_MAX_FRAME) {
+            link_down(kind);
+            return;
+        }
+        if (pr->in_len - off < sizeof(h) + len) break;
+        dispatch(kind, h.type, ntohl(h.session), pr->in + off + sizeof(h), len);
+        if (pr->slot != slot) return;   // the link went down meanwhile
+        off += sizeof(h) + len;
+    }
+    memmove(pr->in, pr->in + off, pr->in_len - off);
+    pr->in_len -= off;
+}
+
+// Once per loop round: waitlist advert if it changed, then what each link
+// takes; a peer that stopped reading is cut off at CLUSTER_MAX_BACKLOG
+void cluster_flush(void) {
+    if (cluster_size == 1) return;
+    if (waitlist.count != advertised) {
+        advertised = waitlist.count;
+        for (int p = 0; p < cluster_size; p++) {
+            if (p != self) queue_frame(p, LINK_ADVERT, advertised, NULL, 0);
+        }
+    }
+    for (int p = 0; p < cluster_size; p++) {
+        struct peer *pr = &peers[p];
+        if (pr->slot < 0 || pr->out_len == 0) continue;
+        if (link_send(p) < 0 || pr->out_len > CLUSTER_MAX_BACKLOG) link_down(p);
+    }
+}
+
+// Once a second: (re)open the listener and links, and merge waitlists
+void cluster_housekeeping(void) {
+    if (cluster_size == 1) return;
+    if (listen_slot < 0 || clients[listen_slot].fd < 0) open_listener();
+
+    time_t now = time(NULL);
+    for (int p = 0; p < self; p++) {
+        if (peers[p].slot < 0 && now >= peers[p].next_try) link_connect(p);
+    }
+
+    // Waiters on two nodes would never meet; the higher node sends its
+    // waiters to the lowest node that also has some, those handed to it
+    // by way of their edge
+    int p = waiting_peer(self);
+    if (p < 0) return;
+    for (int n = waitlist.count; n > 0; n--) {
+        long long id = remove_from_waitlist();
+        struct Player* player = find_player_by_id(id);
+        if (!player) continue;
+        char line[32];
+        snprintf(line, sizeof(line), "m1%lld", id);
+        int moved = cluster_is_vfd(player->fd) ? send_home(player->fd, player, line)
+                                               : handoff(player->fd, player, p, line);
+        if (!moved) add_to_waitlist(id);
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <stddef.h>
+
+#define CLUSTER_MAX_NODES 16
+#define CLUSTER_ROOM_STRIDE 1000000   // room ids per node, >= the largest max_rooms
+#define CLUSTER_VFD_BASE (1 << 30)    // fds at or above this are sessions proxied in from a peer
+#define CLUSTER_RETRY_SECS 2          // between connection attempts to a peer that is down
+#define CLUSTER_CONNECT_MS 200        // longest the event loop waits on one connect
+#define CLUSTER_MAX_FRAME (1 << 20)
+#define CLUSTER_MAX_BACKLOG (64 << 20) // unsent bytes on a link before it is dropped
+
+struct Player;
+
+/*
+ * Several server processes acting as one service. Node k of n owns the
+ * room ids room_id_base .. + CLUSTER_ROOM_STRIDE, so the owner of any room
+ * follows from its id, and hands out player ids congruent to k mod n.
+ *
+ * A client always talks to the node it connected to (the edge). When it
+ * joins or watches a room on another node, or quick-matches with a player
+ * waiting on one, the edge hands the whole session to that owner over the
+ * internal link and from then on only relays bytes: client lines go up as
+ * INPUT frames, everything the owner writes comes back as OUTPUT frames.
+ * On the owner the session is an ordinary player whose fd is a virtual fd
+ * (CLUSTER_VFD_BASE | node << 20 | edge fd); client_write() turns writes
+ * to it into frames. Nodes advertise their waitlist length so quick match
+ * finds opponents anywhere. Only the edge moves a session: when it asks
+ * the owner for a room on a third node, or its own, the owner sends it
+ * home and the edge routes the line again.
+ *
+ * Each pair of nodes shares one TCP link; the higher id connects. Frames
+ * queued during a round go out in one write per link, and what a full
+ * socket does not take waits for POLLOUT.
+ */
+extern int cluster_size;
+
+void cluster_init(void);
+int cluster_owner(int room_id);
+int cluster_owns_slot(int slot);
+void cluster_serve(int slot);
+int cluster_route(int fd, struct Player* player, char action, const char *message);
+int cluster_forwarding(int fd);
+void cluster_forward(int fd, const char *line);
+void cluster_write(int vfd, const void *buf, size_t len);
+void cluster_client_closed(int fd);
+void cluster_flush(void);
+void cluster_housekeeping(void);
+
+static inline int cluster_is_vfd(int fd) {
+    return fd >= CLUSTER_VFD_BASE;
+}
+
+#endif
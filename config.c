@@ -0,0 +1,300 @@
+#include "server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <ctype.h>
+#include <limits.h>
+#include "config.h"
+#include "logger.h"
+#include "ratelimit.h"
+#include "chat.h"
+#include "capture.h"
+#include "arena.h"
+
+struct server_config cfg;
+volatile sig_atomic_t reload_requested = 0;
+
+static struct server_config defaults;
+static const char *config_path;
+static char *overrides[CONFIG_MAX_OVERRIDES];
+static int noverrides = 0;
+
+struct config_key {
+    const char *name;
+    size_t offset;
+    int min;
+    int max;
+    int reloadable;   // applied by SIGHUP; the rest need a restart or hot upgrade
+};
+
+#define KEY(field, min, max, reloadable) \
+    { #field, offsetof(struct server_config, field), min, max, reloadable }
+
+static const struct config_key keys[] = {
+    KEY(port,            1,    65535,     0),
+    KEY(admin_port,      0,    65535,     0),   // 0 disables the stats endpoint
+    KEY(max_clients,     3,    1000000,   0),
+    KEY(max_rooms,       1,    1000000,   0),
+    KEY(max_audience,    0,    100000,    0),
+    KEY(listen_backlog,  1,    65535,     0),
+    KEY(room_arena_size, 1024, 1 << 24,   0),
+    KEY(uring_entries,   8,    32768,     0),
+    KEY(uring_bufs,      8,    32768,     0),
+    KEY(io_uring,        0,    1,         0),
+    KEY(node_id,         0,    1023,      0),
+    KEY(game_timeout,    1,    86400,     1),
+    KEY(poll_timeout_ms, 1,    60000,     1),
+    KEY(per_ip_cap,      0,    1000000,   1),
+    KEY(log_level,       0,    3,         1),
+    KEY(trace_slow_us,   0,    60000000,  1),   // 0 keeps every move
+};
+#define NUM_KEYS (int)(sizeof(keys) / sizeof(keys[0]))
+
+static int *key_field(struct server_config *c, const struct config_key *k) {
+    return (int *)((char *)c + k->offset);
+}
+
+// Range-checked as a long: narrowing first would wrap 4294967297 to 1
+static int parse_int(const char *s, int *out) {
+    char *end;
+    errno = 0;
+    long v = strtol(s, &end, 10);
+    if (end == s || *end != '\0' || errno == ERANGE || v < INT_MIN || v > INT_MAX) return -1;
+    *out = (int)v;
+    return 0;
+}
+
+// "rate/burst", both positive
+static int parse_limit(const char *s, struct rl_limit *out) {
+    char rate_s[32];
+    const char *slash = strchr(s, '/');
+    int rate, burst;
+    if (!slash || slash - s >= (int)sizeof(rate_s)) return -1;
+    memcpy(rate_s, s, slash - s);
+    rate_s[slash - s] = '\0';
+    if (parse_int(rate_s, &rate) < 0 || parse_int(slash + 1, &burst) < 0 || rate <= 0 || burst <= 0) return -1;
+    out->rate = rate;
+    out->burst = burst;
+    return 0;
+}
+
+static int set_key(struct server_config *c, const char *key, const char *value) {
+    if (strcmp(key, "cluster.peers") == 0) {
+        if (strlen(value) >= sizeof(c->cluster_peers)) return -1;
+        strcpy(c->cluster_peers, value);
+        return 0;
+    }
+    if (strcmp(key, "relay.upstream") == 0) {
+        if (strlen(value) >= sizeof(c->relay_upstream)) return -1;
+        strcpy(c->relay_upstream, value);
+        return 0;
+    }
+    if (strcmp(key, "ratings.file") == 0) {
+        if (strlen(value) >= sizeof(c->ratings_file)) return -1;
+        strcpy(c->ratings_file, value);
+        return 0;
+    }
+    if (strcmp(key, "gamelog.file") == 0) {
+        if (strlen(value) >= sizeof(c->gamelog_file)) return -1;
+        strcpy(c->gamelog_file, value);
+        return 0;
+    }
+    if (strcmp(key, "capture.file") == 0) {
+        if (strlen(value) >= sizeof(c->capture_file)) return -1;
+        strcpy(c->capture_file, value);
+        return 0;
+    }
+    if (strncmp(key, "ratelimit.", 10) == 0) {
+        const char *cmd = key + 10;
+        if (strcmp(cmd, "conn") == 0) return parse_limit(value, &c->rl_conn);
+        for (int i = 0; i < STAT_CMD_COUNT; i++) {
+            if (strcmp(cmd, stat_cmd_names[i]) == 0) return parse_limit(value, &c->rl_cmd[i]);
+        }
+        return -1;
+    }
+    for (int i = 0; i < NUM_KEYS; i++) {
+        if (strcmp(key, keys[i].name) != 0) continue;
+        int v;
+        if (parse_int(value, &v) < 0 || v < keys[i].min || v > keys[i].max) return -1;
+        *key_field(c, &keys[i]) = v;
+        return 0;
+    }
+    return -1;
+}
+
+static char *trim(char *s) {
+    while (isspace((unsigned char)*s)) s++;
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) *--end = '\0';
+    return s;
+}
+
+// Applies one "key = value" line in place; blank lines and comments are fine
+static int apply_line(struct server_config *c, char *line) {
+    char *hash = strchr(line, '#');
+    if (hash) *hash = '\0';
+    line = trim(line);
+    if (*line == '\0') return 0;
+
+    char *eq = strchr(line, '=');
+    if (!eq) return -1;
+    *eq = '\0';
+    return set_key(c, trim(line), trim(eq + 1));
+}
+
+static int read_file(struct server_config *c, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "config: cannot open %s\n", path);
+        return -1;
+    }
+    char line[CONFIG_LINE_LEN];
+    int lineno = 0, rc = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        if (!strchr(line, '\n') && !feof(f)) {
+            fprintf(stderr, "config: %s:%d: line longer than %d bytes\n", path, lineno, CONFIG_LINE_LEN - 2);
+            rc = -1;
+            break;
+        }
+        if (apply_line(c, line) < 0) {
+            fprintf(stderr, "config: %s:%d: bad setting\n", path, lineno);
+            rc = -1;
+            break;
+        }
+    }
+    fclose(f);
+    return rc;
+}
+
+static int is_pow2(int v) {
+    return v > 0 && (v & (v - 1)) == 0;
+}
+
+// Defaults, then the file, then the command line
+static int build(struct server_config *c) {
+    *c = defaults;
+    if (config_path && read_file(c, config_path) < 0) return -1;
+    for (int i = 0; i < noverrides; i++) {
+        char line[CONFIG_LINE_LEN];
+        if (strlen(overrides[i]) >= sizeof(line)) {
+            fprintf(stderr, "config: option -o %.32s... longer than %d bytes\n", overrides[i], CONFIG_LINE_LEN - 1);
+            return -1;
+        }
+        strcpy(line, overrides[i]);
+        if (apply_line(c, line) < 0) {
+            fprintf(stderr, "config: bad option -o %s\n", overrides[i]);
+            return -1;
+        }
+    }
+
+    if (!is_pow2(c->uring_bufs)) {
+        fprintf(stderr, "config: uring_bufs must be a power of two\n");
+        return -1;
+    }
+    if ((size_t)c->room_arena_size < sizeof(long long) * c->max_audience + chat_arena_size() + 2 * ARENA_ALIGN) {
+        fprintf(stderr, "config: room_arena_size too small for max_audience %d\n", c->max_audience);
+        return -1;
+    }
+    // Room for the listeners, log file, io_uring and whatever else is open
+    c->max_fd = c->max_clients + 1024;
+    return 0;
+}
+
+// Live state that is not read through cfg
+static void apply_runtime(void) {
+    log_min_level = cfg.log_level;
+    rl_conn_limit = cfg.rl_conn;
+    memcpy(rl_cmd_limits, cfg.rl_cmd, sizeof(rl_cmd_limits));
+}
+
+void config_defaults(void) {
+    static int done = 0;
+    if (!done) {
+        defaults.port = DEFAULT_PORT;
+        defaults.admin_port = DEFAULT_ADMIN_PORT;
+        defaults.max_clients = DEFAULT_MAX_CLIENTS;
+        defaults.max_rooms = DEFAULT_MAX_ROOMS;
+        defaults.max_audience = DEFAULT_MAX_AUDIENCE;
+        defaults.game_timeout = DEFAULT_GAME_TIMEOUT;
+        defaults.poll_timeout_ms = DEFAULT_POLL_TIMEOUT_MS;
+        defaults.listen_backlog = LISTENQ;
+        defaults.per_ip_cap = DEFAULT_PER_IP_CAP;
+        defaults.room_arena_size = DEFAULT_ROOM_ARENA_SIZE;
+        defaults.uring_entries = DEFAULT_URING_ENTRIES;
+        defaults.uring_bufs = DEFAULT_URING_BUFS;
+        strcpy(defaults.ratings_file, DEFAULT_RATINGS_FILE);
+        defaults.io_uring = 1;
+        defaults.log_level = log_min_level;
+        defaults.trace_slow_us = DEFAULT_TRACE_SLOW_US;
+        // The compiled-in tables in ratelimit.c are the defaults
+        defaults.rl_conn = rl_conn_limit;
+        memcpy(defaults.rl_cmd, rl_cmd_limits, sizeof(defaults.rl_cmd));
+        defaults.max_fd = defaults.max_clients + 1024;
+        done = 1;
+    }
+    cfg = defaults;
+}
+
+// Queues a "key=value" from the command line; it is applied after the file
+int config_override(const char *assignment) {
+    if (noverrides == CONFIG_MAX_OVERRIDES) return -1;
+    overrides[noverrides] = strdup(assignment);
+    if (!overrides[noverrides]) return -1;
+    noverrides++;
+    return 0;
+}
+
+int config_load(const char *path) {
+    struct server_config next;
+    config_defaults();
+    config_path = path;
+    if (build(&next) < 0) return -1;
+    cfg = next;
+    apply_runtime();
+    return 0;
+}
+
+/*
+ * SIGHUP: re-reads the file (command-line overrides still win) and applies
+ * the reloadable keys. A bad file leaves the running config untouched.
+ */
+void config_reload(void) {
+    struct server_config next;
+    if (build(&next) < 0) {
+        log_event(EV_CONFIG_ERROR, -1, 0, 0, config_path ? config_path : "(none)");
+        return;
+    }
+    for (int i = 0; i < NUM_KEYS; i++) {
+        int *cur = key_field(&cfg, &keys[i]);
+        int *want = key_field(&next, &keys[i]);
+        if (*cur == *want) continue;
+        if (keys[i].reloadable) {
+            *cur = *want;
+        } else {
+            log_event(EV_CONFIG_RESTART, -1, *cur, *want, keys[i].name);
+        }
+    }
+    if (strcmp(cfg.cluster_peers, next.cluster_peers) != 0) {
+        log_event(EV_CONFIG_RESTART, -1, 0, 0, "cluster.peers");
+    }
+    if (strcmp(cfg.relay_upstream, next.relay_upstream) != 0) {
+        log_event(EV_CONFIG_RESTART, -1, 0, 0, "relay.upstream");
+    }
+    if (strcmp(cfg.ratings_file, next.ratings_file) != 0) {
+        log_event(EV_CONFIG_RESTART, -1, 0, 0, "ratings.file");
+    }
+    if (strcmp(cfg.gamelog_file, next.gamelog_file) != 0) {
+        log_event(EV_CONFIG_RESTART, -1, 0, 0, "gamelog.file");
+    }
+    // A new capture file starts a new trace; an empty one ends the capture
+    if (strcmp(cfg.capture_file, next.capture_file) != 0) {
+        strcpy(cfg.capture_file, next.capture_file);
+        capture_open(cfg.capture_file);
+    }
+    cfg.rl_conn = next.rl_conn;
+    memcpy(cfg.rl_cmd, next.rl_cmd, sizeof(cfg.rl_cmd));
+    apply_runtime();
+    log_event(EV_CONFIG_RELOADED, -1, 0, 0, config_path ? config_path : "(none)");
+}
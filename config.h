@@ -0,0 +1,68 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <signal.h>
+#include "ratelimit.h"
+
+// Defaults, used when neither the config file nor the command line says otherwise
+#define DEFAULT_PORT 12345
+#define DEFAULT_ADMIN_PORT 12346
+#define DEFAULT_MAX_CLIENTS 50
+#define DEFAULT_MAX_ROOMS 20
+#define DEFAULT_MAX_AUDIENCE 50
+#define DEFAULT_GAME_TIMEOUT 60
+#define DEFAULT_POLL_TIMEOUT_MS 1000
+#define DEFAULT_PER_IP_CAP 8
+#define DEFAULT_ROOM_ARENA_SIZE (16 * 1024)
+#define DEFAULT_URING_ENTRIES 256
+#define DEFAULT_URING_BUFS 256
+#define DEFAULT_RATINGS_FILE "ratings.db"
+#define DEFAULT_TRACE_SLOW_US 10000
+
+#define CONFIG_MAX_OVERRIDES 64
+#define CONFIG_STR_LEN 512
+#define CONFIG_LINE_LEN (CONFIG_STR_LEN + 128)   // a key, its string value and a comment
+
+/*
+ * Everything sized or tuned at startup. Values come from the defaults
+ * above, then the config file (-c), then command-line overrides, which
+ * always win. SIGHUP re-reads the file and applies the keys marked
+ * reloadable in config.c; the rest (ports, pool sizes) take effect on the
+ * next start or hot upgrade.
+ */
+struct server_config {
+    int port;
+    int admin_port;
+    int max_clients;       // connection slots, including the two listeners
+    int max_rooms;
+    int max_audience;      // spectators per room
+    int game_timeout;      // seconds the player to move has before losing
+    int poll_timeout_ms;   // longest event-loop sleep
+    int listen_backlog;
+    int per_ip_cap;
+    int room_arena_size;
+    int uring_entries;
+    int uring_bufs;        // power of two
+    int io_uring;          // 0 forces the poll loop
+    int log_level;
+    int trace_slow_us;     // moves at least this slow, read to last flush, are kept for /moves
+    struct rl_limit rl_conn;
+    struct rl_limit rl_cmd[STAT_CMD_COUNT];
+    int node_id;           // this process's index in cluster_peers
+    char cluster_peers[CONFIG_STR_LEN];   // "host:port,..." link address of every node, empty for one node
+    char relay_upstream[CONFIG_STR_LEN];  // "host:port" of the server to relay spectators for, empty to host games
+    char ratings_file[CONFIG_STR_LEN];    // append-only ratings store, one per process; empty keeps them in memory
+    char gamelog_file[CONFIG_STR_LEN];    // finished games for the analytics tool, empty records nothing
+    char capture_file[CONFIG_STR_LEN];    // inbound traffic trace for the replay tool, empty captures nothing
+    int max_fd;            // derived: size of the fd-indexed tables
+};
+
+extern struct server_config cfg;
+extern volatile sig_atomic_t reload_requested;
+
+void config_defaults(void);
+int config_override(const char *assignment);
+int config_load(const char *path);
+void config_reload(void);
+
+#endif
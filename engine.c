@@ -0,0 +1,147 @@
+#include <stdlib.h>
+#include <string.h>
+#include "engine.h"
+
+// Centre columns first: alpha-beta cuts far more when the best move comes early
+static void move_order(int cols, int order[GAME_MAX_COLS]) {
+    for (int i = 0; i < cols; i++) order[i] = cols / 2 + (i % 2 ? -(i + 1) / 2 : i / 2);
+}
+
+// Any legal column, uniformly; what the interactive client's get_ai_move() does
+static int random_choose(const struct game *g, int piece, struct engine_ctx *ctx) {
+    int valid_columns[GAME_MAX_COLS];
+    int valid_count = 0;
+    (void)piece;
+
+    for (int col = 0; col < g->v->cols; col++) {
+        if (g->height[col] < g->v->rows) valid_columns[valid_count++] = col;
+    }
+    ctx->nodes++;
+    ctx->reached = 0;
+    if (valid_count == 0) return -1;
+    return valid_columns[rand_r(&ctx->seed) % valid_count] + 1;
+}
+
+static int popcount(game_bits x) {
+    return __builtin_popcountll((unsigned long long)x) + __builtin_popcountll((unsigned long long)(x >> 64));
+}
+
+/*
+ * Windows of n cells along one direction, one bit per window at its first
+ * cell. Each side's pieces per window are summed in three bit-sliced
+ * counters; a window holding only one side's pieces scores by their count.
+ */
+static int score_direction(game_bits mine, game_bits theirs, game_bits cells, int stride, int n) {
+    static const int weight[5] = { 0, 1, 8, 64, 512 };   // up to connect five
+    game_bits valid = cells, m[3] = { 0, 0, 0 }, t[3] = { 0, 0, 0 };
+    int score = 0;
+
+    for (int k = 0; k < n; k++) {
+        game_bits a = mine >> (k * stride), b = theirs >> (k * stride), carry;
+        valid &= cells >> (k * stride);
+        carry = m[0] & a; m[0] ^= a; m[2] |= m[1] & carry; m[1] ^= carry;
+        carry = t[0] & b; t[0] ^= b; t[2] |= t[1] & carry; t[1] ^= carry;
+    }
+    game_bits open_m = valid & ~(t[0] | t[1] | t[2]);
+    game_bits open_t = valid & ~(m[0] | m[1] | m[2]);
+    for (int c = 1; c < n; c++) {
+        game_bits sm = (c & 1 ? m[0] : ~m[0]) & (c & 2 ? m[1] : ~m[1]) & (c & 4 ? m[2] : ~m[2]);
+        game_bits st = (c & 1 ? t[0] : ~t[0]) & (c & 2 ? t[1] : ~t[1]) & (c & 4 ? t[2] : ~t[2]);
+        score += weight[c] * (popcount(open_m & sm) - popcount(open_t & st));
+    }
+    return score;
+}
+
+// Static evaluation from piece's side: open windows of `connect`, plus the centre column
+static int evaluate(const struct game *g, int piece) {
+    int rows = g->v->rows, cols = g->v->cols;
+    game_bits mine = g->bits[piece - 1], theirs = g->bits[2 - piece];
+    game_bits column = ((game_bits)1 << rows) - 1, cells = 0;
+
+    for (int c = 0; c < cols; c++) cells |= column << (c * (rows + 1));
+    column <<= (cols / 2) * (rows + 1);
+    int score = 3 * (popcount(mine & column) - popcount(theirs & column));
+    // Up, across and the two diagonals, as in the win kernels
+    score += score_direction(mine, theirs, cells, 1, g->v->connect);
+    score += score_direction(mine, theirs, cells, rows + 1, g->v->connect);
+    score += score_direction(mine, theirs, cells, rows, g->v->connect);
+    score += score_direction(mine, theirs, cells, rows + 2, g->v->connect);
+    return score;
+}
+
+static int negamax(struct game *g, const int *order, int piece, int depth, int ply,
+                   int alpha, int beta, struct engine_ctx *ctx) {
+    ctx->nodes++;
+    if (depth == 0) return evaluate(g, piece);
+
+    int any = 0;
+    for (int i = 0; i < g->v->cols; i++) {
+        int col = order[i];
+        if (game_play(g, col, piece) < 0) continue;
+        any = 1;
+        int score;
+        if (game_won(g, piece)) {
+            score = ENGINE_WIN_SCORE - ply;   // sooner wins score higher
+        } else {
+            score = -negamax(g, order, 3 - piece, depth - 1, ply + 1, -beta, -alpha, ctx);
+        }
+        game_undo(g, col);
+        if (score > alpha) alpha = score;
+        if (alpha >= beta) break;
+    }
+    return any ? alpha : 0;   // full board: draw
+}
+
+/*
+ * Iterative deepening negamax with alpha-beta. Each pass searches one
+ * ply deeper from the root; a pass that proves a win or loss ends it.
+ */
+static int search_choose(const struct game *g, int piece, struct engine_ctx *ctx) {
+    struct game b = *g;
+    int order[GAME_MAX_COLS];
+    int best = -1;
+    move_order(b.v->cols, order);
+    ctx->reached = 0;
+
+    for (int depth = 1; depth <= ctx->depth; depth++) {
+        int alpha = -ENGINE_WIN_SCORE - 1, pass_best = -1;
+        for (int i = 0; i < b.v->cols; i++) {
+            int col = order[i];
+            if (game_play(&b, col, piece) < 0) continue;
+            int score;
+            if (game_won(&b, piece)) {
+                score = ENGINE_WIN_SCORE;
+            } else {
+                score = -negamax(&b, order, 3 - piece, depth - 1, 1, -ENGINE_WIN_SCORE - 1, -alpha, ctx);
+            }
+            game_undo(&b, col);
+            if (score > alpha || pass_best < 0) {
+                alpha = score;
+                pass_best = col;
+            }
+        }
+        if (pass_best < 0) return -1;
+        best = pass_best;
+        ctx->reached = depth;
+        if (alpha >= ENGINE_WIN_SCORE - ENGINE_MAX_DEPTH || alpha <= -ENGINE_WIN_SCORE + ENGINE_MAX_DEPTH) break;
+    }
+    return best + 1;
+}
+
+static const struct engine engines[] = {
+    { "random", random_choose },
+    { "search", search_choose },
+};
+
+const struct engine *engine_find(const char *name) {
+    for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+        if (strcmp(engines[i].name, name) == 0) return &engines[i];
+    }
+    return NULL;
+}
+
+void engine_ctx_init(struct engine_ctx *ctx, int depth, unsigned seed) {
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->depth = depth < 1 ? 1 : depth > ENGINE_MAX_DEPTH ? ENGINE_MAX_DEPTH : depth;
+    ctx->seed = seed;
+}
@@ -0,0 +1,32 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include "game.h"
+
+#define ENGINE_DEFAULT_DEPTH 6
+#define ENGINE_MAX_DEPTH (GAME_MAX_ROWS * GAME_MAX_COLS)
+#define ENGINE_WIN_SCORE 1000000
+
+/*
+ * Move pickers for bots. An engine looks at the board, of any variant,
+ * from the side of `piece` and returns the column to play, numbered from 1 as on the wire,
+ * or -1 when the board is full. Everything an engine keeps between calls
+ * lives in the caller's engine_ctx, so one engine can serve many bots or
+ * threads at once.
+ */
+struct engine_ctx {
+    int depth;             // search limit in plies
+    unsigned seed;         // for rand_r()
+    long long nodes;       // positions visited, accumulated across calls
+    int reached;           // depth the last call completed
+};
+
+struct engine {
+    const char *name;
+    int (*choose)(const struct game *g, int piece, struct engine_ctx *ctx);
+};
+
+const struct engine *engine_find(const char *name);
+void engine_ctx_init(struct engine_ctx *ctx, int depth, unsigned seed);
+
+#endif
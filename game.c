@@ -0,0 +1,91 @@
+#include <string.h>
+#include "game.h"
+
+/*
+ * Win kernel for one geometry. Every constant is known at compile time, so
+ * the four directions (up, across and the two diagonals, as bit strides)
+ * and the connect - 1 shifts per direction unroll into straight-line code.
+ */
+#define GAME_KERNEL(fn, ROWS, COLS, CONNECT, word)                          \
+    _Static_assert((COLS) * ((ROWS) + 1) <= 8 * (int)sizeof(word), #fn);    \
+    static int fn(const struct game *g, int piece) {                        \
+        static const int stride[4] = { 1, (ROWS) + 1, (ROWS), (ROWS) + 2 }; \
+        word b = (word)g->bits[piece - 1];                                  \
+        for (int d = 0; d < 4; d++) {                                       \
+            word m = b;                                                     \
+            for (int k = 1; k < (CONNECT); k++) m &= b >> (k * stride[d]);  \
+            if (m) return 1;                                                \
+        }                                                                   \
+        return 0;                                                           \
+    }
+
+GAME_KERNEL(won_7x6, 6, 7, 4, unsigned long long)
+GAME_KERNEL(won_8x7, 7, 8, 4, unsigned long long)
+GAME_KERNEL(won_9x7, 7, 9, 4, game_bits)
+GAME_KERNEL(won_9x7c5, 7, 9, 5, game_bits)
+
+const struct game_variant game_variants[GAME_NVARIANTS] = {
+    { "7x6", 6, 7, 4, won_7x6 },
+    { "8x7", 7, 8, 4, won_8x7 },
+    { "9x7", 7, 9, 4, won_9x7 },
+    { "9x7c5", 7, 9, 5, won_9x7c5 },
+};
+
+const struct game_variant *game_variant_find(const char *name) {
+    for (int i = 0; i < GAME_NVARIANTS; i++) {
+        if (strcmp(game_variants[i].name, name) == 0) return &game_variants[i];
+    }
+    return NULL;
+}
+
+void game_init(struct game *g, const struct game_variant *v) {
+    memset(g, 0, sizeof(*g));
+    g->v = v;
+}
+
+// Returns the row the piece landed in, or -1 for a full or bad column
+int game_play(struct game *g, int column, int piece) {
+    if (column < 0 || column >= g->v->cols || g->height[column] >= g->v->rows) return -1;
+    int row = g->height[column]++;
+    g->bits[piece - 1] |= (game_bits)1 << (column * (g->v->rows + 1) + row);
+    g->moves++;
+    return row;
+}
+
+// Takes back the top piece of a column
+void game_undo(struct game *g, int column) {
+    int row = --g->height[column];
+    game_bits bit = (game_bits)1 << (column * (g->v->rows + 1) + row);
+    g->bits[0] &= ~bit;
+    g->bits[1] &= ~bit;
+    g->moves--;
+}
+
+int game_cell(const struct game *g, int row, int column) {
+    game_bits bit = (game_bits)1 << (column * (g->v->rows + 1) + row);
+    if (g->bits[0] & bit) return 1;
+    if (g->bits[1] & bit) return 2;
+    return 0;
+}
+
+// Writes the cells as digits, bottom row first as on the wire; returns the count
+int game_serialize(const struct game *g, char *out) {
+    unsigned long long col[2][GAME_MAX_COLS];
+    int rows = g->v->rows, cols = g->v->cols, n = 0;
+
+    // One wide shift per column, then plain 64-bit bit tests per cell
+    for (int j = 0; j < cols; j++) {
+        col[0][j] = (unsigned long long)(g->bits[0] >> (j * (rows + 1)));
+        col[1][j] = (unsigned long long)(g->bits[1] >> (j * (rows + 1)));
+    }
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            out[n++] = '0' + ((col[0][j] >> i) & 1) + 2 * ((col[1][j] >> i) & 1);
+        }
+    }
+    return n;
+}
+
+int game_full(const struct game *g) {
+    return g->moves == g->v->rows * g->v->cols;
+}
@@ -0,0 +1,49 @@
+#ifndef GAME_H
+#define GAME_H
+
+/*
+ * Connect Four rules, shared by the server, the bots and the engines.
+ * Geometry and win length are per room: row 0 is the bottom, and columns
+ * here are 0-based (the wire protocol numbers them from 1). Each variant
+ * has its own win kernel, generated from one macro with the dimensions as
+ * constants, working on bitboards: a column is rows + 1 bits (the spare
+ * bit stops lines wrapping into the next column), and a line of `connect`
+ * is a handful of shift-and steps. Boards up to 64 bits (7x6, 8x7) use
+ * 64-bit words; larger ones use 128.
+ */
+#define GAME_MAX_ROWS 7
+#define GAME_MAX_COLS 9
+#define GAME_NVARIANTS 4
+
+typedef unsigned __int128 game_bits;
+
+struct game;
+
+struct game_variant {
+    const char *name;      // on the wire, "7x6" is the classic board
+    int rows;
+    int cols;
+    int connect;
+    int (*won)(const struct game *g, int piece);
+};
+
+struct game {
+    const struct game_variant *v;
+    game_bits bits[2];                    // bitboard per piece
+    unsigned char height[GAME_MAX_COLS];  // pieces in each column
+    int moves;
+};
+
+extern const struct game_variant game_variants[GAME_NVARIANTS];
+#define GAME_CLASSIC (&game_variants[0])
+
+const struct game_variant *game_variant_find(const char *name);
+void game_init(struct game *g, const struct game_variant *v);
+int game_play(struct game *g, int column, int piece);
+void game_undo(struct game *g, int column);
+int game_cell(const struct game *g, int row, int column);
+int game_serialize(const struct game *g, char *out);
+int game_full(const struct game *g);
+#define game_won(g, piece) ((g)->v->won((g), (piece)))
+
+#endif
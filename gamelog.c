@@ -0,0 +1,98 @@
+#include "server.h"
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "gamelog.h"
+#include "histogram.h"
+#include "logger.h"
+
+// A game being played, by room slot; the seats are read at the start
+// because a disconnect empties one before the result
+struct live_game {
+    int recording;
+    long long start_ns;
+    char names[2][GAMELOG_NAME_LEN];
+    unsigned char moves[GAMELOG_MAX_PLIES];
+};
+
+static struct live_game *live;
+static struct gamelog_record pending[GAMELOG_BATCH];
+static int npending;
+static int log_fd = -1;
+static const char *log_path = "";
+
+void gamelog_init(void) {
+    live = pool_alloc(cfg.max_rooms, sizeof(struct live_game));
+}
+
+// Appends go to the end of whole records: a torn one left by a crash is cut off
+int gamelog_open(const char *path) {
+    struct stat st;
+
+    if (!path[0]) return 0;
+    log_path = path;
+    int fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0 || fstat(fd, &st) < 0 ||
+        ftruncate(fd, st.st_size - st.st_size % (off_t)sizeof(struct gamelog_record)) < 0) {
+        log_event(EV_GAMELOG_ERROR, -1, errno, 0, path);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    log_fd = fd;
+    return 0;
+}
+
+void gamelog_game_started(struct Room *room) {
+    if (log_fd < 0) return;
+    struct live_game *g = &live[room->id - room_id_base];
+    struct Player *p1 = find_player_by_id(room->player_1);
+    struct Player *p2 = find_player_by_id(room->player_2);
+
+    g->recording = 1;
+    g->start_ns = monotonic_ns();
+    snprintf(g->names[0], GAMELOG_NAME_LEN, "%s", p1 ? p1->name : "");
+    snprintf(g->names[1], GAMELOG_NAME_LEN, "%s", p2 ? p2->name : "");
+}
+
+// After game_play(): the ply is the game's own move count
+void gamelog_move(struct Room *room, int column) {
+    if (log_fd < 0) return;
+    live[room->id - room_id_base].moves[room->game.moves - 1] = (unsigned char)column;
+}
+
+void gamelog_game_over(struct Room *room, long long winner, int reason) {
+    struct live_game *g = &live[room->id - room_id_base];
+
+    // Games carried over a hot upgrade have no start and are not recorded
+    if (log_fd < 0 || !g->recording) return;
+    g->recording = 0;
+    if (npending == GAMELOG_BATCH) gamelog_flush();
+
+    struct gamelog_record *r = &pending[npending++];
+    memset(r, 0, sizeof(*r));
+    r->magic = GAMELOG_MAGIC;
+    r->variant = (unsigned char)(room->game.v - game_variants);
+    r->result = winner == GAME_NO_RESULT ? GAMELOG_NONE
+              : winner == GAME_DRAW ? GAMELOG_DRAWN
+              : winner == room->player_1 ? GAMELOG_P1 : GAMELOG_P2;
+    r->reason = (unsigned char)reason;
+    r->plies = (unsigned char)room->game.moves;
+    r->ended = time(NULL);
+    r->duration_ms = (unsigned)((monotonic_ns() - g->start_ns) / 1000000);
+    r->node = (unsigned)cfg.node_id;
+    memcpy(r->names, g->names, sizeof(r->names));
+    memcpy(r->moves, g->moves, room->game.moves);
+}
+
+// Once a second, when the batch fills, and before a hot upgrade
+void gamelog_flush(void) {
+    if (log_fd < 0 || npending == 0) return;
+    ssize_t want = (ssize_t)(sizeof(struct gamelog_record) * npending);
+    if (write(log_fd, pending, want) != want) {
+        log_event(EV_GAMELOG_ERROR, -1, errno, npending, log_path);
+        close(log_fd);
+        log_fd = -1;
+    }
+    npending = 0;
+}
@@ -0,0 +1,54 @@
+#ifndef GAMELOG_H
+#define GAMELOG_H
+
+#include "game.h"
+
+#define GAMELOG_MAGIC 0x31473443u   // "C4G1" on disk
+#define GAMELOG_NAME_LEN 32         // MAX_NAME_LEN on the server
+#define GAMELOG_MAX_PLIES 64        // covers GAME_MAX_ROWS * GAME_MAX_COLS
+#define GAMELOG_BATCH 256           // records buffered between writes
+
+// How a game ended, as passed to end_game()
+#define GAME_END_WIN 0
+#define GAME_END_DRAW 1             // board full
+#define GAME_END_TIMEOUT 2          // the player to move ran out of time
+#define GAME_END_QUIT 3
+#define GAME_END_DISCONNECT 4
+#define GAME_END_ABANDONED 5        // room torn down with no result
+#define GAME_END_REASONS 6
+
+// Record result: which seat won
+#define GAMELOG_DRAWN 0
+#define GAMELOG_P1 1
+#define GAMELOG_P2 2
+#define GAMELOG_NONE 3
+
+/*
+ * Finished games, one fixed-size record each, appended to gamelog.file.
+ * Fixed size is what lets the analytics tool split a memory-mapped corpus
+ * into ranges without parsing, and drop a torn tail by rounding the file
+ * size down. Seat 0 moved first; moves are 0-based columns.
+ */
+struct gamelog_record {
+    unsigned magic;
+    unsigned char variant;          // index into game_variants
+    unsigned char result;           // GAMELOG_*
+    unsigned char reason;           // GAME_END_*
+    unsigned char plies;
+    long long ended;                // unix seconds
+    unsigned duration_ms;
+    unsigned node;                  // cluster node that hosted it
+    char names[2][GAMELOG_NAME_LEN];
+    unsigned char moves[GAMELOG_MAX_PLIES];
+};
+
+struct Room;
+
+void gamelog_init(void);
+int gamelog_open(const char *path);
+void gamelog_game_started(struct Room *room);
+void gamelog_move(struct Room *room, int column);
+void gamelog_game_over(struct Room *room, long long winner, int reason);
+void gamelog_flush(void);
+
+#endif
@@ -0,0 +1,81 @@
+#include <string.h>
+#include <time.h>
+#include "histogram.h"
+
+static int hist_index(unsigned long long value) {
+    if (value < HIST_SUB_COUNT) return (int)value;
+    int exp = 63 - __builtin_clzll(value);
+    int shift = exp - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB_COUNT + (int)((value >> shift) - HIST_SUB_COUNT);
+}
+
+// Largest value that lands in bucket `index`
+unsigned long long hist_bucket_limit(int index) {
+    if (index < HIST_SUB_COUNT) return (unsigned long long)index;
+    int shift = index / HIST_SUB_COUNT - 1;
+    unsigned long long sub = (unsigned long long)(index % HIST_SUB_COUNT);
+    return ((HIST_SUB_COUNT + sub + 1) << shift) - 1;
+}
+
+void hist_init(struct histogram *h) {
+    memset(h, 0, sizeof(*h));
+    h->min = ~0ULL;
+}
+
+void hist_record(struct histogram *h, unsigned long long value) {
+    h->counts[hist_index(value)]++;
+    h->total++;
+    h->sum += value;
+    if (value < h->min) h->min = value;
+    if (value > h->max) h->max = value;
+}
+
+void hist_merge(struct histogram *dst, const struct histogram *src) {
+    for (int i = 0; i < HIST_BUCKETS; i++) dst->counts[i] += src->counts[i];
+    dst->total += src->total;
+    dst->sum += src->sum;
+    if (src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+}
+
+unsigned long long hist_percentile(const struct histogram *h, double pct) {
+    if (h->total == 0) return 0;
+    unsigned long long rank = (unsigned long long)(pct / 100.0 * (double)h->total + 0.5);
+    if (rank < 1) rank = 1;
+    unsigned long long seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            unsigned long long limit = hist_bucket_limit(i);
+            return limit > h->max ? h->max : limit;
+        }
+    }
+    return h->max;
+}
+
+double hist_mean(const struct histogram *h) {
+    return h->total ? (double)h->sum / (double)h->total : 0.0;
+}
+
+// One summary line; values are divided by `scale` before printing in `unit`
+void hist_print(const struct histogram *h, FILE *out, const char *label, double scale, const char *unit) {
+    if (h->total == 0) {
+        fprintf(out, "%-16s n=0\n", label);
+        return;
+    }
+    fprintf(out, "%-16s n=%llu min=%.1f%s mean=%.1f%s p50=%.1f%s p90=%.1f%s p99=%.1f%s p99.9=%.1f%s max=%.1f%s\n",
+            label, h->total,
+            h->min / scale, unit,
+            hist_mean(h) / scale, unit,
+            hist_percentile(h, 50.0) / scale, unit,
+            hist_percentile(h, 90.0) / scale, unit,
+            hist_percentile(h, 99.0) / scale, unit,
+            hist_percentile(h, 99.9) / scale, unit,
+            h->max / scale, unit);
+}
+
+long long monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
@@ -0,0 +1,33 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdio.h>
+
+/*
+ * Log-linear (HDR-style) histogram: every power of two is split into
+ * HIST_SUB_COUNT linear buckets, so recording is a clz and an increment and
+ * any percentile is accurate to within 1/HIST_SUB_COUNT of the value.
+ */
+#define HIST_SUB_BITS 4
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+struct histogram {
+    unsigned long long counts[HIST_BUCKETS];
+    unsigned long long total;
+    unsigned long long min;
+    unsigned long long max;
+    unsigned long long sum;
+};
+
+void hist_init(struct histogram *h);
+void hist_record(struct histogram *h, unsigned long long value);
+void hist_merge(struct histogram *dst, const struct histogram *src);
+unsigned long long hist_percentile(const struct histogram *h, double pct);
+double hist_mean(const struct histogram *h);
+unsigned long long hist_bucket_limit(int index);
+void hist_print(const struct histogram *h, FILE *out, const char *label, double scale, const char *unit);
+
+long long monotonic_ns(void);
+
+#endif
@@ -0,0 +1,54 @@
+#include "unp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bot.h"
+
+/*
+ * Load generator: a crowd of headless bots (bot.c) against one server,
+ * with one progress line per second and latency percentiles at the end.
+ */
+const char *host = "127.0.0.1";
+int port = 12345;
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [-h host] [-p port] [-c connections] [-d seconds]\n"
+            "          [-s spectator%%] [-r chats/min/bot] [-t think_ms] [-R connects/sec]\n"
+            "          [-e random|search] [-D depth]\n",
+            prog);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    int c;
+    bot_defaults();
+    while ((c = getopt(argc, argv, "h:p:c:d:s:r:t:R:e:D:")) != -1) {
+        switch (c) {
+            case 'h': host = optarg; break;
+            case 'p': port = atoi(optarg); break;
+            case 'c': bot_opts.nbots = atoi(optarg); break;
+            case 'd': bot_opts.duration = atoi(optarg); break;
+            case 's': bot_opts.spectator_pct = atoi(optarg); break;
+            case 'r': bot_opts.chat_per_min = atof(optarg); break;
+            case 't': bot_opts.think_ms = atoi(optarg); break;
+            case 'R': bot_opts.ramp_per_sec = atoi(optarg); break;
+            case 'e': bot_opts.engine = engine_find(optarg); break;
+            case 'D': bot_opts.depth = atoi(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (bot_opts.nbots <= 0 || bot_opts.ramp_per_sec <= 0 || !bot_opts.engine) usage(argv[0]);
+
+    struct sockaddr_in servaddr;
+    bzero(&servaddr, sizeof(servaddr));
+    servaddr.sin_family = AF_INET;
+    servaddr.sin_port = htons(port);
+    Inet_pton(AF_INET, host, &servaddr.sin_addr);
+
+    printf("loadgen: %d bots (%d%% spectators) against %s:%d for %ds\n",
+           bot_opts.nbots, bot_opts.spectator_pct, host, port, bot_opts.duration);
+    bot_run(&servaddr, "loadgen");
+    return 0;
+}
@@ -0,0 +1,228 @@
+#include "server.h"
+#include <string.h>
+#include "lobby.h"
+
+static int wait_head = -1;
+static int wait_tail = -1;
+
+static int *live_heap;   // room slots
+static int live_count = 0;
+static int *frontier;    // lobby_send_page() scratch, positions in live_heap
+
+void lobby_init(void) {
+    live_heap = pool_alloc(cfg.max_rooms, sizeof(int));
+    frontier = pool_alloc(cfg.max_rooms, sizeof(int));
+    live_count = 0;
+}
+
+static int slot_of(struct Room* room) {
+    return room->id - room_id_base;
+}
+
+void lobby_init_room(struct Room* room) {
+    room->wait_prev = -1;
+    room->wait_next = -1;
+    room->in_waiting = 0;
+    room->heap_pos = -1;
+}
+
+// ---- waiting public rooms ----
+
+void lobby_add_waiting(struct Room* room) {
+    if (room->in_waiting) return;
+    int slot = slot_of(room);
+    room->wait_prev = wait_tail;
+    room->wait_next = -1;
+    if (wait_tail != -1) {
+        rooms[wait_tail].wait_next = slot;
+    } else {
+        wait_head = slot;
+    }
+    wait_tail = slot;
+    room->in_waiting = 1;
+}
+
+void lobby_remove_waiting(struct Room* room) {
+    if (!room->in_waiting) return;
+    if (room->wait_prev != -1) {
+        rooms[room->wait_prev].wait_next = room->wait_next;
+    } else {
+        wait_head = room->wait_next;
+    }
+    if (room->wait_next != -1) {
+        rooms[room->wait_next].wait_prev = room->wait_prev;
+    } else {
+        wait_tail = room->wait_prev;
+    }
+    room->wait_prev = -1;
+    room->wait_next = -1;
+    room->in_waiting = 0;
+}
+
+struct Room* lobby_first_waiting(void) {
+    return wait_head == -1 ? NULL : &rooms[wait_head];
+}
+
+// ---- live games by audience ----
+
+static int heap_before(int a, int b) {
+    if (rooms[a].audience_count != rooms[b].audience_count) {
+        return rooms[a].audience_count > rooms[b].audience_count;
+    }
+    return a < b;
+}
+
+static void heap_place(int pos, int slot) {
+    live_heap[pos] = slot;
+    rooms[slot].heap_pos = pos;
+}
+
+static void sift_up(int pos) {
+    int slot = live_heap[pos];
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+        if (!heap_before(slot, live_heap[parent])) break;
+        heap_place(pos, live_heap[parent]);
+        pos = parent;
+    }
+    heap_place(pos, slot);
+}
+
+static void sift_down(int pos) {
+    int slot = live_heap[pos];
+    while (1) {
+        int child = 2 * pos + 1;
+        if (child >= live_count) break;
+        if (child + 1 < live_count && heap_before(live_heap[child + 1], live_heap[child])) child++;
+        if (!heap_before(live_heap[child], slot)) break;
+        heap_place(pos, live_heap[child]);
+        pos = child;
+    }
+    heap_place(pos, slot);
+}
+
+void lobby_game_started(struct Room* room) {
+    if (room->heap_pos != -1) return;
+    heap_place(live_count, slot_of(room));
+    sift_up(live_count++);
+}
+
+void lobby_game_ended(struct Room* room) {
+    int pos = room->heap_pos;
+    if (pos == -1) return;
+    room->heap_pos = -1;
+    live_count--;
+    if (pos == live_count) return;
+    heap_place(pos, live_heap[live_count]);
+    sift_up(pos);
+    sift_down(rooms[live_heap[pos]].heap_pos);
+}
+
+void lobby_audience_changed(struct Room* room) {
+    if (room->heap_pos == -1) return;
+    sift_up(room->heap_pos);
+    sift_down(room->heap_pos);
+}
+
+void lobby_room_closed(struct Room* room) {
+    lobby_remove_waiting(room);
+    lobby_game_ended(room);
+}
+
+// Only needed after a hot upgrade, when the indexes are not in the snapshot
+void lobby_rebuild(void) {
+    wait_head = wait_tail = -1;
+    live_count = 0;
+    for (int i = 0; i < cfg.max_rooms; i++) lobby_init_room(&rooms[i]);
+    for (int i = 0; i < cfg.max_rooms; i++) {
+        if (!room_status[i]) continue;
+        if (rooms[i].is_public && rooms[i].player_2 == -1) lobby_add_waiting(&rooms[i]);
+        if (room_active[i]) lobby_game_started(&rooms[i]);
+    }
+}
+
+// ---- listing ----
+
+static void append_line(char *buf, int *len, int size, const char *line, int n) {
+    if (*len + n >= size) return;
+    memcpy(buf + *len, line, n);
+    *len += n;
+}
+
+static int frontier_before(int a, int b) {
+    return heap_before(live_heap[a], live_heap[b]);
+}
+
+static void frontier_push(int *f, int *count, int pos) {
+    int i = (*count)++;
+    while (i > 0 && frontier_before(pos, f[(i - 1) / 2])) {
+        f[i] = f[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    f[i] = pos;
+}
+
+static int frontier_pop(int *f, int *count) {
+    int top = f[0];
+    int last = f[--(*count)];
+    int i = 0;
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= *count) break;
+        if (child + 1 < *count && frontier_before(f[child + 1], f[child])) child++;
+        if (!frontier_before(f[child], last)) break;
+        f[i] = f[child];
+        i = child;
+    }
+    if (*count > 0) f[i] = last;
+    return top;
+}
+
+/*
+ * Page `page` of both indexes, answered in one write:
+ *   Lo<room>;<host>                      open public room
+ *   Lg<room>;<player1>;<player2>;<count> live game, most watched first
+ *   Le<page>;<more>                      end of page
+ * Open rooms cost O(page * size) list steps; live games are pulled off
+ * the heap best-first with a small frontier heap, O(k log k) for
+ * k = (page + 1) * size.
+ */
+void lobby_send_page(int fd, int page) {
+    char buf[LOBBY_PAGE_SIZE * 2 * 96 + 32];
+    char line[128];
+    int len = 0, n;
+    int skip = page * LOBBY_PAGE_SIZE;
+    int more = 0;
+
+    int slot = wait_head;
+    for (int i = 0; i < skip && slot != -1; i++) slot = rooms[slot].wait_next;
+    for (int i = 0; i < LOBBY_PAGE_SIZE && slot != -1; i++) {
+        struct Player* host = find_player_by_id(rooms[slot].player_1);
+        n = snprintf(line, sizeof(line), "Lo%d;%s\n", rooms[slot].id, host ? host->name : "?");
+        append_line(buf, &len, sizeof(buf), line, n);
+        slot = rooms[slot].wait_next;
+    }
+    if (slot != -1) more = 1;
+
+    int frontier_count = 0;   // frontier is itself a heap
+    if (live_count > 0) frontier_push(frontier, &frontier_count, 0);
+
+    for (int rank = 0; frontier_count > 0 && rank < skip + LOBBY_PAGE_SIZE; rank++) {
+        int pos = frontier_pop(frontier, &frontier_count);
+        if (2 * pos + 1 < live_count) frontier_push(frontier, &frontier_count, 2 * pos + 1);
+        if (2 * pos + 2 < live_count) frontier_push(frontier, &frontier_count, 2 * pos + 2);
+
+        if (rank < skip) continue;
+        struct Room* room = &rooms[live_heap[pos]];
+        struct Player* p1 = find_player_by_id(room->player_1);
+        struct Player* p2 = find_player_by_id(room->player_2);
+        n = snprintf(line, sizeof(line), "Lg%d;%s;%s;%d\n", room->id,
+                     p1 ? p1->name : "?", p2 ? p2->name : "?", room->audience_count);
+        append_line(buf, &len, sizeof(buf), line, n);
+    }
+    if (frontier_count > 0) more = 1;
+
+    n = snprintf(line, sizeof(line), "Le%d;%d\n", page, more);
+    append_line(buf, &len, sizeof(buf), line, n);
+    client_write(fd, buf, len);
+}
@@ -0,0 +1,26 @@
+#ifndef LOBBY_H
+#define LOBBY_H
+
+#define LOBBY_PAGE_SIZE 10
+
+struct Room;
+
+/*
+ * Lobby indexes, kept current as rooms change so a listing never walks
+ * the room table:
+ *   - an intrusive FIFO list of public rooms waiting for a second player
+ *   - a max-heap of live games ordered by audience size
+ */
+void lobby_init(void);
+void lobby_init_room(struct Room* room);
+void lobby_add_waiting(struct Room* room);
+void lobby_remove_waiting(struct Room* room);
+void lobby_game_started(struct Room* room);
+void lobby_game_ended(struct Room* room);
+void lobby_audience_changed(struct Room* room);
+void lobby_room_closed(struct Room* room);
+void lobby_rebuild(void);
+struct Room* lobby_first_waiting(void);
+void lobby_send_page(int fd, int page);
+
+#endif
@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "logger.h"
+
+/*
+ * Single-producer/single-consumer ring between the event loop and the
+ * flusher thread. The producer never blocks: a full ring drops the record
+ * and bumps a counter. Each event type also has a per-second budget so a
+ * client spamming bad frames costs a counter increment, not a write.
+ */
+#define LOG_RING_SIZE 4096
+#define LOG_FLUSH_INTERVAL_NS 5000000L
+
+struct log_event_def {
+    int level;
+    const char *name;
+    const char *a_name;
+    const char *b_name;
+    const char *text_name;
+    int max_per_sec;
+};
+
+static const struct log_event_def event_defs[EV_COUNT] = {
+    [EV_CLIENT_ACCEPTED]  = { LOG_LVL_INFO,  "client_accepted",  NULL,      NULL,      NULL,   0 },
+    [EV_CLIENT_REJECTED]  = { LOG_LVL_WARN,  "client_rejected",  "retry_s", "full",    NULL,   10 },
+    [EV_PLAYER_CONNECTED] = { LOG_LVL_INFO,  "player_connected", "id",      NULL,      "name", 0 },
+    [EV_ROOM_JOINED]      = { LOG_LVL_INFO,  "room_joined",      "player",  "room",    NULL,   0 },
+    [EV_GAME_TIMEOUT]     = { LOG_LVL_INFO,  "game_timeout",     "room",    "player",  NULL,   0 },
+    [EV_INVALID_COLUMN]   = { LOG_LVL_WARN,  "invalid_move",     "player",  "column",  NULL,   10 },
+    [EV_GAME_INACTIVE]    = { LOG_LVL_WARN,  "game_inactive",    "player",  "room",    NULL,   10 },
+    [EV_NOT_TURN]         = { LOG_LVL_WARN,  "not_players_turn", "player",  "room",    NULL,   10 },
+    [EV_UNKNOWN_MESSAGE]  = { LOG_LVL_WARN,  "unknown_message",  NULL,      NULL,      "msg",  10 },
+    [EV_MESSAGE_TOO_LONG] = { LOG_LVL_WARN,  "message_too_long", "bytes",   NULL,      NULL,   10 },
+    [EV_UPGRADE_DONE]     = { LOG_LVL_INFO,  "upgrade_handover", "pid",     NULL,      NULL,   0 },
+    [EV_UPGRADE_FAILED]   = { LOG_LVL_ERROR, "upgrade_failed",   "pid",     NULL,      NULL,   0 },
+    [EV_IO_BACKEND]       = { LOG_LVL_INFO,  "io_backend",       NULL,      NULL,      "name", 0 },
+    [EV_CONFIG_RELOADED]  = { LOG_LVL_INFO,  "config_reloaded",  NULL,      NULL,      "file", 0 },
+    [EV_CONFIG_RESTART]   = { LOG_LVL_WARN,  "config_needs_restart", "current", "wanted", "key", 0 },
+    [EV_CONFIG_ERROR]     = { LOG_LVL_ERROR, "config_error",     NULL,      NULL,      "file", 0 },
+    [EV_CLUSTER_LINK]     = { LOG_LVL_INFO,  "cluster_link",     "node",    "up",      NULL,   0 },
+    [EV_CLUSTER_HANDOFF]  = { LOG_LVL_DEBUG, "session_handoff",  "player",  "node",    NULL,   0 },
+    [EV_RELAY_UPSTREAM]   = { LOG_LVL_INFO,  "relay_upstream",   "room",    "up",      NULL,   0 },
+    [EV_TOURNEY_ROUND]    = { LOG_LVL_INFO,  "tourney_round",    "event",   "round",   "format", 0 },
+    [EV_TOURNEY_DONE]     = { LOG_LVL_INFO,  "tourney_done",     "event",   "entrants", "winner", 0 },
+    [EV_RATINGS_LOADED]   = { LOG_LVL_INFO,  "ratings_loaded",   "identities", "records", "file", 0 },
+    [EV_RATINGS_ERROR]    = { LOG_LVL_ERROR, "ratings_error",    "errno",   NULL,      "file", 0 },
+    [EV_GAMELOG_ERROR]    = { LOG_LVL_ERROR, "gamelog_error",    "errno",   "records", "file", 0 },
+    [EV_CAPTURE_ERROR]    = { LOG_LVL_ERROR, "capture_error",    "errno",   "events",  "file", 0 },
+    [EV_SUPPRESSED]       = { LOG_LVL_WARN,  "log_suppressed",   NULL,      "count",   "event", 0 },
+};
+
+static const char *level_names[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+
+int log_min_level = LOG_LVL_INFO;
+
+static struct log_record ring[LOG_RING_SIZE];
+static atomic_ulong ring_head;   // next slot the producer writes
+static atomic_ulong ring_tail;   // next slot the consumer reads
+static atomic_ulong dropped;
+
+// Rate limiter state, producer side only
+static long long window_start[EV_COUNT];
+static int window_count[EV_COUNT];
+static long long window_suppressed[EV_COUNT];
+
+static FILE *log_out;
+static pthread_t flusher;
+static atomic_int running;
+
+static long long realtime_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void ring_push(int event, int fd, long long a, long long b, const char *text, long long now) {
+    unsigned long head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+    unsigned long tail = atomic_load_explicit(&ring_tail, memory_order_acquire);
+    if (head - tail >= LOG_RING_SIZE) {
+        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+        return;
+    }
+    struct log_record *r = &ring[head & (LOG_RING_SIZE - 1)];
+    r->ts_ns = now;
+    r->event = event;
+    r->fd = fd;
+    r->a = a;
+    r->b = b;
+    if (text) {
+        strncpy(r->text, text, LOG_TEXT_LEN - 1);
+        r->text[LOG_TEXT_LEN - 1] = '\0';
+    } else {
+        r->text[0] = '\0';
+    }
+    atomic_store_explicit(&ring_head, head + 1, memory_order_release);
+}
+
+void log_event(int event, int fd, long long a, long long b, const char *text) {
+    const struct log_event_def *def = &event_defs[event];
+    if (def->level < log_min_level) return;
+
+    long long now = realtime_ns();
+    if (def->max_per_sec > 0) {
+        if (now - window_start[event] >= 1000000000LL) {
+            if (window_suppressed[event] > 0) {
+                ring_push(EV_SUPPRESSED, -1, 0, window_suppressed[event], def->name, now);
+            }
+            window_start[event] = now;
+            window_count[event] = 0;
+            window_suppressed[event] = 0;
+        }
+        if (window_count[event] >= def->max_per_sec) {
+            window_suppressed[event]++;
+            return;
+        }
+        window_count[event]++;
+    }
+    ring_push(event, fd, a, b, text, now);
+}
+
+unsigned long long log_dropped(void) {
+    return atomic_load(&dropped);
+}
+
+static int format_record(const struct log_record *r, char *buf, size_t size) {
+    const struct log_event_def *def = &event_defs[r->event];
+    time_t secs = (time_t)(r->ts_ns / 1000000000LL);
+    struct tm tm;
+    gmtime_r(&secs, &tm);
+
+    int len = snprintf(buf, size, "%04d-%02d-%02dT%02d:%02d:%02d.%06lldZ %-5s %s",
+                       tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+                       tm.tm_hour, tm.tm_min, tm.tm_sec,
+                       (r->ts_ns % 1000000000LL) / 1000,
+                       level_names[def->level], def->name);
+    if (r->fd >= 0 && len < (int)size) len += snprintf(buf + len, size - len, " fd=%d", r->fd);
+    if (def->a_name && len < (int)size) len += snprintf(buf + len, size - len, " %s=%lld", def->a_name, r->a);
+    if (def->b_name && len < (int)size) len += snprintf(buf + len, size - len, " %s=%lld", def->b_name, r->b);
+    if (def->text_name && len < (int)size) len += snprintf(buf + len, size - len, " %s=\"%s\"", def->text_name, r->text);
+    if (len < (int)size) len += snprintf(buf + len, size - len, "\n");
+    return len < (int)size ? len : (int)size - 1;
+}
+
+static int drain(void) {
+    char line[256];
+    unsigned long tail = atomic_load_explicit(&ring_tail, memory_order_relaxed);
+    unsigned long head = atomic_load_explicit(&ring_head, memory_order_acquire);
+    int n = 0;
+
+    while (tail != head) {
+        struct log_record r = ring[tail & (LOG_RING_SIZE - 1)];
+        atomic_store_explicit(&ring_tail, ++tail, memory_order_release);
+        fwrite(line, 1, format_record(&r, line, sizeof(line)), log_out);
+        n++;
+    }
+    if (n) fflush(log_out);
+    return n;
+}
+
+static void *flusher_main(void *arg) {
+    struct timespec pause = { 0, LOG_FLUSH_INTERVAL_NS };
+    unsigned long long reported_drops = 0;
+    (void)arg;
+
+    while (atomic_load(&running)) {
+        if (drain() == 0) nanosleep(&pause, NULL);
+        unsigned long long drops = log_dropped();
+        if (drops != reported_drops) {
+            fprintf(log_out, "logger: %llu records dropped (ring full)\n", drops - reported_drops);
+            reported_drops = drops;
+        }
+    }
+    drain();
+    return NULL;
+}
+
+void log_start(FILE *out) {
+    log_out = out;
+    atomic_store(&running, 1);
+    if (pthread_create(&flusher, NULL, flusher_main, NULL) != 0) {
+        perror("log_start: pthread_create");
+        exit(1);
+    }
+}
+
+// Drains everything queued so far; safe to call before exec or exit
+void log_stop(void) {
+    if (!atomic_load(&running)) return;
+    atomic_store(&running, 0);
+    pthread_join(flusher, NULL);
+}
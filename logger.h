@@ -0,0 +1,64 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdio.h>
+
+#define LOG_LVL_DEBUG 0
+#define LOG_LVL_INFO 1
+#define LOG_LVL_WARN 2
+#define LOG_LVL_ERROR 3
+
+// Must match the table in logger.c
+enum log_event {
+    EV_CLIENT_ACCEPTED,
+    EV_CLIENT_REJECTED,
+    EV_PLAYER_CONNECTED,
+    EV_ROOM_JOINED,
+    EV_GAME_TIMEOUT,
+    EV_INVALID_COLUMN,
+    EV_GAME_INACTIVE,
+    EV_NOT_TURN,
+    EV_UNKNOWN_MESSAGE,
+    EV_MESSAGE_TOO_LONG,
+    EV_UPGRADE_DONE,
+    EV_UPGRADE_FAILED,
+    EV_IO_BACKEND,
+    EV_CONFIG_RELOADED,
+    EV_CONFIG_RESTART,
+    EV_CONFIG_ERROR,
+    EV_CLUSTER_LINK,
+    EV_CLUSTER_HANDOFF,
+    EV_RELAY_UPSTREAM,
+    EV_TOURNEY_ROUND,
+    EV_TOURNEY_DONE,
+    EV_RATINGS_LOADED,
+    EV_RATINGS_ERROR,
+    EV_GAMELOG_ERROR,
+    EV_CAPTURE_ERROR,
+    EV_SUPPRESSED,
+    EV_COUNT
+};
+
+#define LOG_TEXT_LEN 40
+
+/*
+ * Fixed-size binary record: the event loop only fills one of these in a
+ * ring slot; formatting and I/O happen on the flusher thread.
+ */
+struct log_record {
+    long long ts_ns;
+    int event;
+    int fd;
+    long long a;
+    long long b;
+    char text[LOG_TEXT_LEN];
+};
+
+extern int log_min_level;
+
+void log_start(FILE *out);
+void log_stop(void);
+void log_event(int event, int fd, long long a, long long b, const char *text);
+unsigned long long log_dropped(void);
+
+#endif
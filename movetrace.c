@@ -0,0 +1,267 @@
+#include "server.h"
+#include <string.h>
+#include "movetrace.h"
+#include "stats.h"
+#include "histogram.h"
+
+/*
+ * Per-move spans on the monotonic clock: the read that carried the "s"
+ * frame, handle_move() starting, the board serialized, the move handled,
+ * and each recipient's output fully sent. The poll loop writes
+ * synchronously, so there a recipient is flushed as soon as its write
+ * returns. Under io_uring every write only queues; the connection's byte
+ * count at that point is the mark, and the move stays in flight until
+ * send completions carry every recipient past its mark. Finished moves
+ * feed the span histograms, and those slower end to end than
+ * trace_slow_us are copied to a ring that GET /moves prints.
+ */
+struct move_trace {
+    unsigned seq;             // 0: free
+    int room;
+    long long player;
+    int column;
+    long long read_ns;
+    long long handle_ns;
+    long long serialize_ns;
+    long long end_ns;
+    long long flush_ns;       // last recipient flushed
+    int nrecipients;
+    int pending;              // recipients still sending
+    int dropped;              // closed or untracked before their output went
+    int fds[MOVETRACE_RECIPIENTS];
+    long long flushed[MOVETRACE_RECIPIENTS];   // 0 until sent
+};
+
+struct recipient {
+    int fd;
+    int slot;                 // -1: already flushed
+    unsigned long long mark;
+    long long flush_ns;       // when slot is -1
+};
+
+struct flush_wait {
+    unsigned seq;
+    int index;
+    unsigned long long mark;
+};
+
+struct slot_waits {
+    int head;
+    int count;
+    struct flush_wait w[MOVETRACE_SLOT_WAITS];
+};
+
+int movetrace_active = 0;
+
+static struct move_trace *inflight;
+static struct move_trace *cur;
+static unsigned next_seq = 1;
+static struct recipient *rcpt;
+static int nrcpt;
+static int max_rcpt;
+static struct slot_waits *waits;
+
+static struct move_trace slow[MOVETRACE_SLOW_RING];
+static unsigned long long nslow;
+static unsigned long long ntraced;
+static struct histogram span_handle;      // read -> handle_move()
+static struct histogram span_serialize;   // handle_move() -> board serialized
+static struct histogram span_handled;     // serialized -> handle_move() returned
+static struct histogram span_flush;       // returned -> last recipient flushed
+static struct histogram span_total;
+
+void movetrace_init(void) {
+    inflight = pool_alloc(MOVETRACE_INFLIGHT, sizeof(struct move_trace));
+    max_rcpt = cfg.max_audience + 2;
+    rcpt = pool_alloc(max_rcpt, sizeof(struct recipient));
+    waits = pool_alloc(cfg.max_clients, sizeof(struct slot_waits));
+    hist_init(&span_handle);
+    hist_init(&span_serialize);
+    hist_init(&span_handled);
+    hist_init(&span_flush);
+    hist_init(&span_total);
+}
+
+static void finish(struct move_trace *t) {
+    long long done = t->flush_ns ? t->flush_ns : t->end_ns;
+    long long total = done - t->read_ns;
+
+    ntraced++;
+    hist_record(&span_handle, t->handle_ns - t->read_ns);
+    hist_record(&span_serialize, t->serialize_ns - t->handle_ns);
+    hist_record(&span_handled, t->end_ns - t->serialize_ns);
+    // Written synchronously, everything was out before handle_move() returned
+    hist_record(&span_flush, done > t->end_ns ? done - t->end_ns : 0);
+    hist_record(&span_total, total);
+    MOVE_PROBE3(move_done, t->room, total, t->nrecipients);
+    if (total >= (long long)cfg.trace_slow_us * 1000) {
+        slow[nslow % MOVETRACE_SLOW_RING] = *t;
+        nslow++;
+    }
+    t->seq = 0;
+}
+
+static void flushed(struct move_trace *t, int index, long long now) {
+    if (index < MOVETRACE_RECIPIENTS) t->flushed[index] = now;
+    if (now > t->flush_ns) t->flush_ns = now;
+    MOVE_PROBE3(move_flushed, t->room, index < MOVETRACE_RECIPIENTS ? t->fds[index] : -1, now - t->read_ns);
+}
+
+// A recipient that will never be timed: its connection closed or its waits overflowed
+static void lost(const struct flush_wait *w) {
+    struct move_trace *t = &inflight[w->seq % MOVETRACE_INFLIGHT];
+    if (t->seq != w->seq) return;
+    t->dropped++;
+    if (--t->pending == 0) finish(t);
+}
+
+// The "s" frame's read time; handle_move() follows
+void movetrace_begin(struct Room *room, long long player_id, int column, long long read_ns) {
+    if (!inflight) return;
+    struct move_trace *t = &inflight[next_seq % MOVETRACE_INFLIGHT];
+    // Still sending a thousand moves later: report it with what it has
+    if (t->seq) {
+        t->dropped += t->pending;
+        finish(t);
+    }
+    memset(t, 0, sizeof(*t));
+    t->seq = next_seq++;
+    if (next_seq == 0) next_seq = 1;
+    t->room = room ? room->id : -1;
+    t->player = player_id;
+    t->column = column;
+    t->read_ns = read_ns;
+    cur = t;
+    nrcpt = 0;
+    movetrace_active = 1;
+    MOVE_PROBE4(move_start, t->room, player_id, column, read_ns);
+}
+
+void movetrace_handle(void) {
+    if (movetrace_active) cur->handle_ns = monotonic_ns();
+}
+
+void movetrace_serialized(void) {
+    if (!movetrace_active) return;
+    cur->serialize_ns = monotonic_ns();
+    MOVE_PROBE2(move_serialized, cur->room, cur->serialize_ns - cur->read_ns);
+}
+
+// From client_write(): slot and the connection's queued byte count under io_uring, -1 when already sent
+void movetrace_write(int fd, int slot, unsigned long long mark) {
+    int i = 0;
+    while (i < nrcpt && rcpt[i].fd != fd) i++;
+    if (i == max_rcpt) return;
+    if (i == nrcpt) {
+        rcpt[i].fd = fd;
+        nrcpt++;
+    }
+    rcpt[i].slot = slot;
+    rcpt[i].mark = mark;
+    if (slot < 0) rcpt[i].flush_ns = monotonic_ns();
+}
+
+void movetrace_end(void) {
+    if (!movetrace_active) return;
+    struct move_trace *t = cur;
+    movetrace_active = 0;
+    // Rejected moves serialize nothing and are not traced
+    if (!t->serialize_ns) {
+        t->seq = 0;
+        return;
+    }
+
+    long long now = monotonic_ns();
+    t->end_ns = now;
+    t->nrecipients = nrcpt;
+    for (int i = 0; i < nrcpt && i < MOVETRACE_RECIPIENTS; i++) t->fds[i] = rcpt[i].fd;
+    for (int i = 0; i < nrcpt; i++) {
+        if (rcpt[i].slot < 0) {
+            flushed(t, i, rcpt[i].flush_ns);
+            continue;
+        }
+        struct slot_waits *sw = &waits[rcpt[i].slot];
+        if (sw->count == MOVETRACE_SLOT_WAITS) {
+            struct flush_wait oldest = sw->w[sw->head];
+            sw->head = (sw->head + 1) % MOVETRACE_SLOT_WAITS;
+            sw->count--;
+            lost(&oldest);
+        }
+        struct flush_wait *w = &sw->w[(sw->head + sw->count) % MOVETRACE_SLOT_WAITS];
+        w->seq = t->seq;
+        w->index = i;
+        w->mark = rcpt[i].mark;
+        sw->count++;
+        t->pending++;
+    }
+    if (t->pending == 0) finish(t);
+}
+
+// io_uring send completion: `sent` bytes have left the connection so far
+void movetrace_sent(int slot, unsigned long long sent) {
+    struct slot_waits *sw = &waits[slot];
+    if (sw->count == 0) return;
+    long long now = monotonic_ns();
+    while (sw->count > 0 && sw->w[sw->head].mark <= sent) {
+        struct flush_wait *w = &sw->w[sw->head];
+        sw->head = (sw->head + 1) % MOVETRACE_SLOT_WAITS;
+        sw->count--;
+        struct move_trace *t = &inflight[w->seq % MOVETRACE_INFLIGHT];
+        if (t->seq != w->seq) continue;
+        flushed(t, w->index, now);
+        if (--t->pending == 0) finish(t);
+    }
+}
+
+void movetrace_drop(int slot) {
+    struct slot_waits *sw = &waits[slot];
+    while (sw->count > 0) {
+        struct flush_wait w = sw->w[sw->head];
+        sw->head = (sw->head + 1) % MOVETRACE_SLOT_WAITS;
+        sw->count--;
+        lost(&w);
+    }
+    sw->head = 0;
+}
+
+static int put_span(char *out, size_t size, int len, const char *name, const struct histogram *h) {
+    return stats_append(out, size, len, "# %-10s p50 %.1fus p90 %.1fus p99 %.1fus max %.1fus\n", name,
+                        hist_percentile(h, 50.0) / 1e3, hist_percentile(h, 90.0) / 1e3,
+                        hist_percentile(h, 99.0) / 1e3, h->max / 1e3);
+}
+
+/*
+ * GET /moves[?n=N]   span percentiles over every traced move, then the
+ *                    last N (default all kept) slow ones, newest first, each
+ *                    span in microseconds after the read, and up to
+ *                    MOVETRACE_RECIPIENTS fd:flushed pairs
+ */
+int movetrace_admin(const char *path, char *out, size_t size) {
+    const char *query = strchr(path, '?');
+    const char *p = query ? strstr(query, "n=") : NULL;
+    unsigned long long kept = nslow < MOVETRACE_SLOW_RING ? nslow : MOVETRACE_SLOW_RING;
+    unsigned long long n = p ? (unsigned long long)atoll(p + 2) : kept;
+    if (n > kept) n = kept;
+
+    int len = stats_append(out, size, 0, "# %llu moves traced, %llu at or over %dus, last %llu kept\n",
+                           ntraced, nslow, cfg.trace_slow_us, kept);
+    len = put_span(out, size, len, "handle", &span_handle);
+    len = put_span(out, size, len, "serialize", &span_serialize);
+    len = put_span(out, size, len, "handled", &span_handled);
+    len = put_span(out, size, len, "flush", &span_flush);
+    len = put_span(out, size, len, "total", &span_total);
+    len = stats_append(out, size, len, "# room player column handle serialize handled flushed recipients dropped fd:flushed...\n");
+    for (unsigned long long i = 0; i < n && len < (int)size - 1; i++) {
+        const struct move_trace *t = &slow[(nslow - 1 - i) % MOVETRACE_SLOW_RING];
+        long long done = t->flush_ns ? t->flush_ns : t->end_ns;
+        len = stats_append(out, size, len, "%d %lld %d %.1f %.1f %.1f %.1f %d %d", t->room, t->player, t->column,
+                           (t->handle_ns - t->read_ns) / 1e3, (t->serialize_ns - t->read_ns) / 1e3,
+                           (t->end_ns - t->read_ns) / 1e3, (done - t->read_ns) / 1e3, t->nrecipients, t->dropped);
+        for (int r = 0; r < t->nrecipients && r < MOVETRACE_RECIPIENTS; r++) {
+            if (t->flushed[r]) len = stats_append(out, size, len, " %d:%.1f", t->fds[r], (t->flushed[r] - t->read_ns) / 1e3);
+            else len = stats_append(out, size, len, " %d:-", t->fds[r]);
+        }
+        len = stats_append(out, size, len, "\n");
+    }
+    return len;
+}
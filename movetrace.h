@@ -0,0 +1,48 @@
+#ifndef MOVETRACE_H
+#define MOVETRACE_H
+
+#include <stddef.h>
+
+#define MOVETRACE_SLOW_RING 256     // slowest recent moves kept for /moves/slow
+#define MOVETRACE_RECIPIENTS 8      // recipients timed one by one in a kept trace
+#define MOVETRACE_INFLIGHT 1024     // moves whose output is still being sent
+#define MOVETRACE_SLOT_WAITS 4      // unflushed moves tracked per connection
+
+/*
+ * Static probes for perf/bpftrace, provider "connect4", when the systemtap
+ * header is available; times are CLOCK_MONOTONIC nanoseconds:
+ *   move_start(room, player, column, read_ns)
+ *   move_serialized(room, ns since read)
+ *   move_flushed(room, fd, ns since read)
+ *   move_done(room, ns since read, recipients)
+ */
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define MOVE_PROBE2(name, a, b) DTRACE_PROBE2(connect4, name, a, b)
+#define MOVE_PROBE3(name, a, b, c) DTRACE_PROBE3(connect4, name, a, b, c)
+#define MOVE_PROBE4(name, a, b, c, d) DTRACE_PROBE4(connect4, name, a, b, c, d)
+#endif
+#endif
+#ifndef MOVE_PROBE2
+#define MOVE_PROBE2(name, a, b) do { } while (0)
+#define MOVE_PROBE3(name, a, b, c) do { } while (0)
+#define MOVE_PROBE4(name, a, b, c, d) do { } while (0)
+#endif
+
+struct Room;
+
+// Set between movetrace_begin() and movetrace_end(): writes belong to the move
+extern int movetrace_active;
+
+void movetrace_init(void);
+void movetrace_begin(struct Room *room, long long player_id, int column, long long read_ns);
+void movetrace_handle(void);
+void movetrace_serialized(void);
+void movetrace_write(int fd, int slot, unsigned long long mark);
+void movetrace_end(void);
+void movetrace_sent(int slot, unsigned long long sent);
+void movetrace_drop(int slot);
+int movetrace_admin(const char *path, char *out, size_t size);
+
+#endif
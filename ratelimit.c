@@ -0,0 +1,112 @@
+#include "server.h"
+#include <string.h>
+#include "ratelimit.h"
+
+// Whole-connection budget, checked before the per-command one
+struct rl_limit rl_conn_limit = { 40, 80 };
+
+struct rl_limit rl_cmd_limits[STAT_CMD_COUNT] = {
+    [STAT_CMD_N]     = { 1, 3 },
+    [STAT_CMD_M1]    = { 2, 5 },
+    [STAT_CMD_M2]    = { 2, 5 },
+    [STAT_CMD_M3]    = { 2, 5 },
+    [STAT_CMD_M4]    = { 2, 5 },
+    [STAT_CMD_S]     = { 10, 20 },
+    [STAT_CMD_C]     = { 5, 10 },
+    [STAT_CMD_Q]     = { 2, 5 },
+    [STAT_CMD_L]     = { 2, 5 },
+    [STAT_CMD_OTHER] = { 5, 10 },
+};
+
+static struct rl_conn *conns;   // indexed by fd, cfg.max_fd entries
+static int paused_count = 0;
+
+void rl_init(void) {
+    conns = pool_alloc(cfg.max_fd, sizeof(struct rl_conn));
+    paused_count = 0;
+}
+
+void rl_bucket_fill(struct rl_bucket *b, const struct rl_limit *limit, long long now_ns) {
+    b->tokens = (long long)limit->burst * 1000;
+    b->last_ns = now_ns;
+}
+
+int rl_bucket_take(struct rl_bucket *b, const struct rl_limit *limit, long long now_ns) {
+    long long cap = (long long)limit->burst * 1000;
+    long long elapsed = now_ns - b->last_ns;
+    if (elapsed > 0) {
+        // rate tokens/s == rate milli-tokens/ms
+        b->tokens += elapsed / 1000000 * limit->rate;
+        if (b->tokens > cap) b->tokens = cap;
+        b->last_ns = now_ns - elapsed % 1000000;
+    }
+    if (b->tokens < 1000) return 0;
+    b->tokens -= 1000;
+    return 1;
+}
+
+void rl_reset(int fd, int slot) {
+    if (fd < 0 || fd >= cfg.max_fd) return;
+    struct rl_conn *c = &conns[fd];
+    long long now = monotonic_ns();
+    if (c->paused_until_ns) paused_count--;
+    memset(c, 0, sizeof(*c));
+    c->slot = slot;
+    rl_bucket_fill(&c->total, &rl_conn_limit, now);
+    for (int i = 0; i < STAT_CMD_COUNT; i++) rl_bucket_fill(&c->cmd[i], &rl_cmd_limits[i], now);
+}
+
+static void pause_reads(int fd, struct rl_conn *c, long long now_ns) {
+    if (c->paused_until_ns || c->slot <= 0 || c->slot >= cfg.max_clients) return;
+    if (clients[c->slot].fd != fd) return;
+    clients[c->slot].events = 0;
+    c->paused_until_ns = now_ns + RL_PAUSE_MS * 1000000LL;
+    paused_count++;
+    stats.rl_paused++;
+}
+
+int rl_check(int fd, int cmd, long long now_ns) {
+    if (fd < 0 || fd >= cfg.max_fd) return RL_ALLOW;
+    struct rl_conn *c = &conns[fd];
+
+    if (rl_bucket_take(&c->total, &rl_conn_limit, now_ns)) {
+        if (rl_bucket_take(&c->cmd[cmd], &rl_cmd_limits[cmd], now_ns)) return RL_ALLOW;
+        // Refund: flooding one throttled command must not starve the others
+        c->total.tokens += 1000;
+    }
+
+    // Strikes halve for every quiet second since the last one
+    long long quiet = (now_ns - c->strike_ns) / 1000000000LL;
+    c->strikes = quiet >= 31 ? 0 : c->strikes >> quiet;
+    c->strike_ns = now_ns;
+    c->strikes++;
+    stats.rl_dropped++;
+
+    if (c->strikes >= RL_DISCONNECT_STRIKES) {
+        stats.rl_disconnected++;
+        return RL_DISCONNECT;
+    }
+    if (c->strikes >= RL_PAUSE_STRIKES) {
+        pause_reads(fd, c, now_ns);
+    } else if (c->strikes == RL_BACKOFF_STRIKES) {
+        char msg[64];
+        snprintf(msg, sizeof(msg), "wToo many requests, slow down\n");
+        client_write(fd, msg, strlen(msg));
+    }
+    return RL_DROP;
+}
+
+// Called once per poll round; cheap when nobody is paused
+void rl_resume_paused(long long now_ns) {
+    if (paused_count == 0) return;
+    for (int i = 1; i <= maxi; i++) {
+        int fd = clients[i].fd;
+        if (fd < 0 || fd >= cfg.max_fd) continue;
+        struct rl_conn *c = &conns[fd];
+        if (c->paused_until_ns && now_ns >= c->paused_until_ns) {
+            c->paused_until_ns = 0;
+            clients[i].events = POLLRDNORM;
+            paused_count--;
+        }
+    }
+}
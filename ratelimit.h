@@ -0,0 +1,50 @@
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+#include "stats.h"
+
+// Outcomes of rl_check()
+#define RL_ALLOW 0
+#define RL_DROP 1
+#define RL_DISCONNECT 2
+
+#define RL_BACKOFF_STRIKES 1      // first drop sends a backoff notice
+#define RL_PAUSE_STRIKES 20       // then reads are paused
+#define RL_DISCONNECT_STRIKES 100 // then the connection is closed
+#define RL_PAUSE_MS 2000
+
+struct rl_limit {
+    int rate;    // tokens per second
+    int burst;   // bucket size
+};
+
+/*
+ * Buckets hold milli-tokens so refills stay exact in integer math; each
+ * check is a subtraction, a multiply and a compare.
+ */
+struct rl_bucket {
+    long long tokens;
+    long long last_ns;
+};
+
+struct rl_conn {
+    struct rl_bucket total;
+    struct rl_bucket cmd[STAT_CMD_COUNT];
+    int slot;
+    int strikes;
+    long long strike_ns;
+    long long paused_until_ns;
+};
+
+// Compiled-in defaults; config.c overwrites them from ratelimit.* settings
+extern struct rl_limit rl_conn_limit;
+extern struct rl_limit rl_cmd_limits[STAT_CMD_COUNT];
+
+void rl_init(void);
+void rl_bucket_fill(struct rl_bucket *b, const struct rl_limit *limit, long long now_ns);
+int rl_bucket_take(struct rl_bucket *b, const struct rl_limit *limit, long long now_ns);
+void rl_reset(int fd, int slot);
+int rl_check(int fd, int cmd, long long now_ns);
+void rl_resume_paused(long long now_ns);
+
+#endif
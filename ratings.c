@@ -0,0 +1,492 @@
+#include "server.h"
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include "ratings.h"
+#include "stats.h"
+#include "logger.h"
+
+#define RATINGS_MAGIC 0x52544731u   // "RTG1"
+#define RATINGS_COMPACT_SLACK 1024  // stale records tolerated beyond one per identity
+
+struct identity {
+    char name[MAX_NAME_LEN];
+    unsigned long long token;       // hash of the claim token, 0 while unclaimed
+    int rating;
+    int games, wins, draws;
+    int rec;                        // record number in the file, -1 for a guest
+    int sessions;                   // players logged in under it; a guest goes with its last
+    struct rnode *node;             // NULL for a guest
+};
+
+struct rnode {
+    int ident;                      // -1 for the head
+    int level;
+    struct rlink {
+        struct rnode *next;
+        int span;                   // nodes stepped over, counting next itself
+    } link[];
+};
+
+// One per identity change, appended in place; check covers the fields above it
+struct rating_record {
+    unsigned magic;
+    int ident;                      // the identity's record number
+    int rating, games, wins, draws;
+    unsigned long long token;
+    char name[MAX_NAME_LEN];
+    unsigned check;
+};
+
+static struct identity *ids;
+static int nids, ids_cap;
+static int *free_ids;               // slots of departed guests, reused first
+static int nfree, free_cap;
+static int nrecs;                   // identities on the leaderboard and in the file
+static int *name_index;             // open addressing, identity + 1, 0 empty
+static int index_cap;
+
+static struct rnode *head;
+static int list_level = 1;
+static int list_len;
+static unsigned level_seed = 0x2545f491u;
+
+static int store_fd = -1;
+static const char *store_path = "";
+static int store_dirty;
+
+static unsigned long long hash_str(const char *s) {
+    unsigned long long h = 0xcbf29ce484222325ULL;
+    while (*s) h = (h ^ (unsigned char)*s++) * 0x100000001b3ULL;
+    return h;
+}
+
+static unsigned record_check(const struct rating_record *r) {
+    const unsigned char *p = (const unsigned char *)r;
+    unsigned h = 2166136261u;
+    for (size_t i = 0; i < offsetof(struct rating_record, check); i++) h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+// ---- skip list ----
+
+static struct rnode *node_new(int ident, int level) {
+    struct rnode *n = calloc(1, sizeof(struct rnode) + sizeof(struct rlink) * level);
+    if (!n) err_sys("ratings alloc");
+    n->ident = ident;
+    n->level = level;
+    return n;
+}
+
+static int random_level(void) {
+    int level = 1;
+    // One in four nodes climbs each level
+    while (level < RATINGS_LEVELS) {
+        level_seed ^= level_seed << 13;
+        level_seed ^= level_seed >> 17;
+        level_seed ^= level_seed << 5;
+        if (level_seed & 3) break;
+        level++;
+    }
+    return level;
+}
+
+// a ranks above b: higher rating, then the older identity
+static int ahead(int a, int b) {
+    if (ids[a].rating != ids[b].rating) return ids[a].rating > ids[b].rating;
+    return a < b;
+}
+
+static void list_insert(int ident) {
+    struct rnode *update[RATINGS_LEVELS];
+    int rank[RATINGS_LEVELS];
+    struct rnode *x = head, *n = ids[ident].node;
+
+    for (int i = list_level - 1; i >= 0; i--) {
+        rank[i] = i == list_level - 1 ? 0 : rank[i + 1];
+        while (x->link[i].next && ahead(x->link[i].next->ident, ident)) {
+            rank[i] += x->link[i].span;
+            x = x->link[i].next;
+        }
+        update[i] = x;
+    }
+    if (n->level > list_level) {
+        for (int i = list_level; i < n->level; i++) {
+            rank[i] = 0;
+            update[i] = head;
+            head->link[i].span = list_len;
+        }
+        list_level = n->level;
+    }
+    for (int i = 0; i < n->level; i++) {
+        n->link[i].next = update[i]->link[i].next;
+        update[i]->link[i].next = n;
+        n->link[i].span = update[i]->link[i].span - (rank[0] - rank[i]);
+        update[i]->link[i].span = rank[0] - rank[i] + 1;
+    }
+    for (int i = n->level; i < list_level; i++) update[i]->link[i].span++;
+    list_len++;
+}
+
+// Must run before the identity's rating changes, the search keys on it
+static void list_remove(int ident) {
+    struct rnode *update[RATINGS_LEVELS];
+    struct rnode *x = head, *n = ids[ident].node;
+
+    for (int i = list_level - 1; i >= 0; i--) {
+        while (x->link[i].next && ahead(x->link[i].next->ident, ident)) x = x->link[i].next;
+        update[i] = x;
+    }
+    for (int i = 0; i < list_level; i++) {
+        if (update[i]->link[i].next == n) {
+            update[i]->link[i].span += n->link[i].span - 1;
+            update[i]->link[i].next = n->link[i].next;
+        } else {
+            update[i]->link[i].span--;
+        }
+    }
+    while (list_level > 1 && !head->link[list_level - 1].next) list_level--;
+    list_len--;
+}
+
+// 1-based position on the leaderboard
+static int list_rank(int ident) {
+    struct rnode *x = head;
+    int rank = 0;
+    for (int i = list_level - 1; i >= 0; i--) {
+        while (x->link[i].next && !ahead(ident, x->link[i].next->ident)) {
+            rank += x->link[i].span;
+            x = x->link[i].next;
+        }
+        if (x->ident == ident) return rank;
+    }
+    return 0;
+}
+
+static struct rnode *list_at(int rank) {
+    struct rnode *x = head;
+    int traversed = 0;
+    for (int i = list_level - 1; i >= 0; i--) {
+        while (x->link[i].next && traversed + x->link[i].span <= rank) {
+            traversed += x->link[i].span;
+            x = x->link[i].next;
+        }
+        if (traversed == rank) return x;
+    }
+    return NULL;
+}
+
+// ---- identities ----
+
+static int *index_slot(const char *name) {
+    unsigned long long h = hash_str(name);
+    for (int i = (int)(h & (index_cap - 1));; i = (i + 1) & (index_cap - 1)) {
+        if (!name_index[i] || strcmp(ids[name_index[i] - 1].name, name) == 0) return &name_index[i];
+    }
+}
+
+static void index_grow(void) {
+    int *old = name_index, old_cap = index_cap;
+    index_cap = index_cap ? index_cap * 2 : 1024;
+    name_index = calloc(index_cap, sizeof(int));
+    if (!name_index) err_sys("ratings alloc");
+    for (int i = 0; i < old_cap; i++) {
+        if (old[i]) *index_slot(ids[old[i] - 1].name) = old[i];
+    }
+    free(old);
+}
+
+// Backward-shift delete: later entries of the probe run move into the hole
+static void index_remove(const char *name) {
+    int mask = index_cap - 1;
+    int hole = (int)(index_slot(name) - name_index);
+    name_index[hole] = 0;
+    for (int j = (hole + 1) & mask; name_index[j]; j = (j + 1) & mask) {
+        int home = (int)(hash_str(ids[name_index[j] - 1].name) & mask);
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            name_index[hole] = name_index[j];
+            name_index[j] = 0;
+            hole = j;
+        }
+    }
+}
+
+// In memory only; see make_durable()
+static int identity_add(const char *name) {
+    int ident;
+    if (nfree > 0) {
+        ident = free_ids[--nfree];
+    } else {
+        if (nids == ids_cap) {
+            ids_cap = ids_cap ? ids_cap * 2 : 1024;
+            struct identity *grown = realloc(ids, sizeof(struct identity) * ids_cap);
+            if (!grown) err_sys("ratings alloc");
+            ids = grown;
+        }
+        if ((nids + 1) * 2 > index_cap) index_grow();
+        ident = nids++;
+    }
+
+    struct identity *id = &ids[ident];
+    memset(id, 0, sizeof(*id));
+    snprintf(id->name, sizeof(id->name), "%s", name);
+    id->rating = RATINGS_INITIAL;
+    id->rec = -1;
+    *index_slot(id->name) = ident + 1;
+    return ident;
+}
+
+// A guest nobody is logged in as any more: out of the index, its slot reused
+static void identity_drop(int ident) {
+    if (nfree == free_cap) {
+        free_cap = free_cap ? free_cap * 2 : 1024;
+        int *grown = realloc(free_ids, sizeof(int) * free_cap);
+        if (!grown) err_sys("ratings alloc");
+        free_ids = grown;
+    }
+    index_remove(ids[ident].name);
+    ids[ident].name[0] = '\0';
+    free_ids[nfree++] = ident;
+}
+
+/*
+ * Names are identities from the first login, but a guest gets a record
+ * number and a leaderboard node only once it claims the name or plays a
+ * rated game; until then it is never written and never ranked. The node
+ * is made here but linked by the caller, so a replay links once.
+ */
+static void make_durable(int ident) {
+    ids[ident].rec = nrecs++;
+    ids[ident].node = node_new(ident, random_level());
+}
+
+static void store_append(int ident) {
+    struct rating_record r;
+    struct identity *id = &ids[ident];
+
+    if (store_fd < 0) return;
+    memset(&r, 0, sizeof(r));
+    r.magic = RATINGS_MAGIC;
+    r.ident = id->rec;
+    r.rating = id->rating;
+    r.games = id->games;
+    r.wins = id->wins;
+    r.draws = id->draws;
+    r.token = id->token;
+    memcpy(r.name, id->name, MAX_NAME_LEN);
+    r.check = record_check(&r);
+    if (write(store_fd, &r, sizeof(r)) != sizeof(r)) {
+        // Keep serving from memory; the file is whole up to the last record
+        log_event(EV_RATINGS_ERROR, -1, errno, 0, store_path);
+        close(store_fd);
+        store_fd = -1;
+        return;
+    }
+    store_dirty = 1;
+}
+
+void ratings_init(void) {
+    head = node_new(-1, RATINGS_LEVELS);
+    list_level = 1;
+    list_len = 0;
+    nids = nrecs = nfree = 0;
+    index_grow();
+}
+
+/*
+ * Replays the file into memory, then links every identity once. A record
+ * that is short or fails its check ends the replay and is cut off with
+ * everything after it; the rest of the run appends from there. Nobody has
+ * logged in yet, so record numbers and identities coincide.
+ */
+int ratings_open(const char *path) {
+    struct rating_record r;
+    long long records = 0;
+    off_t good = 0;
+
+    if (!path[0]) return 0;
+    store_path = path;
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        log_event(EV_RATINGS_ERROR, -1, errno, 0, path);
+        return -1;
+    }
+    FILE *in = fdopen(dup(fd), "rb");
+    while (in && fread(&r, sizeof(r), 1, in) == 1) {
+        if (r.magic != RATINGS_MAGIC || r.check != record_check(&r) || r.ident < 0 || r.ident > nrecs) break;
+        r.name[MAX_NAME_LEN - 1] = '\0';
+        if (r.ident == nrecs) make_durable(identity_add(r.name));
+        struct identity *id = &ids[r.ident];
+        id->rating = r.rating;
+        id->games = r.games;
+        id->wins = r.wins;
+        id->draws = r.draws;
+        id->token = r.token;
+        good += sizeof(r);
+        records++;
+    }
+    if (in) fclose(in);
+    if (ftruncate(fd, good) < 0 || lseek(fd, good, SEEK_SET) < 0) {
+        log_event(EV_RATINGS_ERROR, -1, errno, 0, path);
+        close(fd);
+        return -1;
+    }
+    for (int i = 0; i < nrecs; i++) list_insert(i);
+
+    // Players restored by a hot upgrade pick their identities back up
+    for (int i = 0; i < cfg.max_clients; i++) {
+        if (players[i].fd != -1) players[i].rating = ratings_login(players[i].name, NULL);
+    }
+    for (int i = 0; i < cfg.max_rooms; i++) {
+        if (room_status[i]) ratings_game_started(&rooms[i]);
+    }
+
+    store_fd = fd;
+    if (records > 2LL * nrecs + RATINGS_COMPACT_SLACK) {
+        // Latest record per identity into a fresh file, swapped in atomically
+        char tmp[CONFIG_STR_LEN + 8];
+        snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+        int out = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (out >= 0) {
+            store_fd = out;
+            for (int i = 0; i < nrecs && store_fd >= 0; i++) store_append(i);
+            if (store_fd >= 0 && fdatasync(out) == 0 && rename(tmp, path) == 0) {
+                close(fd);
+                records = nrecs;
+            } else {
+                if (store_fd >= 0) close(out);
+                unlink(tmp);
+                store_fd = fd;
+            }
+        }
+    }
+    log_event(EV_RATINGS_LOADED, -1, nrecs, records, path);
+    return 0;
+}
+
+/*
+ * Identity for a login, made on first sight. A claimed name needs its token
+ * ("" for none); NULL skips the check, for sessions that already passed it.
+ * -1 when the token doesn't match.
+ */
+int ratings_login(const char *name, const char *token) {
+    int *slot = index_slot(name);
+    int ident = *slot ? *slot - 1 : -1;
+    unsigned long long h = token && token[0] ? hash_str(token) | 1 : 0;
+
+    if (ident >= 0 && token && ids[ident].token && ids[ident].token != h) return -1;
+    if (ident < 0) ident = identity_add(name);
+    ids[ident].sessions++;
+    if (!h || ids[ident].token) return ident;
+
+    ids[ident].token = h;
+    if (ids[ident].rec < 0) {
+        make_durable(ident);
+        list_insert(ident);
+    }
+    store_append(ident);
+    return ident;
+}
+
+/*
+ * A session under ident ended. Its games are already over, rated or not,
+ * so a guest that no other session holds can go.
+ */
+void ratings_logout(int ident) {
+    if (ident < 0 || ident >= nids || !ids[ident].sessions) return;
+    if (--ids[ident].sessions == 0 && ids[ident].rec < 0) identity_drop(ident);
+}
+
+// Seats are read at the start: a disconnect empties one before the result
+void ratings_game_started(struct Room *room) {
+    struct Player *p1 = find_player_by_id(room->player_1);
+    struct Player *p2 = find_player_by_id(room->player_2);
+    room->rated[0] = p1 ? p1->rating : -1;
+    room->rated[1] = p2 ? p2->rating : -1;
+}
+
+static void rerate(int ident, int delta, int win, int draw) {
+    if (ids[ident].rec >= 0) list_remove(ident);
+    else make_durable(ident);
+    ids[ident].rating += delta;
+    ids[ident].games++;
+    ids[ident].wins += win;
+    ids[ident].draws += draw;
+    list_insert(ident);
+    store_append(ident);
+}
+
+void ratings_game_over(struct Room *room, long long winner) {
+    int a = room->rated[0], b = room->rated[1];
+    if (a < 0 || b < 0 || a == b || room->vs_ai) return;
+
+    // Score for player 1's side: a leaver's seat is already -1, the winner's isn't
+    double score = winner == GAME_DRAW ? 0.5 : winner == room->player_1 ? 1.0 : 0.0;
+    double expected = 1.0 / (1.0 + pow(10.0, (ids[b].rating - ids[a].rating) / 400.0));
+    int delta = (int)lround(RATINGS_K * (score - expected));
+
+    rerate(a, delta, score == 1.0, score == 0.5);
+    rerate(b, -delta, score == 0.0, score == 0.5);
+    room->rated[0] = room->rated[1] = -1;
+}
+
+void ratings_send_page(struct Player *player, int page) {
+    char buf[RATINGS_PAGE_SIZE * 80 + 96];
+    int len = 0;
+    int first = page * RATINGS_PAGE_SIZE + 1;
+    int last = first + RATINGS_PAGE_SIZE - 1;
+
+    if (last > RATINGS_TOP) last = RATINGS_TOP;
+    struct rnode *x = first <= last ? list_at(first) : NULL;
+    for (int rank = first; x && rank <= last; rank++, x = x->link[0].next) {
+        struct identity *id = &ids[x->ident];
+        len += snprintf(buf + len, sizeof(buf) - len, "Kr%d;%s;%d;%d\n", rank, id->name, id->rating, id->games);
+    }
+    int more = last < RATINGS_TOP && last < list_len;
+    int me = player->rating;
+    len += snprintf(buf + len, sizeof(buf) - len, "Ke%d;%d;%d;%d\n", page, more,
+                    me >= 0 && ids[me].rec >= 0 ? list_rank(me) : 0, me >= 0 ? ids[me].rating : 0);
+    client_write(player->fd, buf, len);
+}
+
+// Once a second: what was appended since is on disk
+void ratings_sync(void) {
+    if (store_fd < 0 || !store_dirty) return;
+    fdatasync(store_fd);
+    store_dirty = 0;
+}
+
+/*
+ * GET /ratings?top=N          the first N (default RATINGS_TOP)
+ * GET /ratings/rank?name=X    one player's position
+ */
+int ratings_admin(const char *path, char *out, size_t size) {
+    const char *query = strchr(path, '?');
+    char val[MAX_NAME_LEN];
+    query = query ? query + 1 : "";
+
+    if (strncmp(path, "/ratings/rank", 13) == 0) {
+        const char *p = strstr(query, "name=");
+        size_t n = p ? strcspn(p + 5, "& \r\n") : 0;
+        if (!p || n == 0 || n >= sizeof(val)) return stats_append(out, size, 0, "error name required\n");
+        memcpy(val, p + 5, n);
+        val[n] = '\0';
+        int *slot = index_slot(val);
+        if (!*slot) return stats_append(out, size, 0, "error no such player\n");
+        struct identity *id = &ids[*slot - 1];
+        // Guests are rank 0
+        return stats_append(out, size, 0, "%s rank %d of %d rating %d games %d wins %d draws %d\n", id->name,
+                            id->rec >= 0 ? list_rank(*slot - 1) : 0, list_len, id->rating, id->games, id->wins, id->draws);
+    }
+
+    const char *p = strstr(query, "top=");
+    int top = p ? atoi(p + 4) : RATINGS_TOP;
+    int len = stats_append(out, size, 0, "# rank name rating games wins draws (%d players)\n", list_len);
+    struct rnode *x = top > 0 ? list_at(1) : NULL;
+    for (int rank = 1; x && rank <= top && len < (int)size - 1; rank++, x = x->link[0].next) {
+        struct identity *id = &ids[x->ident];
+        len = stats_append(out, size, len, "%d %s %d %d %d %d\n", rank, id->name, id->rating, id->games, id->wins, id->draws);
+    }
+    return len;
+}
@@ -0,0 +1,45 @@
+#ifndef RATINGS_H
+#define RATINGS_H
+
+#include <stddef.h>
+
+#define RATINGS_INITIAL 1200
+#define RATINGS_K 32
+#define RATINGS_PAGE_SIZE 20
+#define RATINGS_TOP 100        // deepest a client leaderboard page reaches
+#define RATINGS_LEVELS 24      // skip list height, plenty for 4^24 identities
+
+/*
+ * Durable identities and Elo ratings. A name is an identity; "n<name>;<token>"
+ * claims it, and from then on only that token logs in under it. Session
+ * player ids still come from next_id; an identity is what outlives them.
+ * Unclaimed names that never played a rated game are guests: kept in
+ * memory while someone is logged in under them, never ranked or stored.
+ *
+ * The leaderboard is a skip list ordered by rating (ties by age) whose links
+ * carry spans, so both the rank of a player and the entry at a rank are
+ * O(log n), and a page is that plus a walk along the bottom level. A rated
+ * game moves two nodes: unlink, rerate, relink.
+ *
+ * Storage is an append-only file of fixed-size, checksummed records, one per
+ * identity change; the last record for an identity wins. Startup replays it
+ * (dropping a torn tail) and rewrites it compactly once it is mostly stale.
+ * Nothing ever reads it again while running.
+ *
+ * Client command m6<id>;<page>; the reply is Kr<rank>;<name>;<rating>;<games>
+ * lines, then Ke<page>;<more>;<your rank>;<your rating>.
+ */
+struct Room;
+struct Player;
+
+void ratings_init(void);
+int ratings_open(const char *path);
+int ratings_login(const char *name, const char *token);
+void ratings_logout(int ident);
+void ratings_game_started(struct Room *room);
+void ratings_game_over(struct Room *room, long long winner);
+void ratings_send_page(struct Player *player, int page);
+void ratings_sync(void);
+int ratings_admin(const char *path, char *out, size_t size);
+
+#endif
@@ -0,0 +1,407 @@
+#include "server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include "relay.h"
+#include "chat.h"
+#include "cluster.h"
+#include "logger.h"
+#include "uring.h"
+#include "ratelimit.h"
+
+int relay_mode = 0;
+
+struct relay_room {
+    int room_id;          // -1 while the entry is free
+    int slot;             // clients[] slot of the upstream connection
+    long long up_id;      // our player id upstream, -1 until it answers the name
+    int name_tries;       // names refused so far
+    char *in;             // bytes read but not yet a whole line
+    size_t in_len;
+    size_t in_cap;
+    int *fds;             // local watchers
+    int nfds;
+    int fds_cap;
+    char state[RELAY_STATE_LINES][RELAY_LINE_LEN];
+    int nstate;
+    char chat[CHAT_HISTORY][CHAT_LINE_LEN];
+    int chat_head;        // oldest line
+    int chat_count;
+    struct rl_bucket chat_budget;   // chat forwarded upstream, all watchers together
+};
+
+static struct sockaddr_in upstream;
+static struct relay_room *rrooms;
+static int *slot_room;    // by clients[] slot: rrooms index of an upstream connection, or -1
+
+// Scratch for one read's worth of lines, and for catch-up replays
+static char *batch;
+static size_t batch_len;
+static size_t batch_cap;
+
+static void append(char **buf, size_t *len, size_t *cap, const void *p, size_t n) {
+    if (*len + n > *cap) {
+        size_t cap2 = *cap ? *cap : 4096;
+        while (cap2 < *len + n) cap2 *= 2;
+        char *b = realloc(*buf, cap2);
+        if (!b) err_sys("realloc error");
+        *buf = b;
+        *cap = cap2;
+    }
+    memcpy(*buf + *len, p, n);
+    *len += n;
+}
+
+/*
+ * The upstream limits each connection, and one link carries the chat of
+ * every watcher of the room. Forwarding stays inside the upstream's "c"
+ * budget, assumed to be ours, with half the burst as slack for lines that
+ * bunch up in transit; the excess is dropped here rather than get the link
+ * paused or cut.
+ */
+static struct rl_limit relay_chat_budget(void) {
+    struct rl_limit limit = rl_cmd_limits[STAT_CMD_C];
+    if (limit.burst > 1) limit.burst /= 2;
+    return limit;
+}
+
+static struct relay_room *find_rroom(int room_id) {
+    for (int i = 0; i < cfg.max_rooms; i++) {
+        if (rrooms[i].room_id == room_id) return &rrooms[i];
+    }
+    return NULL;
+}
+
+static int add_slot(int fd, int room) {
+    for (int i = ADMIN_SLOT + 1; i < cfg.max_clients; i++) {
+        if (clients[i].fd < 0) {
+            clients[i].fd = fd;
+            clients[i].events = POLLRDNORM;
+            slot_room[i] = room;
+            if (i > maxi) maxi = i;
+            return i;
+        }
+    }
+    close(fd);
+    return -1;
+}
+
+static int upstream_connect(void) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (SA *)&upstream, sizeof(upstream)) < 0) {
+        struct pollfd pfd = { fd, POLLOUT, 0 };
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (errno != EINPROGRESS || poll(&pfd, 1, RELAY_CONNECT_MS) != 1 ||
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+            close(fd);
+            return -1;
+        }
+    }
+    // Read only when ready; our own writes are single short lines
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK);
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    return fd;
+}
+
+static void upstream_send(struct relay_room *r, const char *line, size_t len) {
+    // A failed write shows up as EOF on the next read
+    writen(clients[r->slot].fd, line, len);
+}
+
+// relay-<port>, then relay-<port>-<k> while a player holds the name with a token
+static void send_name(struct relay_room *r) {
+    char msg[64];
+    int n = r->name_tries ? snprintf(msg, sizeof(msg), "nrelay-%d-%d\n", cfg.port, r->name_tries)
+                          : snprintf(msg, sizeof(msg), "nrelay-%d\n", cfg.port);
+    upstream_send(r, msg, n);
+}
+
+// Subscribes to room_id upstream: name ourselves, then watch once the id comes back
+static struct relay_room *open_room(int room_id) {
+    struct relay_room *r = find_rroom(-1);
+    if (!r) return NULL;
+    int fd = upstream_connect();
+    if (fd < 0) return NULL;
+    int slot = add_slot(fd, r - rrooms);
+    if (slot < 0) return NULL;
+
+    r->room_id = room_id;
+    r->slot = slot;
+    r->up_id = -1;
+    r->in_len = 0;
+    r->nfds = 0;
+    r->nstate = 0;
+    r->chat_head = r->chat_count = 0;
+    struct rl_limit chat = relay_chat_budget();
+    rl_bucket_fill(&r->chat_budget, &chat, monotonic_ns());
+
+    r->name_tries = 0;
+    send_name(r);
+    log_event(EV_RELAY_UPSTREAM, -1, room_id, 1, NULL);
+    return r;
+}
+
+// A reply that ends the watch; other "w" lines are notices
+static int room_ended(const char *line) {
+    return strncmp(line, "wRoom closed\n", 13) == 0 || strncmp(line, "wCannot join room as audience\n", 30) == 0;
+}
+
+// Drops the subscription; watchers still attached get msg and go back to the menu
+static void close_room(struct relay_room *r, const char *msg) {
+    for (int i = 0; i < r->nfds; i++) {
+        struct Player *player = find_player_by_fd(r->fds[i]);
+        if (player) player->room_id = -1;
+        if (msg) client_write(r->fds[i], msg, strlen(msg));
+    }
+    log_event(EV_RELAY_UPSTREAM, -1, r->room_id, 0, NULL);
+    if (uring_active) uring_forget(r->slot);
+    close(clients[r->slot].fd);
+    clients[r->slot].fd = -1;
+    slot_room[r->slot] = -1;
+    r->room_id = -1;
+    r->slot = -1;
+    r->nfds = 0;
+}
+
+// State lines replace the previous line of the same kind: the player lines
+// by kind and seat (p61, p72), other p lines by kind, the rest by letter
+static int state_key_len(const char *line) {
+    if (line[0] != 'p') return 1;
+    return (line[1] == '6' || line[1] == '7') ? 3 : 2;
+}
+
+static void cache_line(struct relay_room *r, const char *line, size_t len) {
+    if (line[0] == 'c') {
+        int pos = (r->chat_head + r->chat_count) % CHAT_HISTORY;
+        if (r->chat_count == CHAT_HISTORY) {
+            r->chat_head = (r->chat_head + 1) % CHAT_HISTORY;
+        } else {
+            r->chat_count++;
+        }
+        if (len >= CHAT_LINE_LEN) len = CHAT_LINE_LEN - 1;
+        memcpy(r->chat[pos], line, len);
+        r->chat[pos][len - 1] = '\n';
+        r->chat[pos][len] = '\0';
+        return;
+    }
+    if (len >= RELAY_LINE_LEN) return;
+
+    // A new room header starts a new snapshot
+    if (line[0] == 'r') r->nstate = 0;
+    int key = state_key_len(line);
+    int i;
+    for (i = 0; i < r->nstate; i++) {
+        if (strncmp(r->state[i], line, key) == 0) break;
+    }
+    if (i == r->nstate) {
+        if (r->nstate == RELAY_STATE_LINES) return;
+        r->nstate++;
+    }
+    memcpy(r->state[i], line, len);
+    r->state[i][len] = '\0';
+}
+
+// Brings a new watcher up to date in one write
+static void send_cache(struct relay_room *r, int fd) {
+    batch_len = 0;
+    for (int i = 0; i < r->nstate; i++) {
+        append(&batch, &batch_len, &batch_cap, r->state[i], strlen(r->state[i]));
+    }
+    for (int i = 0; i < r->chat_count; i++) {
+        const char *line = r->chat[(r->chat_head + i) % CHAT_HISTORY];
+        append(&batch, &batch_len, &batch_cap, line, strlen(line));
+    }
+    if (batch_len) client_write(fd, batch, batch_len);
+}
+
+static void unwatch(struct Player *player) {
+    if (player->room_id == -1) return;
+    struct relay_room *r = find_rroom(player->room_id);
+    player->room_id = -1;
+    if (!r) return;
+    for (int i = 0; i < r->nfds; i++) {
+        if (r->fds[i] == player->fd) {
+            r->fds[i] = r->fds[--r->nfds];
+            break;
+        }
+    }
+    // Nobody left to relay to
+    if (r->nfds == 0) close_room(r, NULL);
+}
+
+static void watch(struct Player *player, int room_id) {
+    unwatch(player);
+    struct relay_room *r = find_rroom(room_id);
+    if (!r) r = open_room(room_id);
+    if (!r) {
+        char msg[] = "wCannot join room as audience\n";
+        client_write(player->fd, msg, strlen(msg));
+        return;
+    }
+    if (r->nfds == r->fds_cap) {
+        int cap = r->fds_cap ? r->fds_cap * 2 : 16;
+        int *fds = realloc(r->fds, sizeof(int) * cap);
+        if (!fds) err_sys("realloc error");
+        r->fds = fds;
+        r->fds_cap = cap;
+    }
+    r->fds[r->nfds++] = player->fd;
+    player->room_id = room_id;
+    send_cache(r, player->fd);
+}
+
+void relay_init(void) {
+    if (cfg.relay_upstream[0] == '\0') return;
+    if (cluster_size > 1) err_quit("relay.upstream cannot be combined with cluster.peers");
+
+    char addr[CONFIG_STR_LEN];
+    snprintf(addr, sizeof(addr), "%s", cfg.relay_upstream);
+    char *colon = strrchr(addr, ':');
+    if (!colon) err_quit("relay.upstream: expected host:port, got %s", addr);
+    *colon = '\0';
+    bzero(&upstream, sizeof(upstream));
+    upstream.sin_family = AF_INET;
+    upstream.sin_port = htons(atoi(colon + 1));
+    if (inet_pton(AF_INET, addr, &upstream.sin_addr) != 1) {
+        err_quit("relay.upstream: %s is not an IPv4 address", addr);
+    }
+
+    relay_mode = 1;
+    rrooms = pool_alloc(cfg.max_rooms, sizeof(struct relay_room));
+    for (int i = 0; i < cfg.max_rooms; i++) rrooms[i].room_id = rrooms[i].slot = -1;
+    slot_room = pool_alloc(cfg.max_clients, sizeof(int));
+    for (int i = 0; i < cfg.max_clients; i++) slot_room[i] = -1;
+    printf("Relaying spectators for %s\n", cfg.relay_upstream);
+
+    // Watchers handed over by a hot upgrade subscribe again
+    for (int i = 0; i < cfg.max_clients; i++) {
+        if (player_fds[i] == -1 || players[i].room_id == -1) continue;
+        int room_id = players[i].room_id;
+        players[i].room_id = -1;
+        watch(&players[i], room_id);
+    }
+}
+
+int relay_owns_slot(int slot) {
+    return relay_mode && slot_room[slot] >= 0;
+}
+
+void relay_serve(int slot) {
+    struct relay_room *r = &rrooms[slot_room[slot]];
+    if (r->in_cap - r->in_len < MAXLINE) {
+        size_t cap = r->in_cap ? r->in_cap * 2 : 2 * MAXLINE;
+        char *b = realloc(r->in, cap);
+        if (!b) err_sys("realloc error");
+        r->in = b;
+        r->in_cap = cap;
+    }
+    ssize_t n = read(clients[slot].fd, r->in + r->in_len, r->in_cap - r->in_len);
+    if (n <= 0) {
+        close_room(r, "wRoom closed\n");
+        return;
+    }
+    r->in_len += n;
+
+    int ended = 0;
+    size_t start = 0;
+    batch_len = 0;
+    for (size_t i = 0; i < r->in_len; i++) {
+        if (r->in[i] != '\n') continue;
+        char *line = r->in + start;
+        size_t len = i + 1 - start;
+        start = i + 1;
+
+        if (r->up_id < 0) {
+            // The answer to our name; nothing for the watchers
+            if (line[0] == 'i') {
+                char msg[64];
+                r->up_id = atoll(line + 1);
+                int m = snprintf(msg, sizeof(msg), "m4%lld;%d\n", r->up_id, r->room_id);
+                upstream_send(r, msg, m);
+            } else if (strncmp(line, "wName is registered", 19) == 0) {
+                if (++r->name_tries < RELAY_NAME_TRIES) {
+                    send_name(r);
+                } else {
+                    // Watchers go back to the menu rather than wait forever
+                    append(&batch, &batch_len, &batch_cap, "wRoom closed\n", 13);
+                    ended = 1;
+                    break;
+                }
+            }
+            continue;
+        }
+        // Room closed or the watch refused: pass it on and unsubscribe
+        if (room_ended(line)) ended = 1;
+        else if (line[0] != 'w') cache_line(r, line, len);
+        append(&batch, &batch_len, &batch_cap, line, len);
+        if (ended) break;
+    }
+    memmove(r->in, r->in + start, r->in_len - start);
+    r->in_len -= start;
+
+    for (int i = 0; i < r->nfds; i++) client_write(r->fds[i], batch, batch_len);
+    if (ended) close_room(r, NULL);
+}
+
+void relay_handle(int fd, const char *line) {
+    struct Player *player = find_player_by_fd(fd);
+    if (!player) return;
+
+    switch (line[0]) {
+        case 'm': {
+            long long player_id;
+            int room_id;
+            if (line[1] != '4') {
+                char msg[] = "wThis server only relays spectators\n";
+                client_write(fd, msg, strlen(msg));
+            } else if (sscanf(line + 2, "%lld;%d", &player_id, &room_id) == 2) {
+                watch(player, room_id);
+            }
+            break;
+        }
+        case 'c': {
+            // Goes up under the relay's name, tagged with the watcher's
+            struct relay_room *r = player->room_id != -1 ? find_rroom(player->room_id) : NULL;
+            const char *text = strchr(line, ';');
+            if (!r || r->up_id < 0 || !text) break;
+            struct rl_limit chat = relay_chat_budget();
+            if (!rl_bucket_take(&r->chat_budget, &chat, monotonic_ns())) {
+                stats.relay_chat_dropped++;
+                break;
+            }
+            char msg[MAX_NAME_LEN + MAXLINE];
+            int n = snprintf(msg, sizeof(msg), "c%lld;%s: %s\n", r->up_id, player->name, text + 1);
+            if (n >= (int)sizeof(msg)) n = sizeof(msg) - 1;
+            upstream_send(r, msg, n);
+            break;
+        }
+        case 'l': {
+            if (player->room_id == -1) break;
+            unwatch(player);
+            char msg[] = "w \n";
+            client_write(fd, msg, strlen(msg));
+            break;
+        }
+        case 'q':
+            unwatch(player);
+            break;
+        case 's':
+            // Spectators have no moves
+            break;
+        default:
+            log_event(EV_UNKNOWN_MESSAGE, fd, 0, 0, line);
+            break;
+    }
+}
+
+void relay_client_closed(int fd) {
+    if (!relay_mode) return;
+    struct Player *player = find_player_by_fd(fd);
+    if (player) unwatch(player);
+}
@@ -0,0 +1,30 @@
+#ifndef RELAY_H
+#define RELAY_H
+
+#define RELAY_STATE_LINES 16   // distinct state lines cached per room
+#define RELAY_LINE_LEN 128     // longest cached state line
+#define RELAY_CONNECT_MS 200   // longest the event loop waits on one connect
+#define RELAY_NAME_TRIES 8     // suffixed names tried when ours is registered upstream
+
+/*
+ * Spectator relay. Started with relay.upstream set, the server hosts no
+ * games: it accepts spectators and, for every room at least one of them
+ * watches, keeps one ordinary audience connection to the upstream server
+ * (a primary or another relay, so relays chain into trees). Each line the
+ * upstream sends is written once to every local watcher, batched per read.
+ *
+ * The upstream sees a single audience member per relay, so its fan-out
+ * cost is per relay rather than per spectator. A cache of the room's
+ * latest state lines and chat history brings late joiners up to date
+ * without asking upstream again. Audience counts shown are those of the
+ * upstream; spectator chat goes up under the relay's name.
+ */
+extern int relay_mode;
+
+void relay_init(void);
+int relay_owns_slot(int slot);
+void relay_serve(int slot);
+void relay_handle(int fd, const char *line);
+void relay_client_closed(int fd);
+
+#endif
@@ -0,0 +1,555 @@
+#include "unp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "capture.h"
+#include "histogram.h"
+
+/*
+ * Replay: plays a capture.file trace into a server over loopback. Every
+ * traced connection gets its own socket and the recorded input, read for
+ * read, in trace order; at 1x (or -S times faster) each event waits for
+ * its recorded time. With -x the think time goes: an event waits only
+ * for the frames sent before it that are still unanswered, each for at
+ * most its recorded gap to the event. An event that has to wait holds
+ * back the ones after it, so order across connections is kept. Latency is
+ * the time from a frame going out to the next reply on its connection.
+ *
+ * Player ids are handed out by the server in naming order and clients
+ * quote their own in most commands, so the fresh server's ids may differ
+ * from the traced ones. Each connection's traced id is the first one it
+ * quotes, its new one comes from the "i<id>" reply, and the leading id of
+ * every later line is rewritten. Room ids are sent as traced; they match
+ * as long as rooms are created in the same order. With a server command line after "--" the tool
+ * starts that server, waits for its port and reports its CPU time.
+ */
+#define REPLAY_CLASSES 10
+#define DRAIN_MS 1000
+
+static const char *class_names[REPLAY_CLASSES] = { "n", "m1", "m2", "m3", "m4", "s", "c", "q", "l", "other" };
+
+struct conn {
+    int fd;
+    int connecting;
+    char *out;
+    size_t out_len;
+    size_t out_cap;
+    long long sent_ns;    // oldest frame not yet answered, 0 for none
+    int await_pos;        // index in `awaiting` while sent_ns is set
+    int cls;
+    long long last_ns;    // when the last frame went out
+    long long last_us;    // and its trace time
+    long long trace_id;   // player id in the trace, 0 until quoted
+    long long live_id;    // the one this server gave, 0 until named
+    int mid_line;         // the last frame sent ended inside a line
+    char line[32];        // start of the reply line being read
+    int line_len;
+};
+
+const char *host = "127.0.0.1";
+int port = 12345;
+static struct sockaddr_in servaddr;
+
+static struct conn *conns;
+static struct pollfd *pfds;
+static int nconns;
+static int *awaiting;               // connections with unanswered frames
+static int nawaiting;
+static int max_speed;
+static long long wait_until;        // a held event's deadline, 0 when it waits on a socket
+
+static struct histogram latency[REPLAY_CLASSES];
+static struct histogram all_latency;
+static struct histogram lag;
+
+static unsigned long long nsent[CAPTURE_SEGMENT + 1];
+static unsigned long long bytes_out, bytes_in;
+static unsigned long long connect_failures, server_closed, lost, unanswered, skipped_bytes;
+static int nsegments;
+
+// The trace, mapped, and the next event in it
+static const char *trace;
+static size_t trace_len;
+static size_t pos;
+static struct capture_event ev;
+static const char *ev_data;
+static long long ev_us;             // since the first segment started
+static long long seg_us;
+static long long first_started_ns;
+
+static int frame_class(const char *p, int len) {
+    if (len < 1) return REPLAY_CLASSES - 1;
+    switch (p[0]) {
+        case 'n': return 0;
+        case 'm':
+            if (len > 1 && p[1] >= '1' && p[1] <= '4') return p[1] - '0';
+            return REPLAY_CLASSES - 1;
+        case 's': return 5;
+        case 'c': return 6;
+        case 'q': return 7;
+        case 'l': return 8;
+        default: return REPLAY_CLASSES - 1;
+    }
+}
+
+static int is_segment(size_t at) {
+    struct capture_event e;
+    struct capture_header h;
+    if (at + sizeof(e) + sizeof(h) > trace_len) return 0;
+    memcpy(&e, trace + at, sizeof(e));
+    memcpy(&h, trace + at + sizeof(e), sizeof(h));
+    return e.kind == CAPTURE_SEGMENT && e.len == sizeof(h) && h.magic == CAPTURE_MAGIC;
+}
+
+/*
+ * Loads the next event into `ev`, returns 0 at the end of the trace. A
+ * torn event (the server died mid-write, and a later run appended after
+ * it) is skipped by scanning for the next segment.
+ */
+static int next_event(void) {
+    for (;;) {
+        if (pos + sizeof(ev) > trace_len) return 0;
+        memcpy(&ev, trace + pos, sizeof(ev));
+        int bad = ev.kind < CAPTURE_OPEN || ev.kind > CAPTURE_SEGMENT ||
+                  pos + sizeof(ev) + ev.len > trace_len ||
+                  (ev.kind == CAPTURE_SEGMENT && !is_segment(pos)) ||
+                  (ev.kind != CAPTURE_SEGMENT && (ev.conn == 0 || nsegments == 0));
+        if (bad) {
+            size_t from = pos;
+            while (++pos + sizeof(ev) <= trace_len && !is_segment(pos));
+            skipped_bytes += pos - from;
+            continue;
+        }
+        ev_data = trace + pos + sizeof(ev);
+        pos += sizeof(ev) + ev.len;
+        if (ev.kind == CAPTURE_SEGMENT) {
+            struct capture_header h;
+            memcpy(&h, ev_data, sizeof(h));
+            if (nsegments++ == 0) first_started_ns = h.started_ns;
+            seg_us = (h.started_ns - first_started_ns) / 1000;
+            ev_us = seg_us;
+        } else {
+            ev_us += ev.dt_us;
+        }
+        return 1;
+    }
+}
+
+static void await_add(struct conn *c, long long now) {
+    c->sent_ns = now;
+    c->await_pos = nawaiting;
+    awaiting[nawaiting++] = (int)(c - conns);
+}
+
+static void await_done(struct conn *c) {
+    int last = awaiting[--nawaiting];
+    awaiting[c->await_pos] = last;
+    conns[last].await_pos = c->await_pos;
+    c->await_pos = -1;
+    c->sent_ns = 0;
+}
+
+static void conn_close(struct conn *c, struct pollfd *p) {
+    if (c->fd >= 0) close(c->fd);
+    if (c->sent_ns) {
+        unanswered++;
+        await_done(c);
+    }
+    c->fd = -1;
+    c->connecting = 0;
+    c->out_len = 0;
+    c->trace_id = 0;
+    c->live_id = 0;
+    c->mid_line = 0;
+    c->line_len = 0;
+    p->fd = -1;
+    p->events = 0;
+}
+
+// A new segment is a new server process: the earlier sessions are gone
+static void close_all(void) {
+    for (int i = 0; i < nconns; i++) conn_close(&conns[i], &pfds[i]);
+}
+
+static struct conn *conn_get(unsigned id) {
+    if ((int)id >= nconns) {
+        int n = nconns ? nconns : 256;
+        while (n <= (int)id) n *= 2;
+        conns = realloc(conns, sizeof(*conns) * n);
+        pfds = realloc(pfds, sizeof(*pfds) * n);
+        awaiting = realloc(awaiting, sizeof(*awaiting) * n);
+        if (!conns || !pfds || !awaiting) err_sys("replay: realloc");
+        for (int i = nconns; i < n; i++) {
+            memset(&conns[i], 0, sizeof(conns[i]));
+            conns[i].fd = -1;
+            conns[i].await_pos = -1;
+            pfds[i].fd = -1;
+            pfds[i].events = 0;
+        }
+        nconns = n;
+    }
+    return &conns[id];
+}
+
+static void conn_open(struct conn *c, struct pollfd *p) {
+    conn_close(c, p);
+    c->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (c->fd < 0) {
+        connect_failures++;
+        return;
+    }
+    fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL, 0) | O_NONBLOCK);
+    if (connect(c->fd, (const SA *)&servaddr, sizeof(servaddr)) < 0 && errno != EINPROGRESS) {
+        connect_failures++;
+        conn_close(c, p);
+        return;
+    }
+    c->connecting = 1;
+    p->fd = c->fd;
+    p->events = POLLOUT;
+}
+
+static void conn_flush(struct conn *c, struct pollfd *p) {
+    while (c->out_len > 0) {
+        ssize_t n = write(c->fd, c->out, c->out_len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n <= 0) {
+            server_closed++;
+            conn_close(c, p);
+            return;
+        }
+        bytes_out += n;
+        memmove(c->out, c->out + n, c->out_len - n);
+        c->out_len -= n;
+    }
+    p->events = POLLIN | (c->out_len ? POLLOUT : 0);
+}
+
+static void out_append(struct conn *c, const char *data, size_t len) {
+    if (c->out_len + len > c->out_cap) {
+        c->out_cap = (c->out_len + len) * 2;
+        c->out = realloc(c->out, c->out_cap);
+        if (!c->out) err_sys("replay: realloc");
+    }
+    memcpy(c->out + c->out_len, data, len);
+    c->out_len += len;
+}
+
+// Where a line's player id starts: s/c/q/l<id>..., m<k><id>..., t<k><id>...; 0 for none
+static int id_offset(const char *line, size_t len) {
+    if (len > 1 && strchr("scql", line[0])) return 1;
+    if (len > 2 && line[0] == 'm' && line[1] >= '1' && line[1] <= '9') return 2;
+    if (len > 2 && line[0] == 't' && line[1] >= 'a' && line[1] <= 'z') return 2;
+    return 0;
+}
+
+// Queues a traced frame line by line with the connection's own id swapped
+static void queue_frame(struct conn *c, const char *data, int len) {
+    const char *end = data + len;
+    while (data < end) {
+        const char *nl = memchr(data, '\n', end - data);
+        size_t n = nl ? (size_t)(nl - data) + 1 : (size_t)(end - data);
+        int off = c->mid_line ? 0 : id_offset(data, n);
+        c->mid_line = !nl;
+        // Bounded by the line: trace bytes are not NUL-terminated
+        const char *digits = data + off, *digits_end = digits;
+        long long id = 0;
+        while (off && digits_end < data + n && digits_end - digits < 18 && *digits_end >= '0' && *digits_end <= '9') {
+            id = id * 10 + (*digits_end++ - '0');
+        }
+        if (digits_end > digits) {
+            if (!c->trace_id) c->trace_id = id;
+            if (id == c->trace_id && c->live_id && c->live_id != id) {
+                char num[24];
+                out_append(c, data, off);
+                out_append(c, num, snprintf(num, sizeof(num), "%lld", c->live_id));
+                out_append(c, digits_end, data + n - digits_end);
+                data += n;
+                continue;
+            }
+        }
+        out_append(c, data, n);
+        data += n;
+    }
+}
+
+// Picks the connection's id out of the "i<id>" reply
+static void scan_reply(struct conn *c, const char *buf, ssize_t n) {
+    for (ssize_t i = 0; i < n; i++) {
+        if (buf[i] != '\n') {
+            if (c->line_len < (int)sizeof(c->line) - 1) c->line[c->line_len++] = buf[i];
+            continue;
+        }
+        c->line[c->line_len] = '\0';
+        if (c->line[0] == 'i' && c->line_len > 1) c->live_id = atoll(c->line + 1);
+        c->line_len = 0;
+    }
+}
+
+static void conn_send(struct conn *c, struct pollfd *p, const char *data, int len, long long now) {
+    queue_frame(c, data, len);
+    if (!c->sent_ns) {
+        await_add(c, now);
+        c->cls = frame_class(data, len);
+    }
+    c->last_ns = now;
+    c->last_us = ev_us;
+    conn_flush(c, p);
+}
+
+static void conn_read(struct conn *c, struct pollfd *p, long long now) {
+    char buf[16384];
+    for (;;) {
+        ssize_t n = read(c->fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (n <= 0) {
+            server_closed++;
+            conn_close(c, p);
+            return;
+        }
+        bytes_in += n;
+        scan_reply(c, buf, n);
+        if (c->sent_ns) {
+            hist_record(&latency[c->cls], now - c->sent_ns);
+            hist_record(&all_latency, now - c->sent_ns);
+            await_done(c);
+        }
+    }
+}
+
+// 0 when the event has to wait for its connection
+static int apply_event(long long now) {
+    if (ev.kind == CAPTURE_SEGMENT) {
+        close_all();
+        return 1;
+    }
+    struct conn *c = conn_get(ev.conn);
+    struct pollfd *p = &pfds[ev.conn];
+    wait_until = 0;
+    if (c->connecting || c->out_len) return 0;
+    if (max_speed) {
+        for (int i = 0; i < nawaiting; i++) {
+            struct conn *k = &conns[awaiting[i]];
+            long long until = k->last_ns + (ev_us - k->last_us) * 1000;
+            if (until > wait_until) wait_until = until;
+        }
+        if (now < wait_until) return 0;
+        wait_until = 0;
+    }
+
+    switch (ev.kind) {
+        case CAPTURE_OPEN:
+        case CAPTURE_LIVE:
+            conn_open(c, p);
+            break;
+        case CAPTURE_DATA:
+            // Output already waiting is not the reply to this frame
+            if (c->fd >= 0) conn_read(c, p, now);
+            if (c->fd < 0) {
+                lost++;
+                break;
+            }
+            conn_send(c, p, ev_data, ev.len, now);
+            break;
+        case CAPTURE_CLOSE:
+            conn_close(c, p);
+            break;
+    }
+    nsent[ev.kind]++;
+    return 1;
+}
+
+static long long proc_cpu_ticks(pid_t pid) {
+    char path[64], buf[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+    // Fields after the parenthesised command name: state is the 3rd, utime the 14th
+    char *p = strrchr(buf, ')');
+    unsigned long long utime, stime;
+    if (!p || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2) return -1;
+    return (long long)(utime + stime);
+}
+
+static pid_t start_server(char **argv) {
+    pid_t pid = fork();
+    if (pid < 0) err_sys("replay: fork");
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0) dup2(null, STDOUT_FILENO);
+        execvp(argv[0], argv);
+        perror("replay: exec");
+        _exit(127);
+    }
+    // Up once its port takes a connection
+    for (int i = 0; i < 100; i++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        int ok = connect(fd, (const SA *)&servaddr, sizeof(servaddr)) == 0;
+        close(fd);
+        if (ok) return pid;
+        if (waitpid(pid, NULL, WNOHANG) == pid) err_quit("replay: server exited during startup");
+        usleep(50000);
+    }
+    kill(pid, SIGKILL);
+    err_quit("replay: server not listening on %s:%d", host, port);
+    return -1;
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [-h host] [-p port] [-x | -S speed] [-P server_pid] trace\n"
+            "          [-- server command line, started for the run]\n",
+            prog);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    double speed = 1.0;
+    pid_t pid = 0;
+    int started = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "h:p:xS:P:")) != -1) {
+        switch (c) {
+            case 'h': host = optarg; break;
+            case 'p': port = atoi(optarg); break;
+            case 'x': max_speed = 1; break;
+            case 'S': speed = atof(optarg); break;
+            case 'P': pid = (pid_t)atoi(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind >= argc || speed <= 0) usage(argv[0]);
+    const char *trace_path = argv[optind++];
+
+    bzero(&servaddr, sizeof(servaddr));
+    servaddr.sin_family = AF_INET;
+    servaddr.sin_port = htons(port);
+    Inet_pton(AF_INET, host, &servaddr.sin_addr);
+
+    int tfd = open(trace_path, O_RDONLY);
+    struct stat st;
+    if (tfd < 0 || fstat(tfd, &st) < 0) err_sys("replay: %s", trace_path);
+    trace_len = (size_t)st.st_size;
+    if (trace_len == 0) err_quit("replay: %s is empty", trace_path);
+    trace = mmap(NULL, trace_len, PROT_READ, MAP_PRIVATE, tfd, 0);
+    if (trace == MAP_FAILED) err_sys("replay: mmap");
+    madvise((void *)trace, trace_len, MADV_SEQUENTIAL);
+    close(tfd);
+
+    signal(SIGPIPE, SIG_IGN);
+    if (optind < argc) {
+        pid = start_server(argv + optind);
+        started = 1;
+    }
+
+    for (int i = 0; i < REPLAY_CLASSES; i++) hist_init(&latency[i]);
+    hist_init(&all_latency);
+    hist_init(&lag);
+
+    if (max_speed) {
+        printf("replay: %s (%.1f MB) into %s:%d at max speed\n", trace_path, trace_len / 1e6, host, port);
+    } else {
+        printf("replay: %s (%.1f MB) into %s:%d at %gx\n", trace_path, trace_len / 1e6, host, port, speed);
+    }
+    long long cpu_start = pid ? proc_cpu_ticks(pid) : -1;
+    long long start = monotonic_ns();
+    long long drain_until = 0;
+    int have = next_event();
+    long long last_us = have ? ev_us : 0;
+
+    for (;;) {
+        long long now = monotonic_ns();
+        long long wake = now + 10000000LL;
+
+        while (have) {
+            long long due = max_speed ? now : start + (long long)(ev_us / speed * 1000.0);
+            if (due > now) {
+                if (due < wake) wake = due;
+                break;
+            }
+            if (!apply_event(now)) {
+                if (wait_until && wait_until < wake) wake = wait_until;
+                break;
+            }
+            if (!max_speed && ev.kind != CAPTURE_SEGMENT) hist_record(&lag, now - due);
+            last_us = ev_us;
+            have = next_event();
+        }
+        if (!have) {
+            if (!drain_until) drain_until = now + DRAIN_MS * 1000000LL;
+            if (now >= drain_until) break;
+        }
+
+        struct timespec ts = { 0, wake > now ? wake - now : 0 };
+        int nready = ppoll(pfds, nconns, &ts, NULL);
+        if (nready < 0) {
+            if (errno == EINTR) continue;
+            err_sys("replay: poll");
+        }
+        now = monotonic_ns();
+        for (int i = 0; i < nconns && nready > 0; i++) {
+            struct conn *k = &conns[i];
+            if (pfds[i].fd < 0 || pfds[i].revents == 0) continue;
+            nready--;
+            if (k->connecting) {
+                int err = 0;
+                socklen_t len = sizeof(err);
+                getsockopt(k->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                if (err != 0) {
+                    connect_failures++;
+                    conn_close(k, &pfds[i]);
+                    continue;
+                }
+                k->connecting = 0;
+                pfds[i].events = POLLIN;
+            }
+            if (pfds[i].revents & (POLLIN | POLLERR | POLLHUP)) conn_read(k, &pfds[i], now);
+            if (k->fd >= 0 && (pfds[i].revents & POLLOUT)) conn_flush(k, &pfds[i]);
+        }
+    }
+    double secs = (monotonic_ns() - start) / 1e9 - DRAIN_MS / 1000.0;
+    long long cpu_end = pid ? proc_cpu_ticks(pid) : -1;
+    unanswered += nawaiting;
+
+    unsigned long long events = nsent[CAPTURE_OPEN] + nsent[CAPTURE_LIVE] + nsent[CAPTURE_DATA] + nsent[CAPTURE_CLOSE];
+    printf("\n=== replay summary (%.2fs, trace spans %.2fs) ===\n", secs, last_us / 1e6);
+    printf("events:      %llu (%.0f/s): %llu connects (%llu already live at capture), %llu frames, %llu closes, %d segments\n",
+           events, events / secs, nsent[CAPTURE_OPEN] + nsent[CAPTURE_LIVE], nsent[CAPTURE_LIVE],
+           nsent[CAPTURE_DATA], nsent[CAPTURE_CLOSE], nsegments);
+    printf("bytes:       %llu out, %llu in\n", bytes_out, bytes_in);
+    printf("problems:    %llu connect failures, %llu closed by server, %llu frames lost, %llu unanswered, %llu trace bytes skipped\n",
+           connect_failures, server_closed, lost, unanswered, skipped_bytes);
+    if (cpu_start >= 0 && cpu_end >= 0) {
+        double cpu = (double)(cpu_end - cpu_start) / sysconf(_SC_CLK_TCK);
+        printf("server cpu:  %.2fs (%.0f%% of one core), %.2fus per event, %.2fus per frame\n",
+               cpu, 100.0 * cpu / secs, events ? cpu * 1e6 / events : 0.0,
+               nsent[CAPTURE_DATA] ? cpu * 1e6 / nsent[CAPTURE_DATA] : 0.0);
+    }
+    if (!max_speed) hist_print(&lag, stdout, "schedule lag", 1000.0, "us");
+    hist_print(&all_latency, stdout, "reply", 1000.0, "us");
+    for (int i = 0; i < REPLAY_CLASSES; i++) {
+        char label[16];
+        if (latency[i].total == 0) continue;
+        snprintf(label, sizeof(label), "  %s", class_names[i]);
+        hist_print(&latency[i], stdout, label, 1000.0, "us");
+    }
+
+    if (started) {
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+    }
+    return 0;
+}
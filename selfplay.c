@@ -0,0 +1,300 @@
+#include "unp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <pthread.h>
+#include "game.h"
+#include "engine.h"
+#include "histogram.h"
+
+#define SELFPLAY_CHUNK 16      // games a worker claims from its own range at a time
+
+/*
+ * Offline engine-vs-engine arena. Plays `ngames` games between engines A
+ * and B on every core, using the server's rules (game.c) and no sockets,
+ * on the classic board or any variant the server hosts (-v).
+ * Colours alternate by game number and the first `opening` plies are
+ * random, so deterministic engines still see varied positions. Each game
+ * seeds its engines from its own number, which keeps a run reproducible
+ * however the games land on threads.
+ *
+ * Scheduling is work stealing over ranges of game numbers: every worker
+ * starts with an equal slice and takes chunks from the front of it; a
+ * worker that runs dry takes the back half of the largest range it finds.
+ */
+struct side {
+    const struct engine *engine;
+    int depth;
+};
+
+struct tally {
+    long long wins[2];         // by side, A = 0
+    long long draws;
+    long long moves[2];
+    long long nodes[2];
+    long long depth_sum[2];
+    long long think_ns[2];
+    long long steals;
+    struct histogram move_time[2];
+};
+
+struct worker {
+    pthread_mutex_t lock;
+    long long next;            // [next, end) still to be played
+    long long end;
+    pthread_t tid;
+    struct tally t;
+};
+
+struct side sides[2];
+const struct game_variant *variant = GAME_CLASSIC;
+long long ngames = 10000;
+int nthreads = 0;
+int opening = 2;
+unsigned base_seed = 1;
+double min_score = -1;
+int json_output = 0;
+
+struct worker *workers;
+
+// Game number -> well mixed seed, so neighbouring games don't correlate
+static unsigned game_seed(long long g, unsigned salt) {
+    unsigned long long x = (unsigned long long)g * 0x9e3779b97f4a7c15ULL ^ ((unsigned long long)base_seed << 32 | salt);
+    x ^= x >> 31;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 29;
+    return (unsigned)x;
+}
+
+static void play_game(long long g, struct tally *t) {
+    struct game board;
+    struct engine_ctx ctx[2];
+    unsigned open_seed = game_seed(g, 0);
+    int first = g & 1;         // side that holds piece 1
+    int piece = 1;
+
+    game_init(&board, variant);
+    for (int s = 0; s < 2; s++) engine_ctx_init(&ctx[s], sides[s].depth, game_seed(g, s + 1));
+
+    for (int ply = 0; ply < variant->rows * variant->cols; ply++, piece = 3 - piece) {
+        int s = piece == 1 ? first : 1 - first;
+        int col;
+
+        if (ply < opening) {
+            int open[GAME_MAX_COLS], n = 0;
+            for (int c = 0; c < variant->cols; c++) {
+                if (board.height[c] < variant->rows) open[n++] = c;
+            }
+            col = open[rand_r(&open_seed) % n];
+        } else {
+            long long nodes = ctx[s].nodes;
+            long long start = monotonic_ns();
+            col = sides[s].engine->choose(&board, piece, &ctx[s]) - 1;
+            long long took = monotonic_ns() - start;
+
+            hist_record(&t->move_time[s], took);
+            t->think_ns[s] += took;
+            t->moves[s]++;
+            t->nodes[s] += ctx[s].nodes - nodes;
+            t->depth_sum[s] += ctx[s].reached;
+        }
+
+        if (game_play(&board, col, piece) < 0) {
+            err_quit("selfplay: %s played an illegal column %d in game %lld", sides[s].engine->name, col + 1, g);
+        }
+        if (game_won(&board, piece)) {
+            t->wins[s]++;
+            return;
+        }
+    }
+    t->draws++;
+}
+
+// Take the back half of the fullest range other than our own
+static int steal(struct worker *w) {
+    struct worker *victim = NULL;
+    long long most = 0;
+
+    for (int i = 0; i < nthreads; i++) {
+        struct worker *v = &workers[i];
+        if (v == w) continue;
+        pthread_mutex_lock(&v->lock);
+        long long left = v->end - v->next;
+        pthread_mutex_unlock(&v->lock);
+        if (left > most) {
+            most = left;
+            victim = v;
+        }
+    }
+    if (!victim) return 0;
+
+    long long from, to;
+    pthread_mutex_lock(&victim->lock);
+    to = victim->end;
+    from = victim->next + (victim->end - victim->next) / 2;
+    victim->end = from;
+    pthread_mutex_unlock(&victim->lock);
+    if (from >= to) return 1;    // emptied meanwhile; look again
+
+    pthread_mutex_lock(&w->lock);
+    w->next = from;
+    w->end = to;
+    pthread_mutex_unlock(&w->lock);
+    w->t.steals++;
+    return 1;
+}
+
+static void *worker_main(void *arg) {
+    struct worker *w = arg;
+
+    for (;;) {
+        long long from, to;
+        pthread_mutex_lock(&w->lock);
+        from = w->next;
+        to = from + SELFPLAY_CHUNK < w->end ? from + SELFPLAY_CHUNK : w->end;
+        w->next = to;
+        pthread_mutex_unlock(&w->lock);
+
+        if (from >= to) {
+            if (!steal(w)) break;
+            continue;
+        }
+        for (long long g = from; g < to; g++) play_game(g, &w->t);
+    }
+    return NULL;
+}
+
+static void tally_merge(struct tally *dst, const struct tally *src) {
+    for (int s = 0; s < 2; s++) {
+        dst->wins[s] += src->wins[s];
+        dst->moves[s] += src->moves[s];
+        dst->nodes[s] += src->nodes[s];
+        dst->depth_sum[s] += src->depth_sum[s];
+        dst->think_ns[s] += src->think_ns[s];
+        hist_merge(&dst->move_time[s], &src->move_time[s]);
+    }
+    dst->draws += src->draws;
+    dst->steals += src->steals;
+}
+
+// Half-width of the 95% interval of a score (win = 1, draw = 1/2), in percent
+static double score_margin(const struct tally *t, long long n) {
+    double w = (double)t->wins[0] / n, d = (double)t->draws / n;
+    double mean = w + d / 2;
+    double var = w + d / 4 - mean * mean;
+    return var > 0 ? 196.0 * sqrt(var / n) : 0;
+}
+
+static void report(const struct tally *t, double secs) {
+    long long n = t->wins[0] + t->wins[1] + t->draws;
+    double score = 100.0 * (t->wins[0] + t->draws / 2.0) / n;
+    const char *label[2] = { "A", "B" };
+
+    if (json_output) {
+        printf("{\"games\":%lld,\"variant\":\"%s\",\"threads\":%d,\"seconds\":%.3f,\"steals\":%lld,\"draws\":%lld,"
+               "\"score_a\":%.3f,\"score_margin\":%.3f",
+               n, variant->name, nthreads, secs, t->steals, t->draws, score, score_margin(t, n));
+        for (int s = 0; s < 2; s++) {
+            double think = t->think_ns[s] / 1e9;
+            printf(",\"%c\":{\"engine\":\"%s\",\"depth\":%d,\"wins\":%lld,\"moves\":%lld,"
+                   "\"avg_depth\":%.2f,\"nodes_per_sec\":%.0f,\"move_mean_us\":%.2f,"
+                   "\"move_p50_us\":%.2f,\"move_p99_us\":%.2f}",
+                   "ab"[s], sides[s].engine->name, sides[s].depth, t->wins[s], t->moves[s],
+                   t->moves[s] ? (double)t->depth_sum[s] / t->moves[s] : 0,
+                   think > 0 ? t->nodes[s] / think : 0, hist_mean(&t->move_time[s]) / 1000.0,
+                   hist_percentile(&t->move_time[s], 50) / 1000.0,
+                   hist_percentile(&t->move_time[s], 99) / 1000.0);
+        }
+        printf("}\n");
+        return;
+    }
+
+    printf("=== selfplay: %lld games on %s in %.1fs (%.0f games/s), %d threads, %lld steals ===\n",
+           n, variant->name, secs, n / secs, nthreads, t->steals);
+    for (int s = 0; s < 2; s++) {
+        printf("%s %-8s depth %-2d wins %6.2f%%\n", label[s], sides[s].engine->name,
+               sides[s].depth, 100.0 * t->wins[s] / n);
+    }
+    printf("draws             %6.2f%%\n", 100.0 * t->draws / n);
+    printf("score A           %6.2f%% +/- %.2f (95%%)\n", score, score_margin(t, n));
+    for (int s = 0; s < 2; s++) {
+        double think = t->think_ns[s] / 1e9;
+        printf("%s: %lld moves, avg depth %.2f, %.0f nodes/s per thread\n", label[s], t->moves[s],
+               t->moves[s] ? (double)t->depth_sum[s] / t->moves[s] : 0,
+               think > 0 ? t->nodes[s] / think : 0);
+        hist_print(&t->move_time[s], stdout, s ? "B move" : "A move", 1000.0, "us");
+    }
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [-a engine] [-A depth] [-b engine] [-B depth] [-n games] [-t threads]\n"
+            "          [-v variant] [-o opening plies] [-s seed] [-m min score%% for A] [-j]\n",
+            prog);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    const char *names[2] = { "search", "random" };
+    int c;
+
+    sides[0].depth = sides[1].depth = ENGINE_DEFAULT_DEPTH;
+    while ((c = getopt(argc, argv, "a:A:b:B:n:t:v:o:s:m:j")) != -1) {
+        switch (c) {
+            case 'a': names[0] = optarg; break;
+            case 'A': sides[0].depth = atoi(optarg); break;
+            case 'b': names[1] = optarg; break;
+            case 'B': sides[1].depth = atoi(optarg); break;
+            case 'n': ngames = atoll(optarg); break;
+            case 't': nthreads = atoi(optarg); break;
+            case 'v': if (!(variant = game_variant_find(optarg))) usage(argv[0]); break;
+            case 'o': opening = atoi(optarg); break;
+            case 's': base_seed = strtoul(optarg, NULL, 10); break;
+            case 'm': min_score = atof(optarg); break;
+            case 'j': json_output = 1; break;
+            default: usage(argv[0]);
+        }
+    }
+    for (int s = 0; s < 2; s++) {
+        if (!(sides[s].engine = engine_find(names[s]))) usage(argv[0]);
+    }
+    if (ngames <= 0 || opening < 0 || opening >= variant->rows * variant->cols) usage(argv[0]);
+    if (nthreads <= 0) nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads <= 0) nthreads = 1;
+
+    size_t bytes = (sizeof(struct worker) * nthreads + 63) & ~(size_t)63;
+    if (!(workers = aligned_alloc(64, bytes))) err_sys("aligned_alloc error");
+    memset(workers, 0, bytes);
+
+    long long start = monotonic_ns();
+    for (int i = 0; i < nthreads; i++) {
+        struct worker *w = &workers[i];
+        pthread_mutex_init(&w->lock, NULL);
+        w->next = ngames * i / nthreads;
+        w->end = ngames * (i + 1) / nthreads;
+        hist_init(&w->t.move_time[0]);
+        hist_init(&w->t.move_time[1]);
+    }
+    for (int i = 0; i < nthreads; i++) {
+        if (pthread_create(&workers[i].tid, NULL, worker_main, &workers[i]) != 0) err_sys("pthread_create error");
+    }
+
+    struct tally total;
+    memset(&total, 0, sizeof(total));
+    hist_init(&total.move_time[0]);
+    hist_init(&total.move_time[1]);
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(workers[i].tid, NULL);
+        tally_merge(&total, &workers[i].t);
+    }
+    report(&total, (monotonic_ns() - start) / 1e9);
+
+    // Regression gate: non-zero exit when A scores below the bar
+    if (min_score >= 0 && 100.0 * (total.wins[0] + total.draws / 2.0) / ngames < min_score) {
+        fprintf(stderr, "selfplay: score of A below %.2f%%\n", min_score);
+        return 2;
+    }
+    return 0;
+}
@@ -1,105 +1,168 @@
-#include "unp.h"
+#include "server.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <signal.h>
 #include <poll.h>
+#include "stats.h"
+#include "logger.h"
+#include "ratelimit.h"
+#include "chat.h"
+#include "lobby.h"
+#include "arena.h"
+#include "uring.h"
+#include "admit.h"
+#include "cluster.h"
+#include "relay.h"
+#include "tourney.h"
+#include "ratings.h"
+#include "gamelog.h"
+#include "capture.h"
+#include "movetrace.h"
+
+#define UPGRADE_MAGIC 0x43345550  /* "C4UP" */
+#define UPGRADE_VERSION 2
+#define UPGRADE_FD_BATCH 64
+#define UPGRADE_ACK_TIMEOUT 5000
+
+struct waiting_list waitlist;
+struct Player *players;
+struct Room *rooms;
+unsigned char *room_status;
+long long next_id = 1;
+int room_id_base = MIN_ROOM_ID;
+
+long long *room_turn;
+time_t *room_last_move;
+unsigned char *room_active;
+
+long long *player_ids;
+int *player_fds;
+
+int listenfd;
+struct pollfd *clients;
+int maxi = 0;
+
+// Hot upgrade: SIGUSR2 asks the running server to exec argv[0] and hand over
+// every socket plus a snapshot of the game state. The new process gets the
+// same command line, so it reads the same config.
+char **server_argv;
+volatile sig_atomic_t upgrade_requested = 0;
+
+// Zeroed, cache-line aligned storage for the tables sized from cfg
+void *pool_alloc(size_t n, size_t size) {
+    size_t bytes = (n * size + 63) & ~(size_t)63;
+    void *p = aligned_alloc(64, bytes ? bytes : 64);
+    if (!p) err_sys("pool_alloc");
+    memset(p, 0, bytes ? bytes : 64);
+    return p;
+}
 
-#define MAX_CLIENTS 50
-#define MAX_ROOMS 20
-#define BOARD_WIDTH 6
-#define BOARD_HEIGHT 7
-#define MAX_NAME_LEN 32
-#define MAXLINE 4096
-#define GAME_TIMEOUT 60
-
-#define MIN_ROOM_ID 1001
-#define MAX_ROOM_ID 1999
-#define ROOM_SIZE (MAX_ROOM_ID - MIN_ROOM_ID + 1)
-#define MAX_AUDIENCE 50 
-
-
-struct Player {
-    long long id;
-    char name[MAX_NAME_LEN];
-    int room_id;
-    int fd;
-    int player_number;
-};
+// Sizes every pool from cfg and puts them in their empty state
+void server_init(void) {
+    players = pool_alloc(cfg.max_clients, sizeof(struct Player));
+    player_ids = pool_alloc(cfg.max_clients, sizeof(long long));
+    player_fds = pool_alloc(cfg.max_clients, sizeof(int));
+    clients = pool_alloc(cfg.max_clients, sizeof(struct pollfd));
+    waitlist.players = pool_alloc(cfg.max_clients, sizeof(long long));
+    rooms = pool_alloc(cfg.max_rooms, sizeof(struct Room));
+    room_status = pool_alloc(cfg.max_rooms, 1);
+    room_turn = pool_alloc(cfg.max_rooms, sizeof(long long));
+    room_last_move = pool_alloc(cfg.max_rooms, sizeof(time_t));
+    room_active = pool_alloc(cfg.max_rooms, 1);
+
+    stats_init();
+    rl_init();
+    chat_init();
+    lobby_init();
+    tourney_init();
+    ratings_init();
+    gamelog_init();
+    movetrace_init();
+    arena_init();
+    admit_init();
+
+    clear_players();
+    memset(rooms, -1, sizeof(struct Room) * cfg.max_rooms);
+    lobby_rebuild();
+    init_waiting_list();
+    for (int i = 0; i < cfg.max_clients; i++) clients[i].fd = -1;
+}
 
-struct Room {
-    int id;
-    long long player_1;
-    long long player_2;
-    int board[BOARD_WIDTH][BOARD_HEIGHT];
-    int current_turn;
-    int is_active;
-    time_t last_move_time;
-    int is_public;
-    int audience_count;
-    int vs_ai;
-    long long *audience;
-};
+// Every byte sent to a client goes through here so it can be counted. A
+// failed write means the peer is gone; its read side will see EOF and
+// clean up, so the error is only counted.
+void client_write(int fd, const void *buf, size_t len) {
+    stats.writes++;
+    if (cluster_is_vfd(fd)) {
+        cluster_write(fd, buf, len);
+        if (movetrace_active) movetrace_write(fd, -1, 0);
+        return;
+    }
+    if (uring_active) {
+        uring_send(fd, buf, len);
+        return;
+    }
+    if (writen(fd, buf, len) == (ssize_t)len) {
+        stats.bytes_out += len;
+    } else {
+        stats.write_errors++;
+    }
+    if (movetrace_active) movetrace_write(fd, -1, 0);
+}
 
-struct waiting_list {
-    long long players[MAX_CLIENTS];
-    int count;
-} waitlist;
+void player_set(struct Player* p, long long id, int fd) {
+    int i = (int)(p - players);
+    p->id = player_ids[i] = id;
+    p->fd = player_fds[i] = fd;
+}
 
-struct Player players[MAX_CLIENTS];
-struct Room rooms[MAX_ROOMS];
-int room_status[ROOM_SIZE];
-long long next_id = 1;
+void clear_players(void) {
+    memset(players, -1, sizeof(struct Player) * cfg.max_clients);
+    memset(player_ids, -1, sizeof(long long) * cfg.max_clients);
+    memset(player_fds, -1, sizeof(int) * cfg.max_clients);
+}
 
 struct Player* find_player_by_id(long long id) {
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (players[i].id == id && players[i].fd != -1) return &players[i];
+    for (int i = 0; i < cfg.max_clients; i++) {
+        if (player_ids[i] == id && player_fds[i] != -1) return &players[i];
     }
     return NULL;
 }
 
 struct Player* find_player_by_fd(int fd) {
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (players[i].fd == fd) return &players[i];
+    for (int i = 0; i < cfg.max_clients; i++) {
+        if (player_fds[i] == fd) return &players[i];
     }
     return NULL;
 }
 
 struct Room* find_room_by_id(int room_id) {
-    if (room_id < MIN_ROOM_ID || room_id > MAX_ROOM_ID) return NULL;
-    int idx = room_id - MIN_ROOM_ID;
+    if (room_id < room_id_base || room_id >= room_id_base + cfg.max_rooms) return NULL;
+    int idx = room_id - room_id_base;
     if (!room_status[idx]) return NULL;
     return &rooms[idx];
 }
 
 struct Room* find_waiting_public_room() {
-    for (int i = MIN_ROOM_ID; i <= MAX_ROOM_ID; i++) {
-        if (room_status[i - MIN_ROOM_ID] && 
-            rooms[i - MIN_ROOM_ID].is_public && 
-            rooms[i - MIN_ROOM_ID].player_2 == -1) {
-            return &rooms[i - MIN_ROOM_ID];
-        }
-    }
-    return NULL;
+    return lobby_first_waiting();
 }
 
-int create_room(long long player_id, int is_public);
-void join_as_audience(long long player_id, int room_id);
-void send_game_state_to_audience(struct Player* audience, struct Room* room);
-void notify_room(int room_id, const char* message);
-int join_room(long long player_id, int room_id);
-
 void notify_room(int room_id, const char* message) {
     struct Room* room = find_room_by_id(room_id);
     if (!room) return;
     struct Player *player1 = find_player_by_id(room->player_1);
     struct Player *player2 = find_player_by_id(room->player_2);
-    if (player1) Writen(player1->fd, message, strlen(message));
-    if (player2) Writen(player2->fd, message, strlen(message));
+    if (player1) client_write(player1->fd, message, strlen(message));
+    if (player2) client_write(player2->fd, message, strlen(message));
     for (int i = 0; i < room->audience_count; i++) {
         struct Player* audience = find_player_by_id(room->audience[i]);
         if (audience) {
-            Writen(audience->fd, message, strlen(message));
+            client_write(audience->fd, message, strlen(message));
         }
     }
 }
@@ -109,8 +172,8 @@ void notify_opponent(int room_id, const char* message) {
     if (!room) return;
     struct Player *player1 = find_player_by_id(room->player_1);
     struct Player *player2 = find_player_by_id(room->player_2);
-    if (player1) Writen(player1->fd, message, strlen(message));
-    if (player2) Writen(player2->fd, message, strlen(message));
+    if (player1) client_write(player1->fd, message, strlen(message));
+    if (player2) client_write(player2->fd, message, strlen(message));
 }
 
 void notify_audiences(struct Room* room, const char* message) {
@@ -118,53 +181,73 @@ void notify_audiences(struct Room* room, const char* message) {
     for (int i = 0; i < room->audience_count; i++) {
         struct Player* audience = find_player_by_id(room->audience[i]);
         if (audience) {
-            Writen(audience->fd, message, strlen(message));
+            client_write(audience->fd, message, strlen(message));
         }
     }
 }
 
-void handle_name_message(int fd, const char *name) {
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (players[i].fd == -1) {
-            players[i].id = next_id++;
-            players[i].fd = fd;
-            strncpy(players[i].name, name, MAX_NAME_LEN - 1);
-            players[i].name[MAX_NAME_LEN - 1] = '\0';
+// n<name>[;<token>]: the token claims the name for ratings, see ratings.h
+void handle_name_message(int fd, const char *message) {
+    char name[MAX_NAME_LEN];
+    const char *sep = strchr(message, ';');
+    size_t len = sep ? (size_t)(sep - message) : strlen(message);
+    if (len >= MAX_NAME_LEN) len = MAX_NAME_LEN - 1;
+    memcpy(name, message, len);
+    name[len] = '\0';
+
+    for (int i = 0; i < cfg.max_clients; i++) {
+        if (player_fds[i] == -1) {
+            int rating = ratings_login(name, sep ? sep + 1 : "");
+            if (rating < 0) {
+                char msg[] = "wName is registered to another player\n";
+                client_write(fd, msg, strlen(msg));
+                return;
+            }
+            // Ids stay unique across a cluster: node k hands out k+1, k+1+n, ...
+            player_set(&players[i], next_id, fd);
+            next_id += cluster_size;
+            strcpy(players[i].name, name);
+            players[i].rating = rating;
             players[i].room_id = -1;
             players[i].player_number = 0;
             char msg[64];
             snprintf(msg, sizeof(msg), "i%lld\n", players[i].id);
-            Writen(fd, msg, strlen(msg));
-            printf("Player %s connected with ID %lld\n", name, players[i].id);
+            client_write(fd, msg, strlen(msg));
+            log_event(EV_PLAYER_CONNECTED, fd, players[i].id, 0, name);
             return;
         }
     }
 }
 
-int create_room(long long player_id, int is_public) {
+int create_room(long long player_id, int is_public, const struct game_variant *variant) {
     struct Player* player = find_player_by_id(player_id);
     if (!player) return -1;
-    for (int i = MIN_ROOM_ID; i <= MAX_ROOM_ID; i++) {
-        if (room_status[i - MIN_ROOM_ID] == 0) {
-            int idx = i - MIN_ROOM_ID;
+    for (int i = room_id_base; i < room_id_base + cfg.max_rooms; i++) {
+        if (room_status[i - room_id_base] == 0) {
+            int idx = i - room_id_base;
             rooms[idx].id = i;
             rooms[idx].player_1 = player_id;
             rooms[idx].player_2 = -1;
-            rooms[idx].current_turn = player_id;
-            rooms[idx].is_active = 0;
-            rooms[idx].last_move_time = time(NULL);  // Initialize when room is created
+            ROOM_TURN(&rooms[idx]) = player_id;
+            ROOM_ACTIVE(&rooms[idx]) = 0;
+            ROOM_LAST_MOVE(&rooms[idx]) = time(NULL);  // Initialize when room is created
             rooms[idx].is_public = is_public;
             rooms[idx].audience_count = 0;
             rooms[idx].vs_ai = 0;
-            rooms[idx].audience = malloc(sizeof(long long) * MAX_AUDIENCE);
+            rooms[idx].rated[0] = rooms[idx].rated[1] = -1;
+            room_arena_reset(&rooms[idx]);
+            rooms[idx].audience = room_alloc(&rooms[idx], sizeof(long long) * cfg.max_audience);
             
-            memset(rooms[idx].board, 0, sizeof(rooms[idx].board));
+            game_init(&rooms[idx].game, variant);
             room_status[idx] = 1;
+            lobby_init_room(&rooms[idx]);
+            if (is_public) lobby_add_waiting(&rooms[idx]);
             player->room_id = i;
             player->player_number = 1;
             char msg[32];
             snprintf(msg, sizeof(msg), "r%d\n", i);
-            Writen(player->fd, msg, strlen(msg));
+            client_write(player->fd, msg, strlen(msg));
+            send_variant(&rooms[idx], player->fd);
             
             return i;
         }
@@ -175,17 +258,16 @@ int create_room(long long player_id, int is_public) {
 void check_game_timeouts() {
     time_t current_time = time(NULL);
     
-    for (int i = 0; i < MAX_ROOMS; i++) {
-        if (!room_status[i]) continue;
-        struct Room* room = &rooms[i];
-        
-        // Only check active games with two players
-        if (!room->is_active || room->player_2 == -1) continue;
+    for (int i = 0; i < cfg.max_rooms; i++) {
+        // Only active games (both seats taken) can time out; this scan reads
+        // nothing but the hot arrays until a room has actually expired
+        if (!room_active[i]) continue;
         
         // Check if current player has exceeded timeout
-        if ((current_time - room->last_move_time) > GAME_TIMEOUT) {
+        if ((current_time - room_last_move[i]) > cfg.game_timeout) {
+            struct Room* room = &rooms[i];
             // The player whose turn it is loses
-            long long timeout_player_id = room->current_turn;
+            long long timeout_player_id = ROOM_TURN(room);
             
             // Send timeout notification
             char timeout_msg[32];
@@ -193,14 +275,25 @@ void check_game_timeouts() {
             notify_room(room->id, timeout_msg);
             
             // Mark game as inactive
-            room->is_active = 0;
+            end_game(room, timeout_player_id == room->player_1 ? room->player_2 : room->player_1, GAME_END_TIMEOUT);
             
-            printf("Game in room %d ended due to timeout (Player %lld)\n", 
-                   room->id, timeout_player_id);
+            log_event(EV_GAME_TIMEOUT, -1, room->id, timeout_player_id, NULL);
         }
     }
 }
 
+// Every way a game can finish (win, draw, timeout, quit, disconnect) ends
+// here; winner is a player id, GAME_DRAW or GAME_NO_RESULT
+void end_game(struct Room* room, long long winner, int reason) {
+    if (ROOM_ACTIVE(room)) {
+        gamelog_game_over(room, winner, reason);
+        tourney_game_over(room, winner);
+        if (winner != GAME_NO_RESULT) ratings_game_over(room, winner);
+    }
+    ROOM_ACTIVE(room) = 0;
+    lobby_game_ended(room);
+}
+
 void send_game_state_to_players(struct Room* room) {
     if (!room) return;
     
@@ -211,44 +304,39 @@ void send_game_state_to_players(struct Room* room) {
     char msg[128];
 
     snprintf(msg, sizeof(msg), "a%d\n", room->audience_count);
-    Writen(player1->fd, msg, strlen(msg));
-    Writen(player2->fd, msg, strlen(msg));
+    client_write(player1->fd, msg, strlen(msg));
+    client_write(player2->fd, msg, strlen(msg));
 
     snprintf(msg, sizeof(msg), "r%d\n", room->id);
-    Writen(player1->fd, msg, strlen(msg));
-    Writen(player2->fd, msg, strlen(msg));
+    client_write(player1->fd, msg, strlen(msg));
+    client_write(player2->fd, msg, strlen(msg));
+    send_variant(room, player1->fd);
+    send_variant(room, player2->fd);
 
-    room->current_turn = room->player_1;
-    snprintf(msg, sizeof(msg), "p3%lld\n", room->current_turn);
-    Writen(player1->fd, msg, strlen(msg));
-    Writen(player2->fd, msg, strlen(msg));
+    ROOM_TURN(room) = room->player_1;
+    snprintf(msg, sizeof(msg), "p3%lld\n", ROOM_TURN(room));
+    client_write(player1->fd, msg, strlen(msg));
+    client_write(player2->fd, msg, strlen(msg));
 
     snprintf(msg, sizeof(msg), "p1%s\n", player2->name);
-    Writen(player1->fd, msg, strlen(msg));
+    client_write(player1->fd, msg, strlen(msg));
     snprintf(msg, sizeof(msg), "p41\n");
-    Writen(player1->fd, msg, strlen(msg));
+    client_write(player1->fd, msg, strlen(msg));
     snprintf(msg, sizeof(msg), "p2%lld\n", player2->id);
-    Writen(player1->fd, msg, strlen(msg));
+    client_write(player1->fd, msg, strlen(msg));
     
     snprintf(msg, sizeof(msg), "p1%s\n", player1->name);
-    Writen(player2->fd, msg, strlen(msg));
+    client_write(player2->fd, msg, strlen(msg));
     snprintf(msg, sizeof(msg), "p42\n");
-    Writen(player2->fd, msg, strlen(msg));
+    client_write(player2->fd, msg, strlen(msg));
     snprintf(msg, sizeof(msg), "p2%lld\n", player1->id);
-    Writen(player2->fd, msg, strlen(msg));
+    client_write(player2->fd, msg, strlen(msg));
 
-    char board_msg[128] = "s";
-    int idx = 1;
-    for (int i = 0; i < BOARD_WIDTH; i++) {
-        for (int j = 0; j < BOARD_HEIGHT; j++) {
-            board_msg[idx++] = room->board[i][j] + '0';
-        }
-    }
-    board_msg[idx++] = '\n';
-    board_msg[idx] = '\0';
+    char board_msg[BOARD_MSG_LEN];
+    serialize_board(room, board_msg);
     
-    Writen(player1->fd, board_msg, strlen(board_msg));
-    Writen(player2->fd, board_msg, strlen(board_msg));
+    client_write(player1->fd, board_msg, strlen(board_msg));
+    client_write(player2->fd, board_msg, strlen(board_msg));
 }
 
 void init_waiting_list() {
@@ -256,7 +344,7 @@ void init_waiting_list() {
 }
 
 void add_to_waitlist(long long player_id) {
-    if (waitlist.count < MAX_CLIENTS) {
+    if (waitlist.count < cfg.max_clients) {
         waitlist.players[waitlist.count++] = player_id;
     }
 }
@@ -273,6 +361,18 @@ long long remove_from_waitlist() {
     return -1;
 }
 
+void waitlist_remove(long long player_id) {
+    for (int i = 0; i < waitlist.count; i++) {
+        if (waitlist.players[i] == player_id) {
+            for (int j = i; j < waitlist.count - 1; j++) {
+                waitlist.players[j] = waitlist.players[j + 1];
+            }
+            waitlist.count--;
+            break;
+        }
+    }
+}
+
 int join_room(long long player_id, int room_id) {
     struct Room* room = find_room_by_id(room_id);
     struct Player* player = find_player_by_id(player_id);
@@ -284,8 +384,12 @@ int join_room(long long player_id, int room_id) {
     room->player_2 = player_id;
     player->room_id = room_id;
     player->player_number = 2;
-    room->is_active = 1;
-    room->last_move_time = time(NULL);  // Reset timer when second player joins
+    ROOM_ACTIVE(room) = 1;
+    ratings_game_started(room);
+    gamelog_game_started(room);
+    lobby_remove_waiting(room);
+    lobby_game_started(room);
+    ROOM_LAST_MOVE(room) = time(NULL);  // Reset timer when second player joins
 
     struct Player* player1 = find_player_by_id(room->player_1);
     if (!player1) return -1;
@@ -293,15 +397,15 @@ int join_room(long long player_id, int room_id) {
     char msg[128];
 
     snprintf(msg, sizeof(msg), "r%d\n", room_id);
-    Writen(player1->fd, msg, strlen(msg));
-    Writen(player->fd, msg, strlen(msg));
+    client_write(player1->fd, msg, strlen(msg));
+    client_write(player->fd, msg, strlen(msg));
 
     snprintf(msg, sizeof(msg), "j%s\n", player->name);
-    Writen(player1->fd, msg, strlen(msg));
+    client_write(player1->fd, msg, strlen(msg));
     
     send_game_state_to_players(room);
 
-    printf("Player %lld joined room %d\n", player_id, room_id);
+    log_event(EV_ROOM_JOINED, player->fd, player_id, room_id, NULL);
     return 0;
 }
 
@@ -311,11 +415,11 @@ void handle_menu_action(long long player_id, char action, const char *param) {
 
     switch(action) {
         case '1':  
-            create_room(player_id, 1);
+            create_room(player_id, 1, GAME_CLASSIC);
             break;
             
         case '2':
-            create_room(player_id, 0);
+            create_room(player_id, 0, GAME_CLASSIC);
             break;
             
         case '3': {
@@ -324,7 +428,7 @@ void handle_menu_action(long long player_id, char action, const char *param) {
             if (sscanf(param, "%lld;%d", &pid, &room_id) != 2) return;
             if (join_room(player_id, room_id) == -1) {
                 char msg[] = "wRoom full or invalid\n";
-                Writen(player->fd, msg, strlen(msg));
+                client_write(player->fd, msg, strlen(msg));
             }
             break;
         }
@@ -339,8 +443,8 @@ void handle_menu_action(long long player_id, char action, const char *param) {
 
 int can_join_as_audience(struct Room* room, struct Player* player) {
     if (!room || !player) return 0;
-    if (room->audience_count >= MAX_AUDIENCE) return 0;
-    if (!room->is_active) return 0;
+    if (room->audience_count >= cfg.max_audience) return 0;
+    if (!ROOM_ACTIVE(room)) return 0;
     
     // Check if player is already in the room (as player or audience)
     if (room->player_1 == player->id || room->player_2 == player->id) return 0;
@@ -361,6 +465,7 @@ void remove_audience_member(struct Room* room, long long player_id) {
                 room->audience[j] = room->audience[j + 1];
             }
             room->audience_count--;
+            lobby_audience_changed(room);
             
             // Update audience count for all clients in room
             char msg[32];
@@ -382,45 +487,42 @@ void send_game_state_to_audience(struct Player* audience, struct Room* room) {
     
     char msg[128];
     snprintf(msg, sizeof(msg), "r%d\n", room->id);
-    Writen(audience->fd, msg, strlen(msg));
+    client_write(audience->fd, msg, strlen(msg));
+    send_variant(room, audience->fd);
 
     // Send player 1 info
     snprintf(msg, sizeof(msg), "p61%s\n", player1->name);
-    Writen(audience->fd, msg, strlen(msg));
+    client_write(audience->fd, msg, strlen(msg));
     snprintf(msg, sizeof(msg), "p71%lld\n", player1->id);
-    Writen(audience->fd, msg, strlen(msg));
+    client_write(audience->fd, msg, strlen(msg));
     
     // Send player 2 info if present
     if (player2) {
         snprintf(msg, sizeof(msg), "p62%s\n", player2->name);
-        Writen(audience->fd, msg, strlen(msg));
+        client_write(audience->fd, msg, strlen(msg));
         snprintf(msg, sizeof(msg), "p72%lld\n", player2->id);
-        Writen(audience->fd, msg, strlen(msg));
+        client_write(audience->fd, msg, strlen(msg));
     }
 
     // Send current turn info if game is active
-    if (room->is_active) {
-        snprintf(msg, sizeof(msg), "p8%lld\n", room->current_turn);
-        Writen(audience->fd, msg, strlen(msg));
+    if (ROOM_ACTIVE(room)) {
+        snprintf(msg, sizeof(msg), "p8%lld\n", ROOM_TURN(room));
+        client_write(audience->fd, msg, strlen(msg));
     }
 
-    Writen(audience->fd, "p9\n", strlen("p9\n"));
+    client_write(audience->fd, "p9\n", strlen("p9\n"));
 
     // Send board state
-    char board_msg[128] = "s";
-    int idx = 1;
-    for (int i = 0; i < BOARD_WIDTH; i++) {
-        for (int j = 0; j < BOARD_HEIGHT; j++) {
-            board_msg[idx++] = room->board[i][j] + '0';
-        }
-    }
-    board_msg[idx++] = '\n';
-    board_msg[idx] = '\0';
-    Writen(audience->fd, board_msg, strlen(board_msg));
+    char board_msg[BOARD_MSG_LEN];
+    serialize_board(room, board_msg);
+    client_write(audience->fd, board_msg, strlen(board_msg));
 }
 
 void cleanup_room(struct Room* room) {
     if (!room) return;
+
+    chat_flush_room(room);
+    chat_reset(room);
     
     // Notify all audience members that room is closing
     char msg[] = "wRoom closed\n";
@@ -428,16 +530,41 @@ void cleanup_room(struct Room* room) {
         struct Player* audience = find_player_by_id(room->audience[i]);
         if (audience) {
             audience->room_id = -1;
-            Writen(audience->fd, msg, strlen(msg));
+            client_write(audience->fd, msg, strlen(msg));
         }
     }
     
-    if (room->audience) {
-        free(room->audience);
-        room->audience = NULL;
-    }
+    room->audience = NULL;   // arena memory, released with the room
     room->audience_count = 0;
-    room->is_active = 0;
+    end_game(room, GAME_NO_RESULT, GAME_END_ABANDONED);
+}
+
+// Frees the room slot once nobody is seated in it
+void release_room(struct Room* room) {
+    cleanup_room(room);
+    lobby_room_closed(room);
+    room_arena_reset(room);
+    room_status[room->id - room_id_base] = 0;
+}
+
+// A room stays allocated after its game finishes so both sides can see
+// the result; a seated player gives up the seat when they start something
+// else from the menu, and the last one out frees the room.
+void leave_finished_room(struct Player* player) {
+    if (player->room_id == -1) return;
+    struct Room* room = find_room_by_id(player->room_id);
+    if (!room) {
+        player->room_id = -1;
+        return;
+    }
+    if (ROOM_ACTIVE(room)) return;
+    if (room->player_1 != player->id && room->player_2 != player->id) return;
+
+    if (room->player_1 == player->id) room->player_1 = -1;
+    if (room->player_2 == player->id) room->player_2 = -1;
+    player->room_id = -1;
+    player->player_number = 0;
+    if (room->player_1 == -1 && room->player_2 == -1) release_room(room);
 }
 
 // In server.c, modify the cleanup_disconnected_client function:
@@ -446,16 +573,7 @@ void cleanup_disconnected_client(int fd) {
     struct Player* player = find_player_by_fd(fd);
     if (!player) return;
 
-    // Remove from waitlist if present
-    for (int i = 0; i < waitlist.count; i++) {
-        if (waitlist.players[i] == player->id) {
-            for (int j = i; j < waitlist.count - 1; j++) {
-                waitlist.players[j] = waitlist.players[j + 1];
-            }
-            waitlist.count--;
-            break;
-        }
-    }
+    waitlist_remove(player->id);
 
     if (player->room_id != -1) {
         struct Room* room = find_room_by_id(player->room_id);
@@ -466,63 +584,55 @@ void cleanup_disconnected_client(int fd) {
                 if (room->player_2 == player->id) room->player_2 = -1;
                 
                 // End game if a player disconnects
-                if (room->is_active) {
+                if (ROOM_ACTIVE(room)) {
                     char msg[] = "eX\n";
                     notify_room(room->id, msg);
-                    room->is_active = 0;
+                    end_game(room, room->player_1 != -1 ? room->player_1 : room->player_2, GAME_END_DISCONNECT);
                 }
                 
                 // If both players are gone, cleanup room
                 if (room->player_1 == -1 && room->player_2 == -1) {
-                    cleanup_room(room);
-                    room_status[room->id - MIN_ROOM_ID] = 0;
+                    release_room(room);
                 }
             } else {
                 // They must be an audience member
                 // Send notification if game is still active
-                if (room->is_active) {
+                if (ROOM_ACTIVE(room)) {
                     char chat_msg[128];
-                    snprintf(chat_msg, sizeof(chat_msg), "cSystem;Audience (%s) Disconnected\n", player->name);
-                    notify_room(room->id, chat_msg);
+                    int len = snprintf(chat_msg, sizeof(chat_msg), "cSystem;Audience (%s) Disconnected\n", player->name);
+                    chat_post(room, chat_msg, len);
                 }
                 remove_audience_member(room, player->id);
             }
         }
     }
 
-    player->fd = -1;
-    player->id = -1;
+    ratings_logout(player->rating);
+    player->rating = -1;
+    player_set(player, -1, -1);
     player->room_id = -1;
     player->player_number = 0;
 }
 
 
-int check_win(int board[BOARD_WIDTH][BOARD_HEIGHT], int x, int y) {
-    int player = board[x][y];
-    if (player == 0) return 0;
-    int count;
-    
-    count = 1;
-    for (int i = y + 1; i < BOARD_HEIGHT && board[x][i] == player; i++) count++;
-    for (int i = y - 1; i >= 0 && board[x][i] == player; i--) count++;
-    if (count >= 4) return 1;
-    
-    count = 1;
-    for (int i = x + 1; i < BOARD_WIDTH && board[i][y] == player; i++) count++;
-    for (int i = x - 1; i >= 0 && board[i][y] == player; i--) count++;
-    if (count >= 4) return 1;
-    
-    count = 1;
-    for (int i = 1; x + i < BOARD_WIDTH && y + i < BOARD_HEIGHT && board[x + i][y + i] == player; i++) count++;
-    for (int i = 1; x - i >= 0 && y - i >= 0 && board[x - i][y - i] == player; i++) count++;
-    if (count >= 4) return 1;
-    
-    count = 1;
-    for (int i = 1; x + i < BOARD_WIDTH && y - i >= 0 && board[x + i][y - i] == player; i++) count++;
-    for (int i = 1; x - i >= 0 && y + i < BOARD_HEIGHT && board[x - i][y + i] == player; i++) count++;
-    if (count >= 4) return 1;
-    
-    return 0;
+// Writes "s<cells>\n" into buf (BOARD_MSG_LEN bytes) and returns its length
+int serialize_board(struct Room* room, char *buf) {
+    int idx = 0;
+    buf[idx++] = 's';
+    idx += game_serialize(&room->game, buf + idx);
+    buf[idx++] = '\n';
+    buf[idx] = '\0';
+    return idx;
+}
+
+// Rooms not on the classic board announce "v<name>;<cols>;<rows>;<connect>"
+// right after "r"; clients go back to the classic board on every "r"
+void send_variant(struct Room *room, int fd) {
+    const struct game_variant *v = room->game.v;
+    char msg[64];
+    if (v == GAME_CLASSIC) return;
+    snprintf(msg, sizeof(msg), "v%s;%d;%d;%d\n", v->name, v->cols, v->rows, v->connect);
+    client_write(fd, msg, strlen(msg));
 }
 
 void handle_chat(struct Room* room, long long sender_id, const char* message) {
@@ -542,39 +652,37 @@ void handle_chat(struct Room* room, long long sender_id, const char* message) {
     }
     
     char chat_msg[MAX_NAME_LEN + MAXLINE];
-    snprintf(chat_msg, sizeof(chat_msg), "c%s;%s\n", sender->name, message);
-    
-    notify_room(room->id, chat_msg);
+    int len = snprintf(chat_msg, sizeof(chat_msg), "c%s;%s\n", sender->name, message);
+    if (len >= (int)sizeof(chat_msg)) len = sizeof(chat_msg) - 1;
+
+    chat_post(room, chat_msg, len);
 }
 
 
 
 
 void handle_move(struct Room* room, long long player_id, int column) {
-    if (!room || column < 1 || column > BOARD_HEIGHT) {
-        printf("Invalid move: column out of range\n");
+    movetrace_handle();
+    if (!room || column < 1 || column > room->game.v->cols) {
+        log_event(EV_INVALID_COLUMN, -1, player_id, column, NULL);
         return;
     }
-    if (!room->is_active) {
-        printf("Game is not active\n");
+    if (!ROOM_ACTIVE(room)) {
+        log_event(EV_GAME_INACTIVE, -1, player_id, room->id, NULL);
         return;
     }
-    if (room->current_turn != player_id) {
-        printf("Not player's turn\n");
+    if (ROOM_TURN(room) != player_id) {
+        log_event(EV_NOT_TURN, -1, player_id, room->id, NULL);
         return;
     }
 
-    room->last_move_time = time(NULL);
+    ROOM_LAST_MOVE(room) = time(NULL);
     column--; // Convert to 0-based index
     
-    int row;
-    for (row = 0; row < BOARD_WIDTH; row++) {
-        if (room->board[row][column] == 0) break;
-    }
-    if (row >= BOARD_WIDTH) return;
-    
     int player_number = (player_id == room->player_1) ? 1 : 2;
-    room->board[row][column] = player_number;
+    int row = game_play(&room->game, column, player_number);
+    if (row < 0) return;
+    gamelog_move(room, column);
     
     char msg[128];
     struct Player *player1 = find_player_by_id(room->player_1);
@@ -582,52 +690,34 @@ void handle_move(struct Room* room, long long player_id, int column) {
     if (!player1 || !player2) return;
 
     // Update turn
-    room->current_turn = (room->current_turn == room->player_1) ? room->player_2 : room->player_1;
+    ROOM_TURN(room) = (ROOM_TURN(room) == room->player_1) ? room->player_2 : room->player_1;
 
     // Send turn update to players and audiences
-    snprintf(msg, sizeof(msg), "p3%lld\n", room->current_turn);
-    Writen(player1->fd, msg, strlen(msg));
-    Writen(player2->fd, msg, strlen(msg));
+    snprintf(msg, sizeof(msg), "p3%lld\n", ROOM_TURN(room));
+    client_write(player1->fd, msg, strlen(msg));
+    client_write(player2->fd, msg, strlen(msg));
     
     // For audiences, use p8 format for turn updates
-    snprintf(msg, sizeof(msg), "p8%lld\n", room->current_turn);
+    snprintf(msg, sizeof(msg), "p8%lld\n", ROOM_TURN(room));
     notify_audiences(room, msg);
 
     // Send board update to all
-    char board_msg[128] = "s";
-    int idx = 1;
-    for (int i = 0; i < BOARD_WIDTH; i++) {
-        for (int j = 0; j < BOARD_HEIGHT; j++) {
-            board_msg[idx++] = room->board[i][j] + '0';
-        }
-    }
-    board_msg[idx++] = '\n';
-    board_msg[idx] = '\0';
+    char board_msg[BOARD_MSG_LEN];
+    serialize_board(room, board_msg);
+    movetrace_serialized();
     
     // Send board state to everyone
     notify_room(room->id, board_msg);
     
     // Check win conditions
-    if (check_win(room->board, row, column)) {
+    if (game_won(&room->game, player_number)) {
         char win_msg[8];
         snprintf(win_msg, sizeof(win_msg), "e%d\n", player_number);
         notify_room(room->id, win_msg);
-        room->is_active = 0;
-    } else {
-        int is_full = 1;
-        for (int i = 0; i < BOARD_WIDTH; i++) {
-            for (int j = 0; j < BOARD_HEIGHT; j++) {
-                if (room->board[i][j] == 0) {
-                    is_full = 0;
-                    break;
-                }
-            }
-            if (!is_full) break;
-        }
-        if (is_full) {
-            notify_room(room->id, "e9\n");
-            room->is_active = 0;
-        }
+        end_game(room, player_id, GAME_END_WIN);
+    } else if (game_full(&room->game)) {
+        notify_room(room->id, "e9\n");
+        end_game(room, GAME_DRAW, GAME_END_DRAW);
     }
 }
 
@@ -638,7 +728,7 @@ void join_as_audience(long long player_id, int room_id) {
     if (!can_join_as_audience(room, player)) {
         if (player) {
             char msg[] = "wCannot join room as audience\n";
-            Writen(player->fd, msg, strlen(msg));
+            client_write(player->fd, msg, strlen(msg));
         }
         return;
     }
@@ -651,13 +741,18 @@ void join_as_audience(long long player_id, int room_id) {
         }
     }
     
+    // Chat already queued for this round belongs to the history the new
+    // member is about to receive
+    chat_flush_room(room);
     room->audience[room->audience_count++] = player_id;
+    lobby_audience_changed(room);
     player->room_id = room_id;
     
     // Send initial game state
     if (room->player_1 != -1 && room->player_2 != -1) {
         send_game_state_to_audience(player, room);
     }
+    chat_send_history(room, player->fd);
     
     // Notify everyone about updated audience count
     char msg[32];
@@ -665,18 +760,41 @@ void join_as_audience(long long player_id, int room_id) {
     notify_room(room->id, msg);
 
     char chat_msg[128];
-    snprintf(chat_msg, sizeof(chat_msg), "cSystem;New Audience Join (%s)\n", player->name);
-    notify_room(room->id, chat_msg);
+    int len = snprintf(chat_msg, sizeof(chat_msg), "cSystem;New Audience Join (%s)\n", player->name);
+    chat_post(room, chat_msg, len);
 }
 
-void handle_client_message(int fd, char *buf, ssize_t n) {
+// Returns -1 when the connection should be dropped (flooding)
+int handle_client_message(int fd, char *buf, ssize_t n) {
+    long long read_ns = monotonic_ns();
     if (n >= MAXLINE) {
-        fprintf(stderr, "Message too long from client fd=%d\n", fd);
-        return;
+        log_event(EV_MESSAGE_TOO_LONG, fd, n, 0, NULL);
+        return 0;
     }
     buf[n] = '\0';
     char *message = strtok(buf, "\n");
     while (message != NULL) {
+        long long start_ns = monotonic_ns();
+        int cmd = stat_cmd_index(message);
+        int verdict = rl_check(fd, cmd, start_ns);
+        if (verdict == RL_DISCONNECT) return -1;
+        if (verdict == RL_DROP) {
+            message = strtok(NULL, "\n");
+            continue;
+        }
+        // A session handed to another node: relay the line unchanged
+        if (cluster_forwarding(fd)) {
+            cluster_forward(fd, message);
+            message = strtok(NULL, "\n");
+            continue;
+        }
+        // A relay hosts no games: everything past naming is about watching
+        if (relay_mode && message[0] != 'n') {
+            relay_handle(fd, message);
+            stats_record_cmd(cmd, start_ns);
+            message = strtok(NULL, "\n");
+            continue;
+        }
         switch(message[0]) {
             case 'n':
                 handle_name_message(fd, message + 1);
@@ -689,28 +807,40 @@ void handle_client_message(int fd, char *buf, ssize_t n) {
                 long long player_id;
                 int room_id;
                 char action = message[1];
+
+                if (action >= '1' && action <= '4') leave_finished_room(player);
+                if (cluster_route(fd, player, action, message)) break;
                 
                 switch(action) {
                     case '1': {
                         if (waitlist.count > 0) {
                             long long opponent_id = remove_from_waitlist();
-                            room_id = create_room(opponent_id, 1); 
+                            room_id = create_room(opponent_id, 1, GAME_CLASSIC);
                             join_room(player->id, room_id);
                         } else {
                             add_to_waitlist(player->id);
                             char msg[] = "wMatching...\n";
-                            Writen(player->fd, msg, strlen(msg));
+                            client_write(player->fd, msg, strlen(msg));
                         }
                         break;
                     }
                     case '2': {
-                        room_id = create_room(player->id, 0);
+                        // m2<id>[;<variant>], the classic board by default
+                        const struct game_variant *variant = GAME_CLASSIC;
+                        const char *sep = strchr(message + 2, ';');
+                        if (sep && !(variant = game_variant_find(sep + 1))) {
+                            char msg[] = "wUnknown board variant\n";
+                            client_write(player->fd, msg, strlen(msg));
+                            break;
+                        }
+                        room_id = create_room(player->id, 0, variant);
                         if (room_id != -1) {
                             char msg[32];
                             snprintf(msg, sizeof(msg), "w%d\n", room_id);
-                            Writen(player->fd, msg, strlen(msg));
+                            client_write(player->fd, msg, strlen(msg));
                             snprintf(msg, sizeof(msg), "r%d\n", room_id);
-                            Writen(player->fd, msg, strlen(msg));
+                            client_write(player->fd, msg, strlen(msg));
+                            send_variant(find_room_by_id(room_id), player->fd);
                         }
                         break;
                     }
@@ -718,7 +848,7 @@ void handle_client_message(int fd, char *buf, ssize_t n) {
                         if (sscanf(message + 2, "%lld;%d", &player_id, &room_id) == 2) {
                             if (join_room(player_id, room_id) == -1) {
                                 char msg[] = "wRoom full or invalid\n";
-                                Writen(player->fd, msg, strlen(msg));
+                                client_write(player->fd, msg, strlen(msg));
                             }
                         }
                         break;
@@ -729,6 +859,18 @@ void handle_client_message(int fd, char *buf, ssize_t n) {
                         }
                         break;
                     }
+                    case '5': {
+                        int page = 0;
+                        if (sscanf(message + 2, "%lld;%d", &player_id, &page) < 2 || page < 0) page = 0;
+                        lobby_send_page(player->fd, page);
+                        break;
+                    }
+                    case '6': {
+                        int page = 0;
+                        if (sscanf(message + 2, "%lld;%d", &player_id, &page) < 2 || page < 0) page = 0;
+                        ratings_send_page(player, page);
+                        break;
+                    }
                 }
                 break;
             }
@@ -739,8 +881,10 @@ void handle_client_message(int fd, char *buf, ssize_t n) {
                 struct Player* player = find_player_by_id(player_id);
                 if (player && player->room_id != -1) {
                     struct Room* room = find_room_by_id(player->room_id);
-                    if (room && room->current_turn == player_id) {
+                    if (room && ROOM_TURN(room) == player_id) {
+                        movetrace_begin(room, player_id, column, read_ns);
                         handle_move(room, player_id, column);
+                        movetrace_end();
                     }
                 }
                 break;
@@ -776,19 +920,18 @@ void handle_client_message(int fd, char *buf, ssize_t n) {
                             char count_msg[32];
                             snprintf(count_msg, sizeof(count_msg), "a%d\n", room->audience_count);
                             notify_room(room->id, count_msg);
-                        } else if (room->is_active) {
+                        } else if (ROOM_ACTIVE(room)) {
                             // Handle player quitting
                             char msg[32];
                             snprintf(msg, sizeof(msg), "eQ%lld\n", player_id);
                             notify_room(player->room_id, msg);
-                            room->is_active = 0;
+                            end_game(room, room->player_1 == player_id ? room->player_2 : room->player_1, GAME_END_QUIT);
                             
                             if (room->player_1 == player_id) room->player_1 = -1;
                             if (room->player_2 == player_id) room->player_2 = -1;
                             
                             if (room->player_1 == -1 || room->player_2 == -1) {
-                                cleanup_room(room);
-                                room_status[room->id - MIN_ROOM_ID] = 0;
+                                release_room(room);
                             }
                             
                             player->room_id = -1;
@@ -799,6 +942,12 @@ void handle_client_message(int fd, char *buf, ssize_t n) {
                 break;
             }
 
+            case 't': {
+                struct Player *player = find_player_by_fd(fd);
+                if (player) tourney_handle(player, message);
+                break;
+            }
+
             case 'l': {
                 long long player_id;
                 sscanf(message + 1, "%lld", &player_id);
@@ -811,14 +960,14 @@ void handle_client_message(int fd, char *buf, ssize_t n) {
                         player->room_id = -1;
                         
                         // Just confirm menu return to the leaving player
-                        char msg[] = "w ";
-                        Writen(player->fd, msg, strlen(msg));
+                        char msg[] = "w \n";
+                        client_write(player->fd, msg, strlen(msg));
 
                         // Send leave notification if game is still active
-                        if (room->is_active) {
+                        if (ROOM_ACTIVE(room)) {
                             char chat_msg[128];
-                            snprintf(chat_msg, sizeof(chat_msg), "cSystem;Audience (%s) Left\n", player->name);
-                            notify_room(room->id, chat_msg);
+                            int len = snprintf(chat_msg, sizeof(chat_msg), "cSystem;Audience (%s) Left\n", player->name);
+                            chat_post(room, chat_msg, len);
                         }
                     }
                 }
@@ -827,63 +976,641 @@ void handle_client_message(int fd, char *buf, ssize_t n) {
 
 
             default:
-                printf("Unknown message from client: %s\n", message);
+                log_event(EV_UNKNOWN_MESSAGE, fd, 0, 0, message);
                 break;
         }
+        stats_record_cmd(cmd, start_ns);
         message = strtok(NULL, "\n");
     }
+    return 0;
 }
 
-int main(int argc, char **argv) {
-    int listenfd;
-    struct sockaddr_in servaddr;
-    struct pollfd clients[MAX_CLIENTS];
-    int maxi = 0;
+/*
+ * Hot upgrade.  The old process serializes players, rooms and the waitlist
+ * field by field (so the new binary may change struct layouts), passes the
+ * listening socket and every client socket over a socketpair with
+ * SCM_RIGHTS, and exits once the new process acknowledges the handover.
+ * Until then it keeps ownership, so a failed exec leaves it serving.
+ */
+struct snapshot {
+    char *data;
+    size_t len;
+    size_t cap;
+    size_t pos;
+};
 
-    memset(players, -1, sizeof(players));
-    memset(rooms, -1, sizeof(rooms));
-    memset(room_status, 0, sizeof(room_status));
+static void snap_put(struct snapshot *s, const void *p, size_t n) {
+    if (s->len + n > s->cap) {
+        size_t cap = s->cap ? s->cap * 2 : 4096;
+        while (cap < s->len + n) cap *= 2;
+        s->data = realloc(s->data, cap);
+        if (!s->data) err_sys("snapshot realloc error");
+        s->cap = cap;
+    }
+    memcpy(s->data + s->len, p, n);
+    s->len += n;
+}
 
-    listenfd = Socket(AF_INET, SOCK_STREAM, 0);
+static void snap_put_i64(struct snapshot *s, long long v) {
+    snap_put(s, &v, sizeof(v));
+}
 
-    bzero(&servaddr, sizeof(servaddr));
-    servaddr.sin_family = AF_INET;
-    servaddr.sin_addr.s_addr = htonl(INADDR_ANY);
-    servaddr.sin_port = htons(12345);
+static int snap_get(struct snapshot *s, void *p, size_t n) {
+    if (s->pos + n > s->len) return -1;
+    memcpy(p, s->data + s->pos, n);
+    s->pos += n;
+    return 0;
+}
 
-    Bind(listenfd, (SA *)&servaddr, sizeof(servaddr));
-    Listen(listenfd, LISTENQ);
+static int snap_get_i64(struct snapshot *s, long long *v) {
+    return snap_get(s, v, sizeof(*v));
+}
 
-    clients[0].fd = listenfd;
-    clients[0].events = POLLRDNORM;
-    for (int i = 1; i < MAX_CLIENTS; i++) clients[i].fd = -1;
+void handle_upgrade_signal(int signo) {
+    (void)signo;
+    upgrade_requested = 1;
+}
 
-    printf("Server is running on port 12345...\n");
+void handle_reload_signal(int signo) {
+    (void)signo;
+    reload_requested = 1;
+}
 
-    time_t last_timeout_check = time(NULL);
-    const int POLL_TIMEOUT = 1000;
+static void build_snapshot(struct snapshot *s) {
+    snap_put_i64(s, UPGRADE_MAGIC);
+    snap_put_i64(s, UPGRADE_VERSION);
+    snap_put_i64(s, next_id);
+    snap_put_i64(s, maxi);
+    for (int i = 1; i <= maxi; i++) snap_put_i64(s, clients[i].fd);
+
+    int nplayers = 0;
+    for (int i = 0; i < cfg.max_clients; i++) if (players[i].fd != -1) nplayers++;
+    snap_put_i64(s, nplayers);
+    for (int i = 0; i < cfg.max_clients; i++) {
+        if (players[i].fd == -1) continue;
+        snap_put_i64(s, players[i].id);
+        snap_put_i64(s, players[i].fd);
+        snap_put_i64(s, players[i].room_id);
+        snap_put_i64(s, players[i].player_number);
+        snap_put(s, players[i].name, MAX_NAME_LEN);
+    }
+
+    int nrooms = 0;
+    for (int i = 0; i < cfg.max_rooms; i++) if (room_status[i]) nrooms++;
+    snap_put_i64(s, nrooms);
+    for (int i = 0; i < cfg.max_rooms; i++) {
+        if (!room_status[i]) continue;
+        struct Room *room = &rooms[i];
+        snap_put_i64(s, room->id);
+        snap_put_i64(s, room->player_1);
+        snap_put_i64(s, room->player_2);
+        snap_put_i64(s, ROOM_TURN(room));
+        snap_put_i64(s, ROOM_ACTIVE(room));
+        snap_put_i64(s, ROOM_LAST_MOVE(room));
+        snap_put_i64(s, room->is_public);
+        snap_put_i64(s, room->vs_ai);
+        snap_put_i64(s, room->game.v - game_variants);
+        for (int x = 0; x < room->game.v->rows; x++)
+            for (int y = 0; y < room->game.v->cols; y++)
+                snap_put_i64(s, game_cell(&room->game, x, y));
+        snap_put_i64(s, room->audience_count);
+        for (int a = 0; a < room->audience_count; a++) snap_put_i64(s, room->audience[a]);
+    }
+
+    snap_put_i64(s, waitlist.count);
+    for (int i = 0; i < waitlist.count; i++) snap_put_i64(s, waitlist.players[i]);
+}
+
+static int restore_snapshot(struct snapshot *s, const int *old_fds, const int *new_fds, int nfds) {
+    long long v, count;
+
+    if (snap_get_i64(s, &v) < 0 || v != UPGRADE_MAGIC) return -1;
+    if (snap_get_i64(s, &v) < 0 || v != UPGRADE_VERSION) return -1;
+    if (snap_get_i64(s, &next_id) < 0) return -1;
+    if (snap_get_i64(s, &v) < 0 || v < 0 || v >= cfg.max_clients) return -1;
+    maxi = (int)v;
+    for (int i = 1; i <= maxi; i++) {
+        if (snap_get_i64(s, &v) < 0) return -1;
+        clients[i].fd = -1;
+        clients[i].events = POLLRDNORM;
+        for (int k = 0; k < nfds; k++) {
+            if (old_fds[k] == v) {
+                clients[i].fd = new_fds[k];
+                break;
+            }
+        }
+    }
+
+    if (snap_get_i64(s, &count) < 0 || count < 0 || count > cfg.max_clients) return -1;
+    for (int i = 0; i < count; i++) {
+        struct Player *p = &players[i];
+        long long id;
+        int fd = -1;
+        if (snap_get_i64(s, &id) < 0) return -1;
+        if (snap_get_i64(s, &v) < 0) return -1;
+        for (int k = 0; k < nfds; k++) {
+            if (old_fds[k] == v) {
+                fd = new_fds[k];
+                break;
+            }
+        }
+        if (snap_get_i64(s, &v) < 0) return -1;
+        p->room_id = (int)v;
+        if (snap_get_i64(s, &v) < 0) return -1;
+        p->player_number = (int)v;
+        if (snap_get(s, p->name, MAX_NAME_LEN) < 0) return -1;
+        p->name[MAX_NAME_LEN - 1] = '\0';
+        player_set(p, fd == -1 ? -1 : id, fd);
+    }
+
+    if (snap_get_i64(s, &count) < 0 || count < 0 || count > cfg.max_rooms) return -1;
+    for (int i = 0; i < count; i++) {
+        if (snap_get_i64(s, &v) < 0) return -1;
+        if (v < room_id_base || v >= room_id_base + cfg.max_rooms) return -1;
+        int idx = (int)v - room_id_base;
+        struct Room *room = &rooms[idx];
+        room->id = (int)v;
+        if (snap_get_i64(s, &room->player_1) < 0) return -1;
+        if (snap_get_i64(s, &room->player_2) < 0) return -1;
+        if (snap_get_i64(s, &v) < 0) return -1;
+        ROOM_TURN(room) = v;
+        if (snap_get_i64(s, &v) < 0) return -1;
+        ROOM_ACTIVE(room) = (unsigned char)v;
+        if (snap_get_i64(s, &v) < 0) return -1;
+        ROOM_LAST_MOVE(room) = (time_t)v;
+        if (snap_get_i64(s, &v) < 0) return -1;
+        room->is_public = (int)v;
+        if (snap_get_i64(s, &v) < 0) return -1;
+        room->vs_ai = (int)v;
+        // Cells come bottom row first, so replaying them rebuilds the bitboards
+        if (snap_get_i64(s, &v) < 0 || v < 0 || v >= GAME_NVARIANTS) return -1;
+        game_init(&room->game, &game_variants[v]);
+        for (int x = 0; x < room->game.v->rows; x++) {
+            for (int y = 0; y < room->game.v->cols; y++) {
+                if (snap_get_i64(s, &v) < 0) return -1;
+                if (v && game_play(&room->game, y, (int)v) != x) return -1;
+            }
+        }
+        if (snap_get_i64(s, &v) < 0 || v < 0 || v > cfg.max_audience) return -1;
+        room->audience_count = (int)v;
+        room->audience = room_alloc(room, sizeof(long long) * cfg.max_audience);
+        for (int a = 0; a < room->audience_count; a++) {
+            if (snap_get_i64(s, &room->audience[a]) < 0) return -1;
+        }
+        room_status[idx] = 1;
+    }
+
+    if (snap_get_i64(s, &count) < 0 || count < 0 || count > cfg.max_clients) return -1;
+    waitlist.count = (int)count;
+    for (int i = 0; i < waitlist.count; i++) {
+        if (snap_get_i64(s, &waitlist.players[i]) < 0) return -1;
+    }
+    return 0;
+}
+
+static int send_fds(int chan, const int *fds, int nfds) {
+    char cbuf[CMSG_SPACE(sizeof(int) * UPGRADE_FD_BATCH)];
+
+    for (int off = 0; off < nfds; off += UPGRADE_FD_BATCH) {
+        int n = nfds - off < UPGRADE_FD_BATCH ? nfds - off : UPGRADE_FD_BATCH;
+        char count = (char)n;
+        struct iovec iov = { &count, 1 };
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        memset(cbuf, 0, sizeof(cbuf));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = cbuf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * n);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * n);
+        memcpy(CMSG_DATA(cmsg), fds + off, sizeof(int) * n);
+        if (sendmsg(chan, &msg, 0) != 1) return -1;
+    }
+    return 0;
+}
+
+static int recv_fds(int chan, int *fds, int nfds) {
+    char cbuf[CMSG_SPACE(sizeof(int) * UPGRADE_FD_BATCH)];
+
+    for (int off = 0; off < nfds; ) {
+        char count;
+        struct iovec iov = { &count, 1 };
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = cbuf;
+        msg.msg_controllen = sizeof(cbuf);
+        if (recvmsg(chan, &msg, 0) != 1) return -1;
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) return -1;
+        int n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        if (n != count || off + n > nfds) return -1;
+        memcpy(fds + off, CMSG_DATA(cmsg), sizeof(int) * n);
+        off += n;
+    }
+    return 0;
+}
+
+void hot_upgrade() {
+    int sv[2];
+    // Finished games still buffered go out before the new process takes over,
+    // and the capture ends here: the new process starts its own segment
+    gamelog_flush();
+    capture_stop();
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        perror("hot upgrade: socketpair");
+        return;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("hot upgrade: fork");
+        close(sv[0]);
+        close(sv[1]);
+        return;
+    }
+    if (pid == 0) {
+        char fdarg[16];
+        close(sv[0]);
+        // The new process gets its sockets through sv[1]; inherited copies
+        // would keep connections open after it closes them
+        for (int i = 0; i <= maxi; i++) {
+            if (clients[i].fd >= 0) close(clients[i].fd);
+        }
+        snprintf(fdarg, sizeof(fdarg), "%d", sv[1]);
+        // Original arguments minus any -U of our own, then the new channel
+        int argc = 0;
+        while (server_argv[argc]) argc++;
+        char **argv = malloc(sizeof(char *) * (argc + 3));
+        int n = 0;
+        for (int i = 0; i < argc; i++) {
+            if (strcmp(server_argv[i], "-U") == 0 && i + 1 < argc) {
+                i++;
+                continue;
+            }
+            argv[n++] = server_argv[i];
+        }
+        argv[n++] = "-U";
+        argv[n++] = fdarg;
+        argv[n] = NULL;
+        execv(server_argv[0], argv);
+        perror("hot upgrade: exec");
+        _exit(127);
+    }
+    close(sv[1]);
+
+    // Listening socket first, then every live client socket in slot order
+    int *fds = malloc(sizeof(int) * cfg.max_clients);
+    int nfds = 0;
+    fds[nfds++] = listenfd;
+    for (int i = 1; i <= maxi; i++) {
+        // Links, relayed sessions and relay upstreams are not handed over:
+        // peers see the link drop and end those sessions, and the new
+        // process reconnects and resubscribes
+        if (clients[i].fd >= 0 && !stats_is_admin_conn(i) && !cluster_owns_slot(i) &&
+            !relay_owns_slot(i) && !cluster_forwarding(clients[i].fd)) {
+            fds[nfds++] = clients[i].fd;
+        }
+    }
+
+    struct snapshot snap;
+    memset(&snap, 0, sizeof(snap));
+    build_snapshot(&snap);
+
+    long long header[2] = { (long long)snap.len, nfds };
+    int ok = writen(sv[0], header, sizeof(header)) == sizeof(header) &&
+             writen(sv[0], fds, sizeof(int) * nfds) == (ssize_t)(sizeof(int) * nfds) &&
+             writen(sv[0], snap.data, snap.len) == (ssize_t)snap.len &&
+             send_fds(sv[0], fds, nfds) == 0;
+    free(snap.data);
+    free(fds);
+
+    char ack = 0;
+    if (ok) {
+        struct pollfd pfd = { sv[0], POLLIN, 0 };
+        ok = poll(&pfd, 1, UPGRADE_ACK_TIMEOUT) == 1 && read(sv[0], &ack, 1) == 1 && ack == 'k';
+    }
+    close(sv[0]);
+
+    if (ok) {
+        log_event(EV_UPGRADE_DONE, -1, pid, 0, NULL);
+        log_stop();
+        exit(0);
+    }
+
+    log_event(EV_UPGRADE_FAILED, -1, pid, 0, NULL);
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    capture_open(cfg.capture_file);
+}
+
+int restore_from_upgrade(int chan) {
+    long long header[2];
+    if (readn(chan, header, sizeof(header)) != sizeof(header)) return -1;
+    if (header[0] <= 0 || header[1] < 1 || header[1] > cfg.max_clients) return -1;
+
+    int nfds = (int)header[1];
+    int *old_fds = malloc(sizeof(int) * nfds);
+    int *new_fds = malloc(sizeof(int) * nfds);
+    struct snapshot snap;
+    memset(&snap, 0, sizeof(snap));
+    snap.len = snap.cap = (size_t)header[0];
+    snap.data = malloc(snap.len);
+
+    int rc = -1;
+    if (old_fds && new_fds && snap.data &&
+        readn(chan, old_fds, sizeof(int) * nfds) == (ssize_t)(sizeof(int) * nfds) &&
+        readn(chan, snap.data, snap.len) == (ssize_t)snap.len &&
+        recv_fds(chan, new_fds, nfds) == 0) {
+        listenfd = new_fds[0];
+        // Fails when the new config is too small for the live state
+        rc = restore_snapshot(&snap, old_fds, new_fds, nfds);
+    }
+    free(snap.data);
+    free(old_fds);
+    free(new_fds);
+    if (rc < 0) return -1;
+    lobby_rebuild();
+
+    char ack = 'k';
+    if (write(chan, &ack, 1) != 1) return -1;
+    close(chan);
+    return 0;
+}
+
+// ---- connection bookkeeping shared by the poll and io_uring loops ----
+
+/*
+ * Puts a new connection in a free slot and returns the slot. When it cannot
+ * be admitted the peer is told when to retry, the socket is closed and -1
+ * is returned. `peer` may be NULL when the caller has no address at hand.
+ */
+int add_client(int connfd, const struct sockaddr_in *peer) {
+    struct sockaddr_in addr;
+    stats.accepts++;
+    log_event(EV_CLIENT_ACCEPTED, connfd, 0, 0, NULL);
+
+    if (!peer) {
+        socklen_t len = sizeof(addr);
+        if (getpeername(connfd, (SA *)&addr, &len) == 0 && addr.sin_family == AF_INET) peer = &addr;
+    }
+
+    int slot = -1;
+    for (int i = ADMIN_SLOT + 1; i < cfg.max_clients; i++) {
+        if (clients[i].fd < 0) {
+            slot = i;
+            break;
+        }
+    }
+
+    int retry = admit_check(slot, peer);
+    if (retry > 0) {
+        stats.rejected++;
+        log_event(EV_CLIENT_REJECTED, connfd, retry, slot < 0, NULL);
+        admit_reject(connfd, retry);
+        close(connfd);
+        return -1;
+    }
+
+    clients[slot].fd = connfd;
+    clients[slot].events = POLLRDNORM;
+    rl_reset(connfd, slot);
+    admit_track(slot, peer);
+    if (slot > maxi) maxi = slot;
+    capture_accept(slot);
+    return slot;
+}
+
+// Drains up to ACCEPT_BATCH queued connections; the listening socket is non-blocking
+void accept_batch(void) {
+    for (int i = 0; i < ACCEPT_BATCH; i++) {
+        struct sockaddr_in addr;
+        socklen_t len = sizeof(addr);
+        int connfd = accept4(listenfd, (SA *)&addr, &len, SOCK_CLOEXEC);
+        if (connfd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            // EAGAIN: backlog empty. EMFILE/ENFILE: leave the rest queued
+            // until a descriptor frees up.
+            if (errno != EAGAIN && errno != EWOULDBLOCK) stats.accept_errors++;
+            break;
+        }
+        add_client(connfd, &addr);
+    }
+}
+
+void drop_client(int slot) {
+    int fd = clients[slot].fd;
+    stats.disconnects++;
+    capture_close(slot);
+    cluster_client_closed(fd);
+    relay_client_closed(fd);
+    cleanup_disconnected_client(fd);
+    if (uring_active) uring_forget(slot);
+    admit_release(slot);
+    Close(fd);
+    clients[slot].fd = -1;
+}
+
+// Rate-limit resumes and the once-a-second game timeout scan
+void server_housekeeping(void) {
+    static time_t last_timeout_check = 0;
+
+    rl_resume_paused(monotonic_ns());
+    time_t current_time = time(NULL);
+    if (current_time - last_timeout_check >= 1) {
+        check_game_timeouts();
+        tourney_housekeeping(current_time);
+        ratings_sync();
+        gamelog_flush();
+        cluster_housekeeping();
+        last_timeout_check = current_time;
+    }
+}
+
+/*
+ * The fd-indexed tables have cfg.max_fd entries, so the descriptor limit is
+ * set to exactly that: high enough for max_clients, and no descriptor can
+ * fall outside the tables.
+ */
+void raise_fd_limit(void) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) < 0) return;
+    rlim_t want = (rlim_t)cfg.max_fd;
+    if (rl.rlim_max != RLIM_INFINITY && rl.rlim_max < want) {
+        fprintf(stderr, "Descriptor limit %llu is below max_clients %d\n",
+                (unsigned long long)rl.rlim_max, cfg.max_clients);
+        want = rl.rlim_max;
+    }
+    rl.rlim_cur = want;
+    setrlimit(RLIMIT_NOFILE, &rl);
+}
+
+#ifndef SERVER_NO_MAIN
+int main(int argc, char **argv) {
+    struct sockaddr_in servaddr;
+    const char *config_file = NULL;
+    char buf[CONFIG_LINE_LEN];
+    const char *opt;
+    int upgrade_fd = -1;
+    int c;
+
+    // The short options are shorthands for -o key=value
+    while ((c = getopt(argc, argv, "c:o:p:U:L:Pb:I:R:")) != -1) {
+        opt = buf;
+        buf[0] = '\0';
+        switch (c) {
+            case 'c':
+                config_file = optarg;
+                break;
+            case 'o':
+                opt = optarg;   // build() rejects it whole if too long
+                break;
+            case 'p':
+                snprintf(buf, sizeof(buf), "port=%s", optarg);
+                break;
+            case 'b':
+                snprintf(buf, sizeof(buf), "listen_backlog=%s", optarg);
+                break;
+            case 'I':
+                snprintf(buf, sizeof(buf), "per_ip_cap=%s", optarg);
+                break;
+            case 'R':
+                snprintf(buf, sizeof(buf), "relay.upstream=%s", optarg);
+                break;
+            case 'P':
+                snprintf(buf, sizeof(buf), "io_uring=0");
+                break;
+            case 'U':
+                upgrade_fd = atoi(optarg);
+                break;
+            case 'L':
+                snprintf(buf, sizeof(buf), "log_level=%s", optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-c config_file] [-o key=value] [-p port] [-L log_level(0-3)] "
+                        "[-P] [-b backlog] [-I per_ip_cap] [-R upstream_host:port]\n", argv[0]);
+                exit(1);
+        }
+        if (opt[0] && config_override(opt) < 0) {
+            fprintf(stderr, "Too many overrides\n");
+            exit(1);
+        }
+    }
+    server_argv = argv;
+
+    if (config_load(config_file) < 0) exit(1);
+    raise_fd_limit();
+    server_init();
+    cluster_init();
+
+    if (upgrade_fd != -1) {
+        if (restore_from_upgrade(upgrade_fd) < 0) {
+            fprintf(stderr, "Hot upgrade handover failed, exiting\n");
+            exit(1);
+        }
+        adminfd = clients[ADMIN_SLOT].fd;
+        for (int i = ADMIN_SLOT + 1; i <= maxi; i++) {
+            if (clients[i].fd < 0 || stats_is_admin_conn(i)) continue;
+            struct sockaddr_in addr;
+            socklen_t len = sizeof(addr);
+            rl_reset(clients[i].fd, i);
+            if (getpeername(clients[i].fd, (SA *)&addr, &len) == 0) admit_track(i, &addr);
+        }
+        printf("Server resumed from hot upgrade (%d clients)\n", maxi);
+    } else {
+        listenfd = Socket(AF_INET, SOCK_STREAM, 0);
+        // A restart must not wait out TIME_WAIT from the previous instance
+        int on = 1;
+        setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+        bzero(&servaddr, sizeof(servaddr));
+        servaddr.sin_family = AF_INET;
+        servaddr.sin_addr.s_addr = htonl(INADDR_ANY);
+        servaddr.sin_port = htons(cfg.port);
+
+        Bind(listenfd, (SA *)&servaddr, sizeof(servaddr));
+        Listen(listenfd, cfg.listen_backlog);
+        printf("Server is running on port %d (%d clients, %d rooms)...\n",
+               cfg.port, cfg.max_clients, cfg.max_rooms);
+
+        // Metrics for scraping, loopback only; the server runs without it
+        // if the port is taken
+        adminfd = cfg.admin_port ? stats_open_listener(cfg.admin_port) : -1;
+        if (adminfd < 0 && cfg.admin_port) {
+            fprintf(stderr, "Admin port %d unavailable, stats endpoint disabled\n", cfg.admin_port);
+        } else if (adminfd >= 0) {
+            printf("Stats endpoint on 127.0.0.1:%d\n", cfg.admin_port);
+        }
+        clients[ADMIN_SLOT].fd = adminfd;
+        clients[ADMIN_SLOT].events = POLLRDNORM;
+        maxi = ADMIN_SLOT;
+    }
+    // After the restore, so watchers handed over resubscribe
+    relay_init();
+    // Also after it: the old process has appended its last results by now,
+    // and restored players and rooms are linked back to their identities
+    if (!relay_mode && ratings_open(cfg.ratings_file) < 0) {
+        fprintf(stderr, "Ratings file %s unusable, ratings kept in memory\n", cfg.ratings_file);
+    }
+    if (!relay_mode && gamelog_open(cfg.gamelog_file) < 0) {
+        fprintf(stderr, "Game log %s unusable, games not recorded\n", cfg.gamelog_file);
+    }
+    // Last of all, so clients handed over by an upgrade are in the trace
+    if (capture_open(cfg.capture_file) < 0) {
+        fprintf(stderr, "Capture file %s unusable, traffic not captured\n", cfg.capture_file);
+    }
+
+    clients[0].fd = listenfd;
+    clients[0].events = POLLRDNORM;
+    // accept_batch() drains the backlog until EAGAIN
+    fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL, 0) | O_NONBLOCK);
+
+    signal(SIGPIPE, SIG_IGN);
+    fflush(stdout);
+    log_start(stdout);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_upgrade_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR2, &sa, NULL);
+    sa.sa_handler = handle_reload_signal;
+    sigaction(SIGHUP, &sa, NULL);
+
+    cluster_housekeeping();
+
+    if (cfg.io_uring && uring_init() == 0) {
+        log_event(EV_IO_BACKEND, -1, 0, 0, "io_uring");
+        uring_run();
+    }
+    log_event(EV_IO_BACKEND, -1, 0, 0, "poll");
 
     while (1) {
-        int nready = Poll(clients, maxi + 1, POLL_TIMEOUT);
-        time_t current_time = time(NULL);
-        if (current_time - last_timeout_check >= 1) {
-            check_game_timeouts();
-            last_timeout_check = current_time;
+        // Results of the previous round, then its batched chat
+        tourney_flush();
+        chat_flush_pending();
+        cluster_flush();
+        if (upgrade_requested) {
+            upgrade_requested = 0;
+            hot_upgrade();
+        }
+        if (reload_requested) {
+            reload_requested = 0;
+            config_reload();
         }
+        int nready = poll(clients, maxi + 1, cfg.poll_timeout_ms);
+        if (nready < 0) {
+            if (errno == EINTR) continue;
+            err_sys("poll error");
+        }
+        server_housekeeping();
 
         if (clients[0].revents & POLLRDNORM) {
-            int connfd = Accept(listenfd, NULL, NULL);
-            printf("New client connected (fd=%d)\n", connfd);
-
-            int i;
-            for (i = 1; i < MAX_CLIENTS; i++) {
-                if (clients[i].fd < 0) {
-                    clients[i].fd = connfd;
-                    clients[i].events = POLLRDNORM;
-                    if (i > maxi) maxi = i;
-                    break;
-                }
-            }
+            accept_batch();
             if (--nready <= 0) continue;
         }
 
@@ -891,15 +1618,26 @@ int main(int argc, char **argv) {
             int sockfd = clients[i].fd;
             if (sockfd < 0) continue;
 
-            if (clients[i].revents & (POLLRDNORM | POLLERR)) {
-                char buf[MAXLINE];
-                ssize_t n = read(sockfd, buf, MAXLINE);
-                if (n <= 0) {
-                    cleanup_disconnected_client(sockfd);
-                    Close(sockfd);
-                    clients[i].fd = -1;
+            // Only cluster links ask for POLLWRNORM, while they have output queued
+            if (clients[i].revents & (POLLRDNORM | POLLWRNORM | POLLERR)) {
+                if (i == ADMIN_SLOT) {
+                    stats_accept();
+                } else if (cluster_owns_slot(i)) {
+                    cluster_serve(i);
+                } else if (relay_owns_slot(i)) {
+                    relay_serve(i);
+                } else if (stats_is_admin_conn(i)) {
+                    stats_serve(i);
                 } else {
-                    handle_client_message(sockfd, buf, n);
+                    char buf[MAXLINE];
+                    ssize_t n = read(sockfd, buf, MAXLINE);
+                    if (n > 0) {
+                        stats.bytes_in += n;
+                        capture_data(i, buf, (int)n);
+                    }
+                    if (n <= 0 || handle_client_message(sockfd, buf, n) < 0) {
+                        drop_client(i);
+                    }
                 }
                 if (--nready <= 0) break;
             }
@@ -907,3 +1645,4 @@ int main(int argc, char **argv) {
     }
     return 0;
 }
+#endif
@@ -0,0 +1,136 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "unp.h"
+#include <time.h>
+#include <signal.h>
+#include <poll.h>
+
+#include "game.h"
+
+#define MAX_NAME_LEN 32
+#define MAXLINE 4096
+
+// Room ids run from room_id_base to room_id_base + cfg.max_rooms - 1. In a
+// cluster every node has its own range, CLUSTER_ROOM_STRIDE apart.
+#define MIN_ROOM_ID 1001
+extern int room_id_base;
+
+// Length of an "s<board>\n" frame including the terminating NUL, for the largest variant
+#define BOARD_MSG_LEN (GAME_MAX_ROWS * GAME_MAX_COLS + 3)
+
+struct Player {
+    long long id;
+    char name[MAX_NAME_LEN];
+    int room_id;
+    int fd;
+    int player_number;
+    int rating;           // identity in ratings.c, -1 for none
+};
+
+struct Room {
+    int id;
+    long long player_1;
+    long long player_2;
+    struct game game;     // board and variant
+    int is_public;
+    int audience_count;
+    int vs_ai;
+    long long *audience;
+    int rated[2];         // identities seated when the game started (ratings.c)
+    // Lobby indexes (lobby.c)
+    int wait_prev;
+    int wait_next;
+    int in_waiting;
+    int heap_pos;
+};
+
+#include "config.h"
+
+struct waiting_list {
+    long long *players;   // cfg.max_clients entries
+    int count;
+};
+
+// Pools below are allocated by server_init() from cfg
+extern struct waiting_list waitlist;
+extern struct Player *players;
+extern struct Room *rooms;
+extern unsigned char *room_status;
+extern long long next_id;
+
+/*
+ * Hot fields are kept out of struct Room and struct Player in packed,
+ * cache-line aligned arrays indexed by slot. The timeout scan, turn checks
+ * and player lookups walk only these arrays: one 64-byte line holds the
+ * active flags of 64 rooms, or the fds of 16 players.
+ */
+extern long long *room_turn;
+extern time_t *room_last_move;
+extern unsigned char *room_active;
+
+#define ROOM_SLOT(room) ((int)((room) - rooms))
+#define ROOM_TURN(room) room_turn[ROOM_SLOT(room)]
+#define ROOM_LAST_MOVE(room) room_last_move[ROOM_SLOT(room)]
+#define ROOM_ACTIVE(room) room_active[ROOM_SLOT(room)]
+
+// Mirrors of players[i].id and players[i].fd, written only by player_set()
+extern long long *player_ids;
+extern int *player_fds;
+
+void player_set(struct Player* p, long long id, int fd);
+void clear_players(void);
+
+extern int listenfd;
+extern struct pollfd *clients;
+extern int maxi;
+
+void *pool_alloc(size_t n, size_t size);
+void server_init(void);
+
+void client_write(int fd, const void *buf, size_t len);
+
+extern volatile sig_atomic_t upgrade_requested;
+void hot_upgrade(void);
+int add_client(int connfd, const struct sockaddr_in *peer);
+void accept_batch(void);
+void drop_client(int slot);
+void server_housekeeping(void);
+
+struct Player* find_player_by_id(long long id);
+struct Player* find_player_by_fd(int fd);
+struct Room* find_room_by_id(int room_id);
+struct Room* find_waiting_public_room();
+
+int create_room(long long player_id, int is_public, const struct game_variant *variant);
+int join_room(long long player_id, int room_id);
+void join_as_audience(long long player_id, int room_id);
+void remove_audience_member(struct Room* room, long long player_id);
+void cleanup_room(struct Room* room);
+void release_room(struct Room* room);
+void leave_finished_room(struct Player* player);
+// end_game() results besides a winner's player id
+#define GAME_DRAW 0
+#define GAME_NO_RESULT -1
+
+void end_game(struct Room* room, long long winner, int reason);   // reason: GAME_END_* (gamelog.h)
+void cleanup_disconnected_client(int fd);
+
+void notify_room(int room_id, const char* message);
+void notify_opponent(int room_id, const char* message);
+void notify_audiences(struct Room* room, const char* message);
+void send_game_state_to_players(struct Room* room);
+void send_game_state_to_audience(struct Player* audience, struct Room* room);
+
+void init_waiting_list();
+void add_to_waitlist(long long player_id);
+void waitlist_remove(long long player_id);
+long long remove_from_waitlist();
+
+int serialize_board(struct Room* room, char *buf);
+void send_variant(struct Room *room, int fd);
+void handle_move(struct Room* room, long long player_id, int column);
+void handle_chat(struct Room* room, long long sender_id, const char* message);
+int handle_client_message(int fd, char *buf, ssize_t n);
+
+#endif
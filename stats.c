@@ -0,0 +1,205 @@
+#include "server.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "stats.h"
+#include "tourney.h"
+#include "ratings.h"
+#include "capture.h"
+#include "movetrace.h"
+
+struct server_stats stats;
+int adminfd = -1;
+
+// Client slots currently holding a connection to the admin port
+static char *admin_conn;
+
+const char *stat_cmd_names[STAT_CMD_COUNT] = {
+    "n", "m1", "m2", "m3", "m4", "s", "c", "q", "l", "other"
+};
+
+// Upper bounds (seconds) of the exported histogram buckets
+static const double latency_buckets[] = {
+    1e-6, 2.5e-6, 5e-6, 1e-5, 2.5e-5, 5e-5, 1e-4, 2.5e-4, 5e-4, 1e-3, 2.5e-3, 5e-3, 1e-2, 1e-1
+};
+#define NUM_LATENCY_BUCKETS (int)(sizeof(latency_buckets) / sizeof(latency_buckets[0]))
+
+void stats_init(void) {
+    memset(&stats, 0, sizeof(stats));
+    for (int i = 0; i < STAT_CMD_COUNT; i++) hist_init(&stats.cmd_latency[i]);
+    admin_conn = pool_alloc(cfg.max_clients, 1);
+}
+
+int stat_cmd_index(const char *message) {
+    switch (message[0]) {
+        case 'n': return STAT_CMD_N;
+        case 'm':
+            switch (message[1]) {
+                case '1': return STAT_CMD_M1;
+                case '2': return STAT_CMD_M2;
+                case '3': return STAT_CMD_M3;
+                case '4': return STAT_CMD_M4;
+            }
+            return STAT_CMD_OTHER;
+        case 's': return STAT_CMD_S;
+        case 'c': return STAT_CMD_C;
+        case 'q': return STAT_CMD_Q;
+        case 'l': return STAT_CMD_L;
+    }
+    return STAT_CMD_OTHER;
+}
+
+int stats_open_listener(int port) {
+    struct sockaddr_in addr;
+    int on = 1;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    bzero(&addr, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(fd, (SA *)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void stats_accept(void) {
+    int connfd = accept(adminfd, NULL, NULL);
+    if (connfd < 0) return;
+    for (int i = ADMIN_SLOT + 1; i < cfg.max_clients; i++) {
+        if (clients[i].fd < 0) {
+            clients[i].fd = connfd;
+            clients[i].events = POLLRDNORM;
+            admin_conn[i] = 1;
+            if (i > maxi) maxi = i;
+            return;
+        }
+    }
+    close(connfd);
+}
+
+int stats_is_admin_conn(int slot) {
+    return admin_conn[slot];
+}
+
+// Answers one request and closes: /tourney..., /ratings... and /moves go to
+// those modules' admin, any other path gets the metrics
+void stats_serve(int slot) {
+    static char body[65536];
+    char req[1024];
+    char header[160];
+    int fd = clients[slot].fd;
+    ssize_t n = read(fd, req, sizeof(req) - 1);
+
+    if (n > 0) {
+        req[n] = '\0';
+        char *path = strchr(req, ' ');
+        int len;
+        if (path && strncmp(path + 1, "/tourney", 8) == 0) len = tourney_admin(path + 1, body, sizeof(body));
+        else if (path && strncmp(path + 1, "/ratings", 8) == 0) len = ratings_admin(path + 1, body, sizeof(body));
+        else if (path && strncmp(path + 1, "/moves", 6) == 0) len = movetrace_admin(path + 1, body, sizeof(body));
+        else len = stats_render(body, sizeof(body));
+        int hlen = snprintf(header, sizeof(header),
+                            "HTTP/1.0 200 OK\r\n"
+                            "Content-Type: text/plain; version=0.0.4\r\n"
+                            "Content-Length: %d\r\n\r\n", len);
+        if (send(fd, header, hlen, MSG_NOSIGNAL) == hlen) {
+            send(fd, body, len, MSG_NOSIGNAL);
+        }
+    }
+    close(fd);
+    clients[slot].fd = -1;
+    admin_conn[slot] = 0;
+}
+
+// A full body stays at size - 1: what vsnprintf() wrote, without its NUL
+int stats_append(char *buf, size_t size, int len, const char *fmt, ...) {
+    va_list ap;
+    if (len >= (int)size - 1) return len;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf + len, size - len, fmt, ap);
+    va_end(ap);
+    if (n < 0) return len;
+    return len + n < (int)size ? len + n : (int)size - 1;
+}
+
+int stats_render(char *buf, size_t size) {
+    int len = 0;
+    int active_rooms = 0, active_games = 0, spectators = 0, connected = 0;
+
+    for (int i = 0; i < cfg.max_rooms; i++) {
+        if (!room_status[i]) continue;
+        active_rooms++;
+        if (room_active[i]) active_games++;
+        spectators += rooms[i].audience_count;
+    }
+    for (int i = 0; i < cfg.max_clients; i++) {
+        if (players[i].fd != -1) connected++;
+    }
+
+    len = stats_append(buf, size, len, "# TYPE connect4_command_duration_seconds histogram\n");
+    for (int c = 0; c < STAT_CMD_COUNT; c++) {
+        const struct histogram *h = &stats.cmd_latency[c];
+        unsigned long long cumulative = 0;
+        int bucket = 0;
+        for (int b = 0; b < NUM_LATENCY_BUCKETS; b++) {
+            unsigned long long limit_ns = (unsigned long long)(latency_buckets[b] * 1e9);
+            while (bucket < HIST_BUCKETS && hist_bucket_limit(bucket) <= limit_ns) {
+                cumulative += h->counts[bucket++];
+            }
+            len = stats_append(buf, size, len, "connect4_command_duration_seconds_bucket{cmd=\"%s\",le=\"%g\"} %llu\n",
+                               stat_cmd_names[c], latency_buckets[b], cumulative);
+        }
+        len = stats_append(buf, size, len, "connect4_command_duration_seconds_bucket{cmd=\"%s\",le=\"+Inf\"} %llu\n",
+                           stat_cmd_names[c], h->total);
+        len = stats_append(buf, size, len, "connect4_command_duration_seconds_sum{cmd=\"%s\"} %.9f\n",
+                           stat_cmd_names[c], h->sum / 1e9);
+        len = stats_append(buf, size, len, "connect4_command_duration_seconds_count{cmd=\"%s\"} %llu\n",
+                           stat_cmd_names[c], h->total);
+    }
+
+    len = stats_append(buf, size, len, "# TYPE connect4_received_bytes_total counter\n");
+    len = stats_append(buf, size, len, "connect4_received_bytes_total %llu\n", stats.bytes_in);
+    len = stats_append(buf, size, len, "# TYPE connect4_sent_bytes_total counter\n");
+    len = stats_append(buf, size, len, "connect4_sent_bytes_total %llu\n", stats.bytes_out);
+    len = stats_append(buf, size, len, "# TYPE connect4_writes_total counter\n");
+    len = stats_append(buf, size, len, "connect4_writes_total %llu\n", stats.writes);
+    len = stats_append(buf, size, len, "# TYPE connect4_write_errors_total counter\n");
+    len = stats_append(buf, size, len, "connect4_write_errors_total %llu\n", stats.write_errors);
+    len = stats_append(buf, size, len, "# TYPE connect4_accepts_total counter\n");
+    len = stats_append(buf, size, len, "connect4_accepts_total %llu\n", stats.accepts);
+    len = stats_append(buf, size, len, "# TYPE connect4_accept_errors_total counter\n");
+    len = stats_append(buf, size, len, "connect4_accept_errors_total %llu\n", stats.accept_errors);
+    len = stats_append(buf, size, len, "# TYPE connect4_rejected_total counter\n");
+    len = stats_append(buf, size, len, "connect4_rejected_total %llu\n", stats.rejected);
+    len = stats_append(buf, size, len, "# TYPE connect4_disconnects_total counter\n");
+    len = stats_append(buf, size, len, "connect4_disconnects_total %llu\n", stats.disconnects);
+    len = stats_append(buf, size, len, "# TYPE connect4_ratelimit_dropped_total counter\n");
+    len = stats_append(buf, size, len, "connect4_ratelimit_dropped_total %llu\n", stats.rl_dropped);
+    len = stats_append(buf, size, len, "# TYPE connect4_ratelimit_paused_total counter\n");
+    len = stats_append(buf, size, len, "connect4_ratelimit_paused_total %llu\n", stats.rl_paused);
+    len = stats_append(buf, size, len, "# TYPE connect4_ratelimit_disconnected_total counter\n");
+    len = stats_append(buf, size, len, "connect4_ratelimit_disconnected_total %llu\n", stats.rl_disconnected);
+    len = stats_append(buf, size, len, "# TYPE connect4_relay_chat_dropped_total counter\n");
+    len = stats_append(buf, size, len, "connect4_relay_chat_dropped_total %llu\n", stats.relay_chat_dropped);
+    len = stats_append(buf, size, len, "# TYPE connect4_capture_events_total counter\n");
+    len = stats_append(buf, size, len, "connect4_capture_events_total %llu\n", capture_events());
+    len = stats_append(buf, size, len, "# TYPE connect4_capture_dropped_total counter\n");
+    len = stats_append(buf, size, len, "connect4_capture_dropped_total %llu\n", capture_dropped());
+
+    len = stats_append(buf, size, len, "# TYPE connect4_players_connected gauge\n");
+    len = stats_append(buf, size, len, "connect4_players_connected %d\n", connected);
+    len = stats_append(buf, size, len, "# TYPE connect4_rooms_active gauge\n");
+    len = stats_append(buf, size, len, "connect4_rooms_active %d\n", active_rooms);
+    len = stats_append(buf, size, len, "# TYPE connect4_games_active gauge\n");
+    len = stats_append(buf, size, len, "connect4_games_active %d\n", active_games);
+    len = stats_append(buf, size, len, "# TYPE connect4_spectators gauge\n");
+    len = stats_append(buf, size, len, "connect4_spectators %d\n", spectators);
+    len = stats_append(buf, size, len, "# TYPE connect4_waitlist_depth gauge\n");
+    len = stats_append(buf, size, len, "connect4_waitlist_depth %d\n", waitlist.count);
+    return len;
+}
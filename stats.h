@@ -0,0 +1,62 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "histogram.h"
+
+#define ADMIN_SLOT 1
+
+// Command classes timed in handle_client_message()
+enum stat_cmd {
+    STAT_CMD_N,
+    STAT_CMD_M1,
+    STAT_CMD_M2,
+    STAT_CMD_M3,
+    STAT_CMD_M4,
+    STAT_CMD_S,
+    STAT_CMD_C,
+    STAT_CMD_Q,
+    STAT_CMD_L,
+    STAT_CMD_OTHER,
+    STAT_CMD_COUNT
+};
+
+/*
+ * Everything here is touched only by the event loop thread, so counters
+ * are plain fields; the admin endpoint renders them from the same thread.
+ */
+struct server_stats {
+    struct histogram cmd_latency[STAT_CMD_COUNT];
+    unsigned long long bytes_in;
+    unsigned long long bytes_out;
+    unsigned long long writes;
+    unsigned long long write_errors;
+    unsigned long long accepts;
+    unsigned long long accept_errors;
+    unsigned long long rejected;
+    unsigned long long disconnects;
+    unsigned long long rl_dropped;
+    unsigned long long rl_paused;
+    unsigned long long rl_disconnected;
+    unsigned long long relay_chat_dropped;
+};
+
+extern struct server_stats stats;
+extern int adminfd;
+extern const char *stat_cmd_names[STAT_CMD_COUNT];   // also the ratelimit.<name> config keys
+
+void stats_init(void);
+int stat_cmd_index(const char *message);
+
+static inline void stats_record_cmd(int cmd, long long start_ns) {
+    hist_record(&stats.cmd_latency[cmd], (unsigned long long)(monotonic_ns() - start_ns));
+}
+
+int stats_open_listener(int port);
+void stats_accept(void);
+int stats_is_admin_conn(int slot);
+void stats_serve(int slot);
+int stats_render(char *buf, size_t size);
+// printf onto an admin response body at len; returns the new length
+int stats_append(char *buf, size_t size, int len, const char *fmt, ...);
+
+#endif
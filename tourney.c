@@ -0,0 +1,672 @@
+#include "server.h"
+#include <string.h>
+#include <stdarg.h>
+#include "tourney.h"
+#include "stats.h"
+#include "logger.h"
+
+struct entrant {
+    long long player_id;
+    int pslot;                 // index into players[], checked against the id
+    char name[MAX_NAME_LEN];
+    int points;                // half points: win 2, draw 1, bye 2
+    int whites;                // games played in player 1's seat
+    int out;                   // knocked out or withdrawn
+    int had_bye;
+    int dirty;
+    int *opponents;            // entrant per round, -1 for a bye
+};
+
+struct match {
+    int a, b;                  // entrants; a sits in player 1's seat
+    int room_slot;             // -1 until seated and after the result
+    int pending;               // waiting for a free room
+};
+
+struct tourney {
+    int id;                    // 0 for a free slot
+    int format;
+    int state;
+    int capacity;
+    int rounds;
+    int round;                 // 1-based once running
+    const struct game_variant *variant;
+    time_t start_at;           // 0: start when full
+
+    struct entrant *entrants;
+    int nentrants;
+    struct match *matches;
+    int nmatches;
+    int games_left;            // matches of this round without a result
+    int unseated;              // matches waiting for a room
+    long long *watchers;       // cfg.max_clients entries
+    int nwatchers;
+
+    int *dirty;                // entrants whose line changed since the last flush
+    int ndirty;
+    int queued;                // on the flush list
+};
+
+static struct tourney tourneys[TOURNEY_MAX];
+static int next_tourney_id = 1;
+static int flush_list[TOURNEY_MAX];
+static int flush_count = 0;
+
+// Room slot -> tournament and match, -1 for ordinary rooms
+static int *room_tourney;
+static int *room_match;
+
+static const char *format_names[] = { "swiss", "knockout" };
+static const char *state_names[] = { "open", "running", "done" };
+
+void tourney_init(void) {
+    room_tourney = pool_alloc(cfg.max_rooms, sizeof(int));
+    room_match = pool_alloc(cfg.max_rooms, sizeof(int));
+    for (int i = 0; i < cfg.max_rooms; i++) room_tourney[i] = -1;
+}
+
+static struct tourney *find_tourney(int id) {
+    if (id <= 0) return NULL;
+    for (int i = 0; i < TOURNEY_MAX; i++) {
+        if (tourneys[i].id == id) return &tourneys[i];
+    }
+    return NULL;
+}
+
+static void queue_flush(struct tourney *t) {
+    if (t->queued) return;
+    t->queued = 1;
+    flush_list[flush_count++] = (int)(t - tourneys);
+}
+
+static void mark_dirty(struct tourney *t, int e) {
+    if (t->entrants[e].dirty) return;
+    t->entrants[e].dirty = 1;
+    t->dirty[t->ndirty++] = e;
+    queue_flush(t);
+}
+
+static struct Player *entrant_player(struct entrant *e) {
+    struct Player *p = &players[e->pslot];
+    return p->id == e->player_id && p->fd != -1 ? p : NULL;
+}
+
+static void send_line(int fd, const char *fmt, ...) {
+    char line[MAXLINE];
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (len >= (int)sizeof(line)) len = sizeof(line) - 1;
+    client_write(fd, line, len);
+}
+
+// One write of the same batch to every entrant still connected and every watcher
+static void broadcast(struct tourney *t, const char *batch, size_t len) {
+    for (int i = 0; i < t->nentrants; i++) {
+        struct Player *p = entrant_player(&t->entrants[i]);
+        if (p) client_write(p->fd, batch, len);
+    }
+    for (int i = 0; i < t->nwatchers; i++) {
+        struct Player *p = find_player_by_id(t->watchers[i]);
+        if (p) client_write(p->fd, batch, len);
+    }
+}
+
+static void send_info(struct tourney *t, int fd) {
+    send_line(fd, "To%d;%s;%d;%d;%s;%d;%s\n", t->id, format_names[t->format], t->rounds,
+              t->capacity, t->variant->name, t->nentrants, state_names[t->state]);
+}
+
+static void free_tourney(struct tourney *t) {
+    for (int i = 0; i < t->capacity; i++) free(t->entrants[i].opponents);
+    free(t->entrants);
+    free(t->matches);
+    free(t->watchers);
+    free(t->dirty);
+    memset(t, 0, sizeof(*t));
+}
+
+static int open_tourney(int format, int capacity, int rounds, const struct game_variant *v, int start_in) {
+    struct tourney *t = NULL;
+    for (int i = 0; i < TOURNEY_MAX && !t; i++) {
+        if (tourneys[i].id == 0) t = &tourneys[i];
+    }
+    // A finished event keeps its slot for the listing until one is needed
+    for (int i = 0; i < TOURNEY_MAX && !t; i++) {
+        if (tourneys[i].state == TOURNEY_DONE && !tourneys[i].queued) {
+            free_tourney(&tourneys[i]);
+            t = &tourneys[i];
+        }
+    }
+    if (!t) return -1;
+
+    t->id = next_tourney_id++;
+    t->format = format;
+    t->state = TOURNEY_OPEN;
+    t->capacity = capacity;
+    t->rounds = rounds;
+    if (format == TOURNEY_KNOCKOUT) {
+        // Length follows the field; start_tourney() recounts once it closes
+        t->rounds = 0;
+        while ((1 << t->rounds) < capacity) t->rounds++;
+    }
+    t->variant = v;
+    t->start_at = start_in > 0 ? time(NULL) + start_in : 0;
+    t->entrants = calloc(capacity, sizeof(struct entrant));
+    t->matches = calloc(capacity / 2 + 1, sizeof(struct match));
+    t->watchers = calloc(cfg.max_clients, sizeof(long long));
+    t->dirty = calloc(capacity, sizeof(int));
+    if (!t->entrants || !t->matches || !t->watchers || !t->dirty) err_sys("tourney alloc");
+    return t->id;
+}
+
+// ---- pairing ----
+
+static struct tourney *sort_t;
+
+// Score groups, then seed (sign-up order)
+static int by_standing(const void *x, const void *y) {
+    int a = *(const int *)x, b = *(const int *)y;
+    int pa = sort_t->entrants[a].points, pb = sort_t->entrants[b].points;
+    if (pa != pb) return pb - pa;
+    return a - b;
+}
+
+static int have_met(struct tourney *t, int a, int b) {
+    for (int r = 0; r < t->round - 1; r++) {
+        if (t->entrants[a].opponents[r] == b) return 1;
+    }
+    return 0;
+}
+
+static void add_match(struct tourney *t, int a, int b) {
+    // The side with fewer games as player 1 takes that seat
+    if (t->entrants[b].whites < t->entrants[a].whites) {
+        int tmp = a;
+        a = b;
+        b = tmp;
+    }
+    struct match *m = &t->matches[t->nmatches++];
+    m->a = a;
+    m->b = b;
+    m->room_slot = -1;
+    m->pending = 1;
+    t->entrants[a].opponents[t->round - 1] = b;
+    t->entrants[b].opponents[t->round - 1] = a;
+    t->games_left++;
+    t->unseated++;
+}
+
+static void give_bye(struct tourney *t, int e) {
+    struct Player *p = entrant_player(&t->entrants[e]);
+    t->entrants[e].opponents[t->round - 1] = -1;
+    t->entrants[e].had_bye = 1;
+    t->entrants[e].points += 2;
+    mark_dirty(t, e);
+    if (p) send_line(p->fd, "Tb%d;%d\n", t->id, t->round);
+}
+
+static void pair_swiss(struct tourney *t, int *order, int n) {
+    sort_t = t;
+    qsort(order, n, sizeof(int), by_standing);
+
+    if (n % 2) {
+        // The lowest-placed entrant without a bye sits out
+        int pick = n - 1;
+        for (int i = n - 1; i >= 0; i--) {
+            if (!t->entrants[order[i]].had_bye) {
+                pick = i;
+                break;
+            }
+        }
+        give_bye(t, order[pick]);
+        memmove(order + pick, order + pick + 1, sizeof(int) * (n - pick - 1));
+        n--;
+    }
+
+    // Down the table: the nearest entrant not met yet, else the nearest
+    for (int i = 0; i < n; i++) {
+        if (order[i] < 0) continue;
+        int a = order[i], partner = -1;
+        for (int j = i + 1; j < n; j++) {
+            if (order[j] < 0) continue;
+            if (partner < 0) partner = j;
+            if (!have_met(t, a, order[j])) {
+                partner = j;
+                break;
+            }
+        }
+        if (partner < 0) break;
+        add_match(t, a, order[partner]);
+        order[i] = order[partner] = -1;
+    }
+}
+
+static void pair_knockout(struct tourney *t, int *order, int n) {
+    // order[] is already in seed order; the top seed gets any bye
+    int lo = 0, hi = n - 1;
+    if (n % 2) give_bye(t, order[lo++]);
+    while (lo < hi) add_match(t, order[lo++], order[hi--]);
+}
+
+// A player is seated only if not in another live game; anything else
+// they were doing (queueing, watching, a finished room) is left behind
+static int free_for_game(struct Player *p) {
+    waitlist_remove(p->id);
+    leave_finished_room(p);
+    if (p->room_id == -1) return 1;
+    struct Room *room = find_room_by_id(p->room_id);
+    if (!room) {
+        p->room_id = -1;
+        return 1;
+    }
+    if (room->player_1 == p->id || room->player_2 == p->id) return 0;
+    remove_audience_member(room, p->id);
+    p->room_id = -1;
+    return 1;
+}
+
+static void record_result(struct tourney *t, struct match *m, long long winner);
+
+// Returns 0 when no room is free; the match stays pending for the next flush
+static int seat_match(struct tourney *t, int mi) {
+    struct match *m = &t->matches[mi];
+    struct entrant *ea = &t->entrants[m->a], *eb = &t->entrants[m->b];
+    struct Player *pa = entrant_player(ea), *pb = entrant_player(eb);
+
+    if (pa && !free_for_game(pa)) pa = NULL;
+    if (pb && !free_for_game(pb)) pb = NULL;
+    if (!pa || !pb) {
+        // A missing player forfeits
+        m->pending = 0;
+        t->unseated--;
+        record_result(t, m, pa ? ea->player_id : pb ? eb->player_id : GAME_NO_RESULT);
+        return 1;
+    }
+
+    int room_id = create_room(pa->id, 0, t->variant);
+    if (room_id == -1) return 0;
+    join_room(pb->id, room_id);
+
+    int slot = room_id - room_id_base;
+    room_tourney[slot] = (int)(t - tourneys);
+    room_match[slot] = mi;
+    m->room_slot = slot;
+    m->pending = 0;
+    t->unseated--;
+    ea->whites++;
+    send_line(pa->fd, "Tm%d;%d;%d;%s\n", t->id, t->round, room_id, eb->name);
+    send_line(pb->fd, "Tm%d;%d;%d;%s\n", t->id, t->round, room_id, ea->name);
+    return 1;
+}
+
+// Entrants sitting in finished games give up their seats; returns 1 if any did
+static int vacate_finished(struct tourney *t) {
+    int vacated = 0;
+    for (int i = 0; i < t->nentrants; i++) {
+        struct Player *p = entrant_player(&t->entrants[i]);
+        if (!p || p->room_id == -1) continue;
+        leave_finished_room(p);
+        if (p->room_id == -1) vacated = 1;
+    }
+    return vacated;
+}
+
+// Out of rooms, the rest wait for tourney_housekeeping() to queue another try
+static void seat_pending(struct tourney *t) {
+    int vacated = 0;
+    for (int i = 0; i < t->nmatches && t->unseated > 0; i++) {
+        if (!t->matches[i].pending || seat_match(t, i)) continue;
+        // Our own finished games hold rooms until the next round; free them first
+        if (vacated || !vacate_finished(t)) break;
+        vacated = 1;
+        i--;
+    }
+}
+
+static void finish(struct tourney *t);
+
+static void start_round(struct tourney *t) {
+    int *order = malloc(sizeof(int) * (t->nentrants ? t->nentrants : 1));
+    int n = 0;
+    if (!order) err_sys("tourney alloc");
+
+    for (int i = 0; i < t->nentrants; i++) {
+        struct entrant *e = &t->entrants[i];
+        if (e->out) continue;
+        // Whoever left since the last round is out of the pairing
+        if (!entrant_player(e)) {
+            e->out = 1;
+            mark_dirty(t, i);
+            continue;
+        }
+        order[n++] = i;
+    }
+    if (n < 2 || (t->format == TOURNEY_SWISS && t->round >= t->rounds)) {
+        free(order);
+        finish(t);
+        return;
+    }
+
+    t->round++;
+    t->nmatches = 0;
+    char line[64];
+    int len = snprintf(line, sizeof(line), "Tr%d;%d;%d\n", t->id, t->round, t->rounds);
+    broadcast(t, line, len);
+    log_event(EV_TOURNEY_ROUND, -1, t->id, t->round, format_names[t->format]);
+
+    if (t->format == TOURNEY_SWISS) pair_swiss(t, order, n);
+    else pair_knockout(t, order, n);
+    free(order);
+    seat_pending(t);
+    if (t->games_left == 0) queue_flush(t);
+}
+
+static void start_tourney(struct tourney *t) {
+    if (t->format == TOURNEY_KNOCKOUT) {
+        t->rounds = 0;
+        while ((1 << t->rounds) < t->nentrants) t->rounds++;
+    }
+    for (int i = 0; i < t->nentrants; i++) {
+        t->entrants[i].opponents = malloc(sizeof(int) * (t->rounds ? t->rounds : 1));
+        if (!t->entrants[i].opponents) err_sys("tourney alloc");
+    }
+    t->state = TOURNEY_RUNNING;
+    start_round(t);
+}
+
+static int by_final(const void *x, const void *y) {
+    int a = *(const int *)x, b = *(const int *)y;
+    const struct entrant *ea = &sort_t->entrants[a], *eb = &sort_t->entrants[b];
+    // Knockout: whoever lasted longest; Swiss: points
+    if (sort_t->format == TOURNEY_KNOCKOUT && ea->out != eb->out) return ea->out - eb->out;
+    if (ea->points != eb->points) return eb->points - ea->points;
+    return a - b;
+}
+
+static void finish(struct tourney *t) {
+    int *order = malloc(sizeof(int) * (t->nentrants ? t->nentrants : 1));
+    if (!order) err_sys("tourney alloc");
+    for (int i = 0; i < t->nentrants; i++) order[i] = i;
+    sort_t = t;
+    qsort(order, t->nentrants, sizeof(int), by_final);
+
+    char *batch = malloc((TOURNEY_TOP + 1) * (MAX_NAME_LEN + 48));
+    if (!batch) err_sys("tourney alloc");
+    size_t len = 0;
+    int top = t->nentrants < TOURNEY_TOP ? t->nentrants : TOURNEY_TOP;
+    for (int i = 0; i < top; i++) {
+        struct entrant *e = &t->entrants[order[i]];
+        len += sprintf(batch + len, "Tf%d;%d;%s;%d\n", t->id, i + 1, e->name, e->points);
+    }
+    const char *winner = t->nentrants ? t->entrants[order[0]].name : "";
+    len += sprintf(batch + len, "Te%d;%s\n", t->id, winner);
+    broadcast(t, batch, len);
+    log_event(EV_TOURNEY_DONE, -1, t->id, t->nentrants, winner);
+
+    free(batch);
+    free(order);
+    t->state = TOURNEY_DONE;
+}
+
+// ---- results ----
+
+static void record_result(struct tourney *t, struct match *m, long long winner) {
+    struct entrant *ea = &t->entrants[m->a], *eb = &t->entrants[m->b];
+    int win_a = winner == ea->player_id, win_b = winner == eb->player_id;
+
+    if (t->format == TOURNEY_SWISS) {
+        if (win_a) ea->points += 2;
+        else if (win_b) eb->points += 2;
+        else if (winner == GAME_DRAW) {
+            ea->points++;
+            eb->points++;
+        }
+    } else {
+        // No winner (draw or abandoned): the better seed goes through
+        if (!win_a && !win_b) win_a = m->a < m->b;
+        if (win_a) {
+            ea->points += 2;
+            eb->out = 1;
+        } else {
+            eb->points += 2;
+            ea->out = 1;
+        }
+    }
+    mark_dirty(t, m->a);
+    mark_dirty(t, m->b);
+    t->games_left--;
+}
+
+void tourney_game_over(struct Room *room, long long winner) {
+    int slot = ROOM_SLOT(room);
+    if (room_tourney[slot] < 0) return;
+    struct tourney *t = &tourneys[room_tourney[slot]];
+    struct match *m = &t->matches[room_match[slot]];
+    room_tourney[slot] = -1;
+    m->room_slot = -1;
+    record_result(t, m, winner);
+}
+
+// Score lines for whoever changed, in one batch per event, and the next
+// round once the current one is complete
+void tourney_flush(void) {
+    int list[TOURNEY_MAX], n = flush_count;
+
+    // Work queued from here on (a new round's byes and forfeits) waits a round
+    memcpy(list, flush_list, sizeof(int) * n);
+    flush_count = 0;
+    for (int f = 0; f < n; f++) {
+        struct tourney *t = &tourneys[list[f]];
+        t->queued = 0;
+        if (t->unseated > 0) seat_pending(t);
+
+        if (t->ndirty > 0) {
+            size_t cap = (size_t)t->ndirty * (MAX_NAME_LEN + 48), len = 0;
+            char *batch = malloc(cap);
+            if (!batch) err_sys("tourney alloc");
+            for (int i = 0; i < t->ndirty; i++) {
+                struct entrant *e = &t->entrants[t->dirty[i]];
+                e->dirty = 0;
+                len += snprintf(batch + len, cap - len, "Ts%d;%s;%d;%d\n", t->id, e->name, e->points, e->out);
+            }
+            t->ndirty = 0;
+            broadcast(t, batch, len);
+            free(batch);
+        }
+
+        if (t->state == TOURNEY_RUNNING && t->games_left == 0 && t->unseated == 0) start_round(t);
+    }
+}
+
+// Once a second: events whose start time has come, and another try at
+// seating matches that found no free room
+void tourney_housekeeping(time_t now) {
+    for (int i = 0; i < TOURNEY_MAX; i++) {
+        struct tourney *t = &tourneys[i];
+        if (t->id == 0) continue;
+        if (t->state == TOURNEY_RUNNING && t->unseated > 0) queue_flush(t);
+        if (t->state != TOURNEY_OPEN || !t->start_at || now < t->start_at) continue;
+        if (t->nentrants >= 2) start_tourney(t);
+        else finish(t);
+    }
+}
+
+// ---- client commands ----
+
+static int find_watcher(struct tourney *t, long long id) {
+    for (int i = 0; i < t->nwatchers; i++) {
+        if (t->watchers[i] == id) return i;
+    }
+    return -1;
+}
+
+static int find_entrant(struct tourney *t, long long id) {
+    for (int i = 0; i < t->nentrants; i++) {
+        if (t->entrants[i].player_id == id) return i;
+    }
+    return -1;
+}
+
+static void notice(struct Player *p, const char *text) {
+    send_line(p->fd, "w%s\n", text);
+}
+
+static void tourney_join(struct Player *p, struct tourney *t) {
+    const char *err = NULL;
+    if (t->state != TOURNEY_OPEN) err = "Tournament already started";
+    else if (find_entrant(t, p->id) >= 0) err = "Already signed up";
+    else if (t->nentrants >= t->capacity) err = "Tournament full";
+    if (err) {
+        notice(p, err);
+        return;
+    }
+
+    struct entrant *e = &t->entrants[t->nentrants++];
+    memset(e, 0, sizeof(*e));
+    e->player_id = p->id;
+    e->pslot = (int)(p - players);
+    snprintf(e->name, sizeof(e->name), "%s", p->name);
+    send_info(t, p->fd);
+    if (t->nentrants == t->capacity) start_tourney(t);
+}
+
+static void tourney_watch(struct Player *p, struct tourney *t) {
+    if (find_watcher(t, p->id) < 0) {
+        if (t->nwatchers >= cfg.max_clients) {
+            notice(p, "Too many watchers");
+            return;
+        }
+        t->watchers[t->nwatchers++] = p->id;
+    }
+    send_info(t, p->fd);
+    // Catch-up: the whole table once, deltas from then on
+    for (int i = 0; i < t->nentrants; i++) {
+        struct entrant *e = &t->entrants[i];
+        send_line(p->fd, "Ts%d;%s;%d;%d\n", t->id, e->name, e->points, e->out);
+    }
+}
+
+static void tourney_leave(struct Player *p, struct tourney *t) {
+    int w = find_watcher(t, p->id);
+    if (w >= 0) t->watchers[w] = t->watchers[--t->nwatchers];
+
+    int e = find_entrant(t, p->id);
+    if (e >= 0 && t->state == TOURNEY_OPEN) {
+        memmove(&t->entrants[e], &t->entrants[e + 1], sizeof(struct entrant) * (t->nentrants - e - 1));
+        t->nentrants--;
+    } else if (e >= 0 && t->state == TOURNEY_RUNNING && !t->entrants[e].out) {
+        // Withdrawn: a game in progress still counts, later rounds skip them
+        t->entrants[e].out = 1;
+        mark_dirty(t, e);
+    }
+    send_info(t, p->fd);
+}
+
+void tourney_handle(struct Player *p, const char *message) {
+    long long pid;
+    int id = 0;
+    if (sscanf(message + 2, "%lld;%d", &pid, &id) < 1 || pid != p->id) return;
+
+    if (message[1] == 'i') {
+        for (int i = 0; i < TOURNEY_MAX; i++) {
+            if (tourneys[i].id) send_info(&tourneys[i], p->fd);
+        }
+        send_line(p->fd, "Tz\n");
+        return;
+    }
+
+    struct tourney *t = find_tourney(id);
+    if (!t) {
+        notice(p, "No such tournament");
+        return;
+    }
+    switch (message[1]) {
+        case 'j': tourney_join(p, t); break;
+        case 'w': tourney_watch(p, t); break;
+        case 'l': tourney_leave(p, t); break;
+    }
+}
+
+// ---- admin endpoint ----
+
+static int param(const char *query, const char *key, char *val, size_t size) {
+    size_t klen = strlen(key);
+    for (const char *q = query; q && *q; q = strchr(q, '&'), q = q ? q + 1 : NULL) {
+        if (strncmp(q, key, klen) == 0 && q[klen] == '=') {
+            size_t n = strcspn(q + klen + 1, "& \r\n");
+            if (n >= size) n = size - 1;
+            memcpy(val, q + klen + 1, n);
+            val[n] = '\0';
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * GET /tourney                 list events
+ * GET /tourney/open?format=swiss|knockout&players=N[&rounds=N][&variant=V][&start=S]
+ *                              start S seconds from now, or when full
+ * GET /tourney/start?id=N      start now with whoever signed up
+ * GET /tourney/standings?id=N  full table
+ */
+int tourney_admin(const char *path, char *out, size_t size) {
+    const char *query = strchr(path, '?');
+    char val[32];
+    int len = 0;
+    query = query ? query + 1 : "";
+
+    if (strncmp(path, "/tourney/open", 13) == 0) {
+        int format = TOURNEY_SWISS, capacity = 0, rounds = TOURNEY_SWISS_ROUNDS, start = 0;
+        const struct game_variant *v = GAME_CLASSIC;
+        if (param(query, "format", val, sizeof(val)) && strcmp(val, "knockout") == 0) format = TOURNEY_KNOCKOUT;
+        if (param(query, "players", val, sizeof(val))) capacity = atoi(val);
+        if (param(query, "rounds", val, sizeof(val))) rounds = atoi(val);
+        if (param(query, "start", val, sizeof(val))) start = atoi(val);
+        if (param(query, "variant", val, sizeof(val)) && !(v = game_variant_find(val))) {
+            return stats_append(out, size, 0, "error unknown variant\n");
+        }
+        if (capacity < 2 || capacity > cfg.max_clients || rounds < 1) {
+            return stats_append(out, size, 0, "error players must be 2..%d, rounds >= 1\n", cfg.max_clients);
+        }
+        int id = open_tourney(format, capacity, rounds, v, start);
+        if (id < 0) return stats_append(out, size, 0, "error %d events already open\n", TOURNEY_MAX);
+        return stats_append(out, size, 0, "opened %d\n", id);
+    }
+
+    int starting = strncmp(path, "/tourney/start", 14) == 0;
+    if (starting || strncmp(path, "/tourney/standings", 18) == 0) {
+        struct tourney *t = param(query, "id", val, sizeof(val)) ? find_tourney(atoi(val)) : NULL;
+        if (!t) return stats_append(out, size, 0, "error no such event\n");
+        if (starting) {
+            if (t->state != TOURNEY_OPEN || t->nentrants < 2) return stats_append(out, size, 0, "error cannot start\n");
+            start_tourney(t);
+            return stats_append(out, size, 0, "started %d\n", t->id);
+        }
+        int *order = malloc(sizeof(int) * (t->nentrants ? t->nentrants : 1));
+        if (!order) err_sys("tourney alloc");
+        for (int i = 0; i < t->nentrants; i++) order[i] = i;
+        sort_t = t;
+        qsort(order, t->nentrants, sizeof(int), by_final);
+        len = stats_append(out, size, len, "# event %d %s round %d/%d\n", t->id, state_names[t->state], t->round, t->rounds);
+        for (int i = 0; i < t->nentrants; i++) {
+            struct entrant *e = &t->entrants[order[i]];
+            len = stats_append(out, size, len, "%d %s %d.%d%s\n", i + 1, e->name, e->points / 2,
+                               e->points % 2 ? 5 : 0, e->out ? " out" : "");
+        }
+        free(order);
+        return len;
+    }
+
+    len = stats_append(out, size, len, "# id format state round rounds entrants capacity games_left variant\n");
+    for (int i = 0; i < TOURNEY_MAX; i++) {
+        struct tourney *t = &tourneys[i];
+        if (!t->id) continue;
+        len = stats_append(out, size, len, "%d %s %s %d %d %d %d %d %s\n", t->id, format_names[t->format],
+                           state_names[t->state], t->round, t->rounds, t->nentrants, t->capacity,
+                           t->games_left, t->variant->name);
+    }
+    return len;
+}
@@ -0,0 +1,50 @@
+#ifndef TOURNEY_H
+#define TOURNEY_H
+
+#include <stddef.h>
+#include <time.h>
+
+#define TOURNEY_MAX 8          // events open or running at once
+#define TOURNEY_TOP 10         // final standings lines pushed at the end
+#define TOURNEY_SWISS_ROUNDS 5 // default length of a Swiss event
+
+#define TOURNEY_SWISS 0
+#define TOURNEY_KNOCKOUT 1
+
+#define TOURNEY_OPEN 0
+#define TOURNEY_RUNNING 1
+#define TOURNEY_DONE 2
+
+/*
+ * Tournaments: an event is opened from the admin endpoint, players sign up
+ * with "tj", and when it fills (or its start time comes) every round is
+ * paired and seated in bulk through create_room()/join_room(). Rounds are
+ * Swiss (score groups, no rematches, one bye per player) or single
+ * elimination (top seed against bottom seed, lower seed through on a draw).
+ *
+ * end_game() reports each result here; recording it only touches the two
+ * entrants. Once per poll round tourney_flush() pushes the score lines of
+ * the entrants that changed to participants and watchers, and pairs the
+ * next round of an event whose last game has just ended. Nothing scans
+ * the field except pairing itself, once per round.
+ *
+ * Client commands: tj<id>;<event> join, tw<id>;<event> watch, tl<id>;<event>
+ * leave, ti<id> list. Server lines start with 'T':
+ *   To<event>;<format>;<rounds>;<capacity>;<variant>;<entrants>;<state>
+ *   Tr<event>;<round>;<rounds>         round starts
+ *   Tm<event>;<round>;<room>;<opponent> your game (Tb<event>;<round> a bye)
+ *   Ts<event>;<name>;<half points>;<out>
+ *   Tf<event>;<rank>;<name>;<half points>, then Te<event>;<winner>
+ *   Tz                                 end of a ti listing
+ */
+struct Room;
+struct Player;
+
+void tourney_init(void);
+void tourney_handle(struct Player *player, const char *message);
+void tourney_game_over(struct Room *room, long long winner);
+void tourney_flush(void);
+void tourney_housekeeping(time_t now);
+int tourney_admin(const char *path, char *out, size_t size);
+
+#endif
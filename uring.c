@@ -0,0 +1,617 @@
+#include "server.h"
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include "stats.h"
+#include "chat.h"
+#include "uring.h"
+#include "cluster.h"
+#include "relay.h"
+#include "tourney.h"
+#include "capture.h"
+#include "movetrace.h"
+
+int uring_active = 0;
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+// Multishot recv (6.0) is the newest feature used; older headers get the stub
+#if defined(IORING_RECV_MULTISHOT) && defined(IORING_ACCEPT_MULTISHOT) && defined(__NR_io_uring_setup)
+
+#define URING_OUT_MAX (256 * 1024)   // queued output per connection before we drop
+
+/*
+ * user_data: a send carries its struct send_op pointer (8-byte aligned, low
+ * bits zero); every other request carries a kind in the low 3 bits, the
+ * client slot and the slot's generation, so completions for a connection
+ * that has since been closed are recognised and ignored.
+ */
+#define UD_ACCEPT 1
+#define UD_RECV 2
+#define UD_POLL 3
+#define UD_CANCEL 4
+#define UD(kind, slot, gen) ((unsigned long long)(kind) | ((unsigned long long)(slot) << 3) | \
+                             ((unsigned long long)(gen) << 32))
+#define UD_KIND(ud) ((int)((ud) & 7))
+#define UD_SLOT(ud) ((int)(((ud) >> 3) & 0x1fffffff))
+#define UD_GEN(ud) ((unsigned)((ud) >> 32))
+
+struct send_op {
+    int slot;
+    int fd;
+    unsigned gen;
+    char *data;
+    size_t cap;
+    size_t len;
+    size_t off;
+};
+
+struct uring_conn {
+    int fd;                   // clients[slot].fd this state belongs to
+    unsigned gen;
+    int armed;                // recv (or poll, for admin slots) outstanding
+    int canceling;
+    int dirty;
+    struct send_op *inflight; // at most one send per connection, keeps order
+    char *out;                // written since the last send was queued
+    size_t out_len;
+    size_t out_cap;
+    char *spare;              // previous send buffer, reused for `out`
+    size_t spare_cap;
+    unsigned long long queued; // bytes taken by uring_send() since the connection began
+    unsigned long long sent;   // of which the kernel has sent
+};
+
+static int ring_fd = -1;
+static unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+static unsigned sq_entries;
+static unsigned sq_local_tail;
+static struct io_uring_sqe *sqes;
+static unsigned *cq_head, *cq_tail, *cq_mask;
+static struct io_uring_cqe *cqes;
+
+static struct io_uring_buf_ring *buf_ring;
+static char *buf_base;
+static unsigned short buf_tail;
+
+static int multishot_recv = 1;
+static int accept_armed = 0;
+static int sends_outstanding = 0;
+
+static struct uring_conn *conns;   // by client slot, cfg.max_clients entries
+static int *fd_slot;               // by fd, cfg.max_fd entries
+static int *dirty_slots;
+static int ndirty = 0;
+
+static int sys_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(unsigned submit, unsigned wait, unsigned flags, void *arg, size_t argsz) {
+    return (int)syscall(__NR_io_uring_enter, ring_fd, submit, wait, flags, arg, argsz);
+}
+
+static int sys_register(unsigned op, void *arg, unsigned nr) {
+    return (int)syscall(__NR_io_uring_register, ring_fd, op, arg, nr);
+}
+
+// ---- rings ----
+
+static int ring_submit(int wait_ms) {
+    __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+    unsigned pending = sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    if (wait_ms < 0) return pending ? sys_enter(pending, 0, 0, NULL, 0) : 0;
+
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    ts.tv_sec = wait_ms / 1000;
+    ts.tv_nsec = (long long)(wait_ms % 1000) * 1000000;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (unsigned long long)(uintptr_t)&ts;
+    return sys_enter(pending, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+static struct io_uring_sqe *get_sqe(void) {
+    while (sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+        if (ring_submit(-1) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            err_sys("io_uring_enter error");
+    }
+    unsigned idx = sq_local_tail & *sq_mask;
+    struct io_uring_sqe *sqe = &sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array[idx] = idx;
+    sq_local_tail++;
+    return sqe;
+}
+
+static void buf_recycle(int bid) {
+    struct io_uring_buf *b = &buf_ring->bufs[buf_tail & (cfg.uring_bufs - 1)];
+    b->addr = (unsigned long long)(uintptr_t)(buf_base + (size_t)bid * MAXLINE);
+    b->len = MAXLINE - 1;   // room for handle_client_message()'s terminator
+    b->bid = (unsigned short)bid;
+    buf_tail++;
+    __atomic_store_n(&buf_ring->tail, buf_tail, __ATOMIC_RELEASE);
+}
+
+static int ops_supported(void) {
+    static const int needed[] = {
+        IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_POLL_ADD, IORING_OP_ASYNC_CANCEL
+    };
+    size_t len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, len);
+    int ok = probe && sys_register(IORING_REGISTER_PROBE, probe, 256) == 0;
+
+    for (int i = 0; ok && i < (int)(sizeof(needed) / sizeof(needed[0])); i++) {
+        if (needed[i] > probe->last_op || !(probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED)) ok = 0;
+    }
+    free(probe);
+    return ok;
+}
+
+static int setup_buffers(void) {
+    buf_ring = mmap(NULL, cfg.uring_bufs * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf_ring == MAP_FAILED) {
+        buf_ring = NULL;
+        return -1;
+    }
+    buf_base = malloc((size_t)cfg.uring_bufs * MAXLINE);
+    if (!buf_base) return -1;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long long)(uintptr_t)buf_ring;
+    reg.ring_entries = cfg.uring_bufs;
+    reg.bgid = URING_BUF_GROUP;
+    if (sys_register(IORING_REGISTER_PBUF_RING, &reg, 1) < 0) return -1;
+
+    for (int i = 0; i < cfg.uring_bufs; i++) buf_recycle(i);
+    return 0;
+}
+
+int uring_init(void) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    ring_fd = sys_setup(cfg.uring_entries, &p);
+    if (ring_fd < 0) return -1;
+
+    unsigned need = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((p.features & need) != need) goto fail;
+
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    char *ring = mmap(NULL, sq_size > cq_size ? sq_size : cq_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED) goto fail;
+    sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) goto fail;
+
+    sq_head = (unsigned *)(ring + p.sq_off.head);
+    sq_tail = (unsigned *)(ring + p.sq_off.tail);
+    sq_mask = (unsigned *)(ring + p.sq_off.ring_mask);
+    sq_array = (unsigned *)(ring + p.sq_off.array);
+    sq_entries = p.sq_entries;
+    sq_local_tail = *sq_tail;
+    cq_head = (unsigned *)(ring + p.cq_off.head);
+    cq_tail = (unsigned *)(ring + p.cq_off.tail);
+    cq_mask = (unsigned *)(ring + p.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *)(ring + p.cq_off.cqes);
+
+    if (!ops_supported() || setup_buffers() < 0) goto fail;
+
+    conns = pool_alloc(cfg.max_clients, sizeof(struct uring_conn));
+    fd_slot = pool_alloc(cfg.max_fd, sizeof(int));
+    dirty_slots = pool_alloc(cfg.max_clients, sizeof(int));
+    memset(fd_slot, -1, sizeof(int) * cfg.max_fd);
+    for (int i = 0; i < cfg.max_clients; i++) conns[i].fd = -1;
+    uring_active = 1;
+    return 0;
+
+fail:
+    // Mappings of a failed ring are left as they are; the process goes on with poll()
+    close(ring_fd);
+    ring_fd = -1;
+    return -1;
+}
+
+// ---- connections ----
+
+static void cancel_request(unsigned long long ud) {
+    struct io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = ud;
+    sqe->user_data = UD_CANCEL;
+}
+
+static unsigned long long armed_ud(int slot) {
+    int kind = (slot == ADMIN_SLOT || stats_is_admin_conn(slot) || cluster_owns_slot(slot) ||
+                relay_owns_slot(slot)) ? UD_POLL : UD_RECV;
+    return UD(kind, slot, conns[slot].gen);
+}
+
+// Resyncs the state of a slot whose connection changed behind our back
+// (accepted, restored after an upgrade, or an admin connection closed)
+static struct uring_conn *conn_sync(int slot) {
+    struct uring_conn *c = &conns[slot];
+    if (c->fd == clients[slot].fd) return c;
+
+    if (c->fd >= 0 && c->fd < cfg.max_fd && fd_slot[c->fd] == slot) fd_slot[c->fd] = -1;
+    c->fd = clients[slot].fd;
+    c->gen++;
+    c->armed = 0;
+    c->canceling = 0;
+    c->inflight = NULL;
+    c->out_len = 0;
+    c->queued = c->sent = 0;
+    movetrace_drop(slot);
+    if (c->fd >= 0 && c->fd < cfg.max_fd) fd_slot[c->fd] = slot;
+    return c;
+}
+
+// The slot's poll events changed: cancel its poll so the next arm pass uses them
+void uring_rearm(int slot) {
+    struct uring_conn *c = conn_sync(slot);
+    if (!c->armed || c->canceling) return;
+    cancel_request(armed_ud(slot));
+    c->canceling = 1;
+}
+
+void uring_forget(int slot) {
+    struct uring_conn *c = &conns[slot];
+    if (c->fd != clients[slot].fd) return;
+
+    // Cancel by user_data: the fd is about to be closed and may be reused
+    if (c->armed) cancel_request(armed_ud(slot));
+    if (c->inflight) cancel_request((unsigned long long)(uintptr_t)c->inflight);
+    if (c->fd >= 0 && c->fd < cfg.max_fd) fd_slot[c->fd] = -1;
+    // An in-flight send_op now has a stale generation and frees itself
+    c->fd = -1;
+    c->gen++;
+    c->armed = 0;
+    c->canceling = 0;
+    c->inflight = NULL;
+    c->out_len = 0;
+    c->queued = c->sent = 0;
+    movetrace_drop(slot);
+}
+
+static void queue_send(struct send_op *op) {
+    struct io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = op->fd;
+    sqe->addr = (unsigned long long)(uintptr_t)(op->data + op->off);
+    sqe->len = (unsigned)(op->len - op->off);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = (unsigned long long)(uintptr_t)op;
+}
+
+static void start_send(int slot) {
+    struct uring_conn *c = &conns[slot];
+    struct send_op *op = malloc(sizeof(*op));
+    if (!op) err_sys("malloc error");
+    op->slot = slot;
+    op->fd = c->fd;
+    op->gen = c->gen;
+    op->data = c->out;
+    op->cap = c->out_cap;
+    op->len = c->out_len;
+    op->off = 0;
+
+    c->out = c->spare;
+    c->out_cap = c->spare_cap;
+    c->out_len = 0;
+    c->spare = NULL;
+    c->spare_cap = 0;
+    c->inflight = op;
+    sends_outstanding++;
+    queue_send(op);
+}
+
+static void mark_dirty(int slot) {
+    if (conns[slot].dirty) return;
+    conns[slot].dirty = 1;
+    dirty_slots[ndirty++] = slot;
+}
+
+// One send per connection with output; all of them leave with the next enter
+static void flush_sends(void) {
+    for (int i = 0; i < ndirty; i++) {
+        int slot = dirty_slots[i];
+        struct uring_conn *c = &conns[slot];
+        c->dirty = 0;
+        // A connection with a send in flight is restarted from send_done()
+        if (c->fd < 0 || c->inflight || c->out_len == 0) continue;
+        start_send(slot);
+    }
+    ndirty = 0;
+}
+
+void uring_send(int fd, const void *buf, size_t len) {
+    int slot = (fd >= 0 && fd < cfg.max_fd) ? fd_slot[fd] : -1;
+    if (slot < 0 || clients[slot].fd != fd) {
+        slot = -1;
+        for (int i = 1; i <= maxi; i++) {
+            if (clients[i].fd == fd) {
+                slot = i;
+                break;
+            }
+        }
+    }
+    if (slot < 0) {
+        // Not a client socket (or out of fd_slot range): plain blocking write
+        if (writen(fd, buf, len) == (ssize_t)len) {
+            stats.bytes_out += len;
+        } else {
+            stats.write_errors++;
+        }
+        if (movetrace_active) movetrace_write(fd, -1, 0);
+        return;
+    }
+
+    struct uring_conn *c = conn_sync(slot);
+    if (c->out_len + len > URING_OUT_MAX) {
+        // The peer stopped reading; drop rather than grow without bound
+        stats.write_errors++;
+        return;
+    }
+    if (c->out_len + len > c->out_cap) {
+        size_t cap = c->out_cap ? c->out_cap : 4096;
+        while (cap < c->out_len + len) cap *= 2;
+        char *out = realloc(c->out, cap);
+        if (!out) err_sys("realloc error");
+        c->out = out;
+        c->out_cap = cap;
+    }
+    memcpy(c->out + c->out_len, buf, len);
+    c->out_len += len;
+    c->queued += len;
+    // A move's output to this connection is flushed once `sent` reaches this
+    if (movetrace_active) movetrace_write(fd, slot, c->queued);
+    mark_dirty(slot);
+}
+
+// ---- completions ----
+
+static void send_done(struct send_op *op, int res) {
+    int slot = op->slot;
+    struct uring_conn *c = &conns[slot];
+    int current = (op->gen == c->gen && c->inflight == op);
+
+    if (current && res > 0) {
+        stats.bytes_out += res;
+        op->off += res;
+        c->sent += res;
+        movetrace_sent(slot, c->sent);
+        if (op->off < op->len) {
+            queue_send(op);
+            return;
+        }
+    } else if (current && res != -ECANCELED) {
+        stats.write_errors++;
+    }
+    sends_outstanding--;
+
+    if (!current) {
+        free(op->data);
+        free(op);
+        return;
+    }
+    c->inflight = NULL;
+    if (!c->spare) {
+        c->spare = op->data;
+        c->spare_cap = op->cap;
+    } else {
+        free(op->data);
+    }
+    free(op);
+    if (c->out_len > 0) mark_dirty(slot);
+}
+
+static void accept_done(int res, unsigned flags) {
+    if (!(flags & IORING_CQE_F_MORE)) accept_armed = 0;
+    if (res < 0) return;
+    add_client(res, NULL);
+}
+
+static void recv_done(int slot, unsigned gen, int res, unsigned flags) {
+    struct uring_conn *c = &conns[slot];
+    int bid = (flags & IORING_CQE_F_BUFFER) ? (int)(flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+
+    if (gen != c->gen || c->fd != clients[slot].fd) {
+        if (bid >= 0) buf_recycle(bid);
+        return;
+    }
+    if (!(flags & IORING_CQE_F_MORE)) {
+        c->armed = 0;
+        c->canceling = 0;
+    }
+
+    if (res > 0 && bid >= 0) {
+        stats.bytes_in += res;
+        capture_data(slot, buf_base + (size_t)bid * MAXLINE, res);
+        int rc = handle_client_message(c->fd, buf_base + (size_t)bid * MAXLINE, res);
+        buf_recycle(bid);
+        if (rc < 0) {
+            drop_client(slot);
+        } else if (clients[slot].events == 0 && c->armed && !c->canceling) {
+            // Paused by the rate limiter: stop reading until it resumes
+            cancel_request(UD(UD_RECV, slot, c->gen));
+            c->canceling = 1;
+        }
+        return;
+    }
+    if (bid >= 0) buf_recycle(bid);
+
+    // Out of buffers or cancelled: the next arm pass starts a new recv
+    if (res == -ENOBUFS || res == -ECANCELED) return;
+    if (res == -EINVAL && multishot_recv) {
+        // Kernel without multishot recv: fall back to one recv per request
+        multishot_recv = 0;
+        return;
+    }
+    drop_client(slot);
+}
+
+static void poll_done(int slot, unsigned gen, int res) {
+    struct uring_conn *c = &conns[slot];
+    if (gen != c->gen || c->fd != clients[slot].fd) return;
+    c->armed = 0;
+    c->canceling = 0;
+    if (res < 0) return;
+
+    if (slot == ADMIN_SLOT) {
+        stats_accept();
+    } else if (cluster_owns_slot(slot)) {
+        cluster_serve(slot);
+    } else if (relay_owns_slot(slot)) {
+        relay_serve(slot);
+    } else if (stats_is_admin_conn(slot)) {
+        stats_serve(slot);
+    }
+}
+
+static void reap(void) {
+    unsigned head = *cq_head;
+    while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &cqes[head & *cq_mask];
+        unsigned long long ud = cqe->user_data;
+        int res = cqe->res;
+        unsigned flags = cqe->flags;
+        head++;
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+
+        switch (UD_KIND(ud)) {
+            case 0: send_done((struct send_op *)(uintptr_t)ud, res); break;
+            case UD_ACCEPT: accept_done(res, flags); break;
+            case UD_RECV: recv_done(UD_SLOT(ud), UD_GEN(ud), res, flags); break;
+            case UD_POLL: poll_done(UD_SLOT(ud), UD_GEN(ud), res); break;
+        }
+    }
+}
+
+// Starts a read request on every connection that wants input and has none
+static void arm_all(void) {
+    if (!accept_armed) {
+        struct io_uring_sqe *sqe = get_sqe();
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = listenfd;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_CLOEXEC;
+        sqe->user_data = UD_ACCEPT;
+        accept_armed = 1;
+    }
+
+    for (int i = 1; i <= maxi; i++) {
+        struct uring_conn *c = conn_sync(i);
+        if (c->fd < 0 || c->armed || clients[i].events == 0) continue;
+
+        struct io_uring_sqe *sqe = get_sqe();
+        sqe->fd = c->fd;
+        sqe->user_data = armed_ud(i);
+        if (UD_KIND(sqe->user_data) == UD_POLL) {
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->poll32_events = (clients[i].events & POLLWRNORM) ? POLLIN | POLLOUT : POLLIN;
+        } else {
+            sqe->opcode = IORING_OP_RECV;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = URING_BUF_GROUP;
+            sqe->ioprio = multishot_recv ? IORING_RECV_MULTISHOT : 0;
+        }
+        c->armed = 1;
+    }
+}
+
+static int busy(void) {
+    if (accept_armed || sends_outstanding > 0) return 1;
+    for (int i = 1; i <= maxi; i++) {
+        if (conns[i].armed || (conns[i].fd >= 0 && conns[i].out_len > 0)) return 1;
+    }
+    return 0;
+}
+
+/*
+ * Before a hot upgrade: cancel every read and let queued output drain, so
+ * no input is taken off a socket after it has been handed over and nothing
+ * we accepted to send is left behind. Input that completes meanwhile is
+ * handled as usual.
+ */
+static void quiesce(void) {
+    if (accept_armed) cancel_request(UD_ACCEPT);
+    for (int i = 1; i <= maxi; i++) {
+        struct uring_conn *c = &conns[i];
+        if (c->armed && !c->canceling) {
+            cancel_request(armed_ud(i));
+            c->canceling = 1;
+        }
+    }
+
+    long long deadline = monotonic_ns() + URING_DRAIN_MS * 1000000LL;
+    while (monotonic_ns() < deadline) {
+        chat_flush_pending();
+        flush_sends();
+        if (!busy()) break;
+        ring_submit(100);
+        reap();
+    }
+}
+
+void uring_run(void) {
+    while (1) {
+        // Results of the previous round, then its batched chat
+        tourney_flush();
+        chat_flush_pending();
+        cluster_flush();
+        if (upgrade_requested) {
+            upgrade_requested = 0;
+            quiesce();
+            hot_upgrade();
+            // Still here: the upgrade failed, the next arm pass resumes reads
+        }
+        if (reload_requested) {
+            reload_requested = 0;
+            config_reload();
+        }
+        arm_all();
+        flush_sends();
+        if (ring_submit(cfg.poll_timeout_ms) < 0 &&
+            errno != EINTR && errno != ETIME && errno != EAGAIN && errno != EBUSY) {
+            err_sys("io_uring_enter error");
+        }
+        server_housekeeping();
+        reap();
+    }
+}
+
+#else
+
+int uring_init(void) {
+    return -1;
+}
+
+void uring_run(void) {
+}
+
+void uring_send(int fd, const void *buf, size_t len) {
+    (void)fd;
+    (void)buf;
+    (void)len;
+}
+
+void uring_rearm(int slot) {
+    (void)slot;
+}
+
+void uring_forget(int slot) {
+    (void)slot;
+}
+
+#endif
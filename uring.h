@@ -0,0 +1,32 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+
+#define URING_BUF_GROUP 0
+#define URING_DRAIN_MS 2000      // longest wait for queued sends before an upgrade
+
+/*
+ * io_uring backend for the event loop, driven through the raw syscalls.
+ *
+ * - one multishot accept on the listening socket
+ * - one multishot recv per client, drawing from a provided buffer ring
+ * - client_write() appends to a per-connection output buffer; each round
+ *   the buffers are turned into one send per connection and the whole
+ *   fan-out goes to the kernel with the round's single io_uring_enter()
+ * - the admin listener, admin connections, cluster links and relay
+ *   upstreams are poll requests that call back into their modules
+ *
+ * Queue depth and receive buffer count are cfg.uring_entries and
+ * cfg.uring_bufs. uring_init() fails on kernels or headers without the features above and
+ * the server keeps using poll().
+ */
+extern int uring_active;
+
+int uring_init(void);
+void uring_run(void);
+void uring_send(int fd, const void *buf, size_t len);
+void uring_rearm(int slot);
+void uring_forget(int slot);
+
+#endif